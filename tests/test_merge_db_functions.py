@@ -28,6 +28,8 @@ import sys
 import os
 import sqlite3
 
+import pytest
+
 sys.path.append("../tuna")
 sys.path.append("tuna")
 
@@ -36,10 +38,11 @@ this_path = os.path.dirname(__file__)
 from tuna.miopen.subcmd.merge_db import parse_jobline, parse_text_fdb_name, parse_text_pdb_name
 from tuna.miopen.subcmd.merge_db import target_merge
 from tuna.miopen.subcmd.merge_db import update_master_list, write_merge_results
-from tuna.miopen.subcmd.merge_db import merge_text_file
+from tuna.miopen.subcmd.merge_db import merge_text_file, pdbmerge_text_file
 from tuna.miopen.subcmd.merge_db import get_sqlite_table
 from tuna.miopen.subcmd.merge_db import get_sqlite_row, get_sqlite_data, load_master_list
 from tuna.miopen.utils.helper import prune_cfg_dims
+from tuna.miopen.utils.pdbmerge_lib import load_pdbmerge
 
 
 def test_parse_jobline():
@@ -517,6 +520,47 @@ def test_merge_text_file():
   assert (err_found)
 
 
+# Made up perf db records, the target replaces some solvers of the master, adds others and has
+# a key of its own. Solvers with the same first parameter are sorted by id.
+PDB_MASTER = """64-28-28-3x3-64-28-28-8-1x1-1x1-1x1-0-NCHW-FP32-F=ConvBinWinogradRxSf2x3:16,2;ConvOclDirectFwd:2,16,1
+128-14-14-1x1-256-14-14-16-0x0-1x1-1x1-0-NCHW-FP16-B=ConvAsm1x1U:4,8,1;GemmBwd1x1_stride1:4,1
+"""
+PDB_TARGET = """64-28-28-3x3-64-28-28-8-1x1-1x1-1x1-0-NCHW-FP32-F=ConvOclDirectFwd:32,4,2;ConvAsm3x3U:1,1
+256-7-7-3x3-512-7-7-32-1x1-1x1-1x1-0-NCHW-FP32-W=ConvAsmBwdWrW3x3:8,8,1
+"""
+
+
+@pytest.mark.parametrize('keep_keys', [False, True])
+@pytest.mark.parametrize('kind', ['fdb', 'pdb'])
+def test_pdbmerge_text_file(tmp_path, kind, keep_keys):
+  """pdbmerge_core merges text dbs into the same file as update_master_list and
+  write_merge_results"""
+  lib = load_pdbmerge()
+  if lib is None:
+    pytest.skip('pdbmerge_core not built, set TUNA_PDBMERGE_LIB')
+
+  if kind == 'fdb':
+    master_file = f'{this_path}/../utils/test_files/old_gfx90a68.HIP.fdb.txt'
+    target_file = f'{this_path}/../utils/test_files/usr_gfx90a68.HIP.fdb.txt'
+  else:
+    master_file = str(tmp_path / 'master.txt')
+    target_file = str(tmp_path / 'target.txt')
+    for path, contents in ((master_file, PDB_MASTER), (target_file, PDB_TARGET)):
+      with open(path, 'w') as db_file:
+        db_file.write(contents)
+
+  python_file = str(tmp_path / 'python.txt')
+  master_list = load_master_list(master_file)
+  update_master_list(master_list, [target_file], [-1], keep_keys)
+  write_merge_results(master_list, python_file, [])
+
+  merged_file = str(tmp_path / 'pdbmerge.txt')
+  pdbmerge_text_file(lib, master_file, target_file, merged_file, [], keep_keys)
+
+  with open(python_file) as python_fp, open(merged_file) as merged_fp:
+    assert merged_fp.read() == python_fp.read()
+
+
 def test_get_sqlite_table():
 
   local_path = "{0}/../utils/test_files/test_gfx90678.db".format(this_path)
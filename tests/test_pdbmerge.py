@@ -0,0 +1,990 @@
+#!/usr/bin/env python3
+###############################################################################
+#
+# MIT License
+#
+# Copyright (c) 2022 Advanced Micro Devices, Inc.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+###############################################################################
+"""runs the pdbmerge tool of utils/pdbmerge over generated text dbs"""
+import gzip
+import json
+import os
+import random
+import shutil
+import signal
+import sqlite3
+import struct
+import subprocess
+import threading
+import time
+
+import pytest
+
+from tuna.miopen.utils.metadata import SQLITE_CONFIG_COLS
+
+# Path of the pdbmerge executable, otherwise it is searched for in PATH
+PDBMERGE = os.environ.get('TUNA_PDBMERGE') or shutil.which('pdbmerge')
+
+pytestmark = pytest.mark.skipif(not PDBMERGE,
+                                reason='pdbmerge not built, set TUNA_PDBMERGE')
+
+SOLVERS = [
+    'ConvAsm1x1U', 'ConvBinWinogradRxS', 'ConvOclDirectFwd', 'ConvAsmBwdWrW3x3',
+    'ConvHipImplicitGemmV4R1Fwd', 'GemmFwd1x1_0_1'
+]
+
+
+def db_key(index):
+  """perf db key of a made up problem"""
+  rng = random.Random(index)
+  sizes = '-'.join(str(rng.randrange(1, 512)) for _ in range(7))
+  return f'{sizes}-{index}-NCHW-FP{16 if index % 2 else 32}-{"FBW"[index % 3]}'
+
+
+def db_value(index, solver, variant):
+  """parameters of a solver under a key, variants other than 0 conflict with it"""
+  rng = random.Random(f'{index}/{solver}/{variant}')
+  return ','.join(str(rng.randrange(1, 64)) for _ in range(rng.randrange(3, 24)))
+
+
+def write_db(path, seed, keys=12000, records=3000, conflict_percent=10):
+  """writes a text perf db with records of a share of the keys, some of their items
+  conflict with the other files and a few lines are ill-formed"""
+  rng = random.Random(seed)
+  with open(path, 'w', encoding='utf-8') as db_file:
+    for index in sorted(rng.sample(range(keys), records)):
+      items = []
+      for solver in SOLVERS[:2 + index % (len(SOLVERS) - 1)]:
+        conflicts = rng.randrange(100) < conflict_percent
+        items.append(f'{solver}:{db_value(index, solver, seed if conflicts else 0)}')
+      db_file.write(f'{db_key(index)}={";".join(items)}\n')
+
+      if rng.randrange(500) == 0:
+        db_file.write('no key in this line\n')
+      if rng.randrange(500) == 0:
+        db_file.write(f'{db_key(index)}=\n')
+
+
+def load_db(db):
+  """records of a text db, its path or contents, by key, ill-formed lines are left out"""
+  if isinstance(db, bytes):
+    lines = db.decode().splitlines()
+  else:
+    with open(db, encoding='utf-8') as db_file:
+      lines = db_file.read().splitlines()
+
+  records = {}
+  for line in lines:
+    key, equals, value = line.partition('=')
+    if equals and value:
+      records[key] = value
+  return records
+
+
+@pytest.fixture(scope='module')
+def sources(tmp_path_factory):
+  """eight text dbs sharing keys, merged they have more keys than an output chunk"""
+  directory = tmp_path_factory.mktemp('sources')
+  paths = [str(directory / f'db{seed}.txt') for seed in range(8)]
+  for seed, path in enumerate(paths):
+    write_db(path, seed)
+  return paths
+
+
+def merge(directory, sources, *args, env=None):
+  """runs pdbmerge with the outputs in directory, returns the exit code, what it printed and
+  the contents of every output it wrote"""
+  os.makedirs(directory, exist_ok=True)
+  output = os.path.join(directory, 'out.txt')
+  commands = os.path.join(directory, 'commands.txt')
+  run = subprocess.run(
+      [PDBMERGE, '--verbosity', '3', '-o', output, '-c', commands, *args, *sources],
+      env=None if env is None else {**os.environ, **env},
+      capture_output=True,
+      check=False)
+  assert run.returncode in (0, 1), run.stderr.decode()
+
+  result = {'code': run.returncode, 'stdout': run.stdout, 'stderr': run.stderr}
+  for name in sorted(os.listdir(directory)):
+    with open(os.path.join(directory, name), 'rb') as output_file:
+      result[name] = output_file.read()
+  return result
+
+
+@pytest.mark.parametrize('mode', ['off', 'auto', 'majority'])
+def test_jobs_match_serial(tmp_path, sources, mode):
+  """sources parsed concurrently merge into the same bytes, warnings included"""
+  serial = merge(tmp_path / 'serial', sources, '-r', mode)
+  assert serial['out.txt']
+
+  for args in (['-j', '2'], ['-j', '4'], ['-j', '3', '--prefetch', '0'], ['-j', '4', '-m']):
+    assert merge(tmp_path / '_'.join(args), sources, '-r', mode, *args) == serial, args
+
+
+@pytest.mark.parametrize('mode', ['off', 'auto'])
+def test_concurrent_output_matches_serial(tmp_path, sources, mode):
+  """records written in chunks by several jobs are assembled in order, as are the compressed
+  outputs and the ones written in the background"""
+  serial = merge(tmp_path / 'serial', sources, '-r', mode)
+  assert serial['out.txt'].count(b'\n') > 4096, 'too few records to be written in chunks'
+
+  for args in (['-j', '4'], ['-j', '4', '-a'], ['-j', '8', '--prefetch', '1']):
+    assert merge(tmp_path / '_'.join(args), sources, '-r', mode, *args) == serial, args
+
+  compressed = tmp_path / 'compressed'
+  merge(compressed, sources, '-r', mode, '-j', '4', '-o', str(compressed / 'out.txt.gz'))
+  with gzip.open(compressed / 'out.txt.gz') as output_file:
+    assert output_file.read() == serial['out.txt']
+
+
+@pytest.mark.parametrize('mode', ['off', 'auto', 'last'])
+def test_spilled_merge_matches_in_memory(tmp_path, sources, mode):
+  """records spilled to sorted files by --max_memory merge the same as when kept in memory,
+  and the spilled files are removed"""
+  in_memory = merge(tmp_path / 'in_memory', sources, '-r', mode)
+
+  spills = tmp_path / 'spills'
+  spills.mkdir()
+  for args in (['--max_memory', '1'], ['--max_memory', '1', '-j', '3']):
+    stats = tmp_path / 'stats.json'
+    spilled = merge(tmp_path / '_'.join(args), sources, '-r', mode, '--temp_dir', str(spills),
+                    '--stats', str(stats), *args)
+    with open(stats, encoding='utf-8') as stats_file:
+      assert json.load(stats_file)['counts']['spills'] > 1, args
+
+    assert spilled == in_memory, args
+    assert not os.listdir(spills), args
+
+
+def merge_into(master, sources, *args):
+  """runs pdbmerge merging the sources into the master in place"""
+  run = subprocess.run([PDBMERGE, '--verbosity', '0', '--master', master, *args, *sources],
+                       capture_output=True,
+                       check=False)
+  assert run.returncode in (0, 1), run.stderr.decode()
+  return run
+
+
+@pytest.mark.parametrize('mode', ['off', 'auto', 'last', 'replace', 'priority'])
+def test_master_matches_output(tmp_path, sources, mode):
+  """records merged into a master in place are the ones merged into an output with the master
+  as the first source, over runs that find them through the index"""
+  args = ['-r', mode]
+  if mode == 'priority':
+    # The master is not listed, so it comes before the other sources that are not.
+    args += ['--priority', sources[3]]
+
+  master = str(tmp_path / 'master.txt')
+  shutil.copy(sources[0], master)
+  merge_into(master, sources[1:], *args)
+  assert os.path.exists(master + '.idx')
+
+  expected = load_db(merge(tmp_path / 'output', sources, *args)['out.txt'])
+  assert load_db(master) == expected
+
+  if mode != 'off':
+    # Conflicting items dropped by off come back from later sources, the others merge in steps.
+    shutil.copy(sources[0], master)
+    for source in sources[1:]:
+      merge_into(master, [source], *args)
+    assert load_db(master) == expected
+
+
+def test_master_changed_outside(tmp_path, sources):
+  """a master written by anything else is indexed again before it is merged into"""
+  master = str(tmp_path / 'master.txt')
+  shutil.copy(sources[0], master)
+  merge_into(master, sources[1:4], '-r', 'last')
+
+  records = load_db(master)
+  changed = sorted(records)[len(records) // 2]
+  records[changed] = 'ConvAsm1x1U:1,2,3'
+  records['1-2-3-4-5-6-7-8-NCHW-FP32-F'] = 'ConvOclDirectFwd:4,5,6'
+  with open(master, 'w', encoding='utf-8') as master_file:
+    master_file.writelines(f'{key}={value}\n' for key, value in records.items())
+
+  edited = str(tmp_path / 'edited.txt')
+  shutil.copy(master, edited)
+  merge_into(master, sources[4:], '-r', 'last')
+  output = merge(tmp_path / 'output', [edited, *sources[4:]], '-r', 'last')['out.txt']
+  assert load_db(master) == load_db(output)
+
+
+def write_journal(path, base, appended, patches):
+  """writes the journal a run interrupted while applying it leaves, see MasterDb"""
+  with open(path, 'wb') as journal:
+    journal.write(appended)
+    for offset, data in patches:
+      journal.write(struct.pack('=QQ', offset, len(data)) + data)
+    journal.write(struct.pack('=8sQQQ', b'PDBJRN1', base, len(appended), len(patches)))
+
+
+def test_master_journal_applied(tmp_path, sources):
+  """the journal left by an interrupted run is applied by the next one before it merges,
+  one that can not be applied stops the run with the master unchanged"""
+  master = str(tmp_path / 'master.txt')
+  shutil.copy(sources[0], master)
+  merge_into(master, sources[1:2], '-r', 'auto')
+
+  with open(master, 'rb') as master_file:
+    before = master_file.read()
+  first = before.index(b'=') + 1
+  key = b'9-8-7-6-5-4-3-2-NCHW-FP16-B'
+  appended = key + b'=ConvAsm1x1U:7,7,7\n'
+  # Replaying a journal again from the start gives the same master, so a partly applied one
+  # left on top of its changes is fine too.
+  patched = before[:first] + b'X' + before[first + 1:] + appended
+  with open(master, 'ab') as master_file:
+    master_file.write(appended[:10])
+
+  write_journal(master + '.journal', len(before), appended, [(first, b'X')])
+  merge_into(master, sources[2:], '-r', 'auto')
+  assert not os.path.exists(master + '.journal')
+
+  edited = str(tmp_path / 'edited.txt')
+  with open(edited, 'wb') as edited_file:
+    edited_file.write(patched)
+  output = merge(tmp_path / 'output', [edited, *sources[2:]], '-r', 'auto')['out.txt']
+  assert load_db(master) == load_db(output)
+  assert load_db(master)[key.decode()] == 'ConvAsm1x1U:7,7,7'
+
+  with open(master, 'rb') as master_file:
+    merged = master_file.read()
+  with open(master + '.journal', 'wb') as journal:
+    journal.write(b'not a journal')
+  run = subprocess.run([PDBMERGE, '--master', master, sources[0]],
+                       capture_output=True,
+                       check=False)
+  assert run.returncode == 2
+  assert b'journal' in run.stderr
+  with open(master, 'rb') as master_file:
+    assert master_file.read() == merged
+  assert not os.path.exists(master + '.journal.tmp')
+
+
+@pytest.mark.parametrize('mode', ['off', 'auto'])
+def test_binary_db_round_trip(tmp_path, sources, mode):
+  """binary perf dbs read back as sources merge the same as the text they were written from"""
+  text = merge(tmp_path / 'text', sources, '-r', mode)
+
+  binary = str(tmp_path / 'merged.pdbx')
+  merge(tmp_path / 'binary', sources, '-r', mode, '-o', binary)
+  with open(binary, 'rb') as binary_file:
+    assert binary_file.read() != text['out.txt']
+
+  for args in ([], ['-m'], ['-j', '2']):
+    back = merge(tmp_path / ('back' + '_'.join(args)), [binary], '-r', mode, *args)
+    assert back['out.txt'] == text['out.txt'], args
+
+  again = str(tmp_path / 'again.bin')
+  merge(tmp_path / 'again', [binary], '-r', mode, '-f', 'bin', '-o', again)
+  with open(binary, 'rb') as binary_file, open(again, 'rb') as again_file:
+    assert again_file.read() == binary_file.read()
+
+  # A binary db of some of the sources merges with the text of the others.
+  part = str(tmp_path / 'part.pdbx')
+  merge(tmp_path / 'part', sources[:3], '-r', 'auto', '-o', part)
+  mixed = merge(tmp_path / 'mixed', [part, *sources[3:]], '-r', 'auto')
+  assert mixed['out.txt'] == merge(tmp_path / 'all', sources, '-r', 'auto')['out.txt']
+
+
+def test_binary_db_of_another_host(tmp_path):
+  """binary perf dbs are mapped in place, those of another byte order or version are refused"""
+  source, = write_sources(tmp_path / 'sources', ['k1=S:1;T:2', 'k2=S:3'])
+  binary = str(tmp_path / 'merged.pdbx')
+  assert run_pdbmerge('-o', binary, source).returncode == 0
+  with open(binary, 'rb') as binary_file:
+    contents = binary_file.read()
+
+  # The footer ends with the byte order mark and the magic.
+  order = contents[-16:-8]
+  assert order in (bytes(range(1, 9)), bytes(range(8, 0, -1)))
+  for changed, error in ((contents[:-16] + order[::-1] + contents[-8:],
+                          'written on a host of the other byte order'),
+                         (contents[:-4] + b'1\0\0\0', 'written by another version of pdbmerge')):
+    with open(binary, 'wb') as binary_file:
+      binary_file.write(changed)
+    run = run_pdbmerge('-o', str(tmp_path / 'out.txt'), binary)
+    assert run.returncode == 2
+    assert run.stderr.decode() == f'F\tCan not read binary perf db {binary}: {error}\n'
+
+
+def cpu_flags():
+  """features of the CPU, empty where /proc/cpuinfo is missing"""
+  try:
+    with open('/proc/cpuinfo', encoding='utf-8') as cpuinfo:
+      for line in cpuinfo:
+        if line.startswith('flags'):
+          return set(line.partition(':')[2].split())
+  except OSError:
+    pass
+  return set()
+
+
+@pytest.mark.parametrize('scanner', ['swar', 'sse2', 'avx2'])
+def test_scanners_match_bytes(tmp_path, sources, scanner):
+  """the word and vector delimiter scanners split lines, records and items as the one going
+  a byte at a time, over delimiters on both sides of every block boundary"""
+  if scanner != 'swar' and scanner not in cpu_flags():
+    pytest.skip(f'the CPU has no {scanner}')
+
+  edges = str(tmp_path / 'edges.txt')
+  rng = random.Random(24)
+  with open(edges, 'w', encoding='utf-8') as edges_file:
+    for width in range(1, 200):
+      key = f'{width}-' + 'k' * (width % 70)
+      items = ';'.join(f'{solver}:' + ','.join(['9' * (width % 5 + 1)] * (width % 30))
+                       for solver in rng.sample(SOLVERS, 1 + width % 4))
+      separators = ['', ';', ';;', '=;', ':', ',:']
+      edges_file.write(f'{key}={items}{separators[width % len(separators)]}\n')
+    edges_file.write('no newline at the end=ConvAsm1x1U:' + '1,' * 40)
+
+  scanned = [*sources, edges]
+  for args in ([], ['-m'], ['-j', '2']):
+    reference = merge(tmp_path / 'bytes', scanned, '-r', 'auto', *args,
+                      env={'PDBMERGE_SCANNER': 'bytes'})
+    result = merge(tmp_path / scanner, scanned, '-r', 'auto', *args,
+                   env={'PDBMERGE_SCANNER': scanner})
+    assert result == reference, args
+    shutil.rmtree(tmp_path / 'bytes')
+    shutil.rmtree(tmp_path / scanner)
+
+
+def test_output_over_a_source(tmp_path, sources):
+  """parsed sources can be merged into one of them, streamed ones are refused as an output
+  before anything is written"""
+  merged = load_db(merge(tmp_path / 'merged', sources[:2], '-r', 'auto')['out.txt'])
+
+  first = str(tmp_path / 'first.txt')
+  shutil.copy(sources[0], first)
+  merge(tmp_path / 'in_place', [first, sources[1]], '-r', 'auto', '-o', first)
+  assert load_db(first) == merged
+
+  shutil.copy(sources[0], first)
+  for args in (['--sorted_inputs'], ['--sorted_inputs', '-m'], ['--diff']):
+    run = subprocess.run([PDBMERGE, *args, '-o', first, first, sources[1]],
+                         capture_output=True,
+                         check=False)
+    assert run.returncode == 2, args
+    assert b'streamed sources' in run.stderr, args
+    with open(first, 'rb') as first_file, open(sources[0], 'rb') as source_file:
+      assert first_file.read() == source_file.read(), args
+
+
+# MIOpen text keys and the config columns Tuna's export_db.py stores them as, from layout to
+# group_count in the order of SQLITE_CONFIG_COLS
+SQLITE_CONFIGS = {
+    '576-4-4-1x1-192-2-2-8-0x0-2x2-1x1-0-NCHW-FP32-F':
+        ('NCHW', 'F', 'FP32', 2, 576, 4, 4, 1, 1, 1, 1, 192, 8, 0, 0, 0, 2, 2, 0, 1, 1, 0, 0, 1),
+    '64-14-14-3x3-32-14-14-16-1x1-1x1-1x1-0-NCHW-FP16-B_g2':
+        ('NCHW', 'B', 'FP16', 2, 64, 14, 14, 1, 3, 3, 1, 32, 16, 1, 1, 0, 1, 1, 0, 1, 1, 0, 0, 2),
+    '8-6-4-6-3x3x3-16-6-4-6-2-1x1x1-1x1x1-1x1x1-0-NCDHW-FP32-W':
+        ('NCDHW', 'W', 'FP32', 3, 8, 4, 6, 6, 3, 3, 3, 16, 2, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 1),
+}
+
+
+def test_sqlite_keys_are_text_keys(tmp_path):
+  """SQLite configs are keyed by their MIOpen text keys both ways, so a .db converts to text
+  and back and its configs conflict with the same keys of text sources"""
+  text = str(tmp_path / 'configs.txt')
+  with open(text, 'w', encoding='utf-8') as text_file:
+    for index, key in enumerate(SQLITE_CONFIGS):
+      text_file.write(f'{key}=ConvAsm1x1U:{index},1;GemmFwd1x1_0_1:{index},2\n')
+
+  database = str(tmp_path / 'configs.db')
+  merge(tmp_path / 'to_db', [text], '-o', database)
+  with sqlite3.connect(database) as cnx:
+    columns = ', '.join(SQLITE_CONFIG_COLS)
+    rows = cnx.execute(f'SELECT {columns} FROM config ORDER BY id').fetchall()
+    items = cnx.execute('SELECT solver, params FROM perf_db WHERE config = 1').fetchall()
+  assert rows == list(SQLITE_CONFIGS.values())
+  assert sorted(items) == [('ConvAsm1x1U', '0,1'), ('GemmFwd1x1_0_1', '0,2')]
+
+  back = merge(tmp_path / 'to_text', [database])
+  with open(text, 'rb') as text_file:
+    assert back['out.txt'] == text_file.read()
+
+  # The text source comes last and replaces the items of the config it shares with the .db.
+  key = next(iter(SQLITE_CONFIGS))
+  newer = str(tmp_path / 'newer.txt')
+  with open(newer, 'w', encoding='utf-8') as newer_file:
+    newer_file.write(f'{key}=ConvAsm1x1U:9,9\n')
+  merged = load_db(merge(tmp_path / 'mixed', [database, newer], '-r', 'last')['out.txt'])
+  assert len(merged) == len(SQLITE_CONFIGS)
+  assert merged[key] == 'ConvAsm1x1U:9,9;GemmFwd1x1_0_1:0,2'
+
+  # The configs of a db exported by Tuna come back as they were.
+  exported = os.path.join(os.path.dirname(__file__), '../utils/test_files/test_gfx90678.db')
+  query = (f'SELECT {columns}, solver, params FROM config INNER JOIN perf_db ON '
+           'config.id = perf_db.config')
+  through_text = str(tmp_path / 'through_text.db')
+  merge(tmp_path / 'exported', [exported])
+  merge(tmp_path / 'exported_back', [str(tmp_path / 'exported' / 'out.txt')], '-o', through_text)
+  with sqlite3.connect(exported) as cnx, sqlite3.connect(through_text) as back_cnx:
+    assert sorted(back_cnx.execute(query)) == sorted(cnx.execute(query))
+
+
+def test_sqlite_output_kept_on_error(tmp_path):
+  """a key no config row can hold fails the merge and leaves the existing .db as it was"""
+  text = str(tmp_path / 'configs.txt')
+  with open(text, 'w', encoding='utf-8') as text_file:
+    for key in SQLITE_CONFIGS:
+      text_file.write(f'{key}=ConvAsm1x1U:1,1\n')
+    # Out sizes that do not follow from the others.
+    text_file.write('1-2-2-1x1-1-9-9-1-0x0-1x1-1x1-0-NCHW-FP32-F=ConvAsm1x1U:1,1\n')
+
+  database = str(tmp_path / 'configs.db')
+  with open(database, 'wb') as database_file:
+    database_file.write(b'left as it was')
+
+  run = subprocess.run([PDBMERGE, '-o', database, text], capture_output=True, check=False)
+  assert run.returncode == 2
+  assert b'Not a key of an SQLite perf db config' in run.stderr
+  with open(database, 'rb') as database_file:
+    assert database_file.read() == b'left as it was'
+  assert not os.path.exists(database + '.tmp')
+
+
+def write_sources(directory, *dbs):
+  """writes hand made text dbs, each a list of lines, returns their paths"""
+  os.makedirs(directory, exist_ok=True)
+  paths = []
+  for index, lines in enumerate(dbs):
+    path = os.path.join(directory, f'{"abcdefgh"[index]}.txt')
+    with open(path, 'w', encoding='utf-8') as db_file:
+      db_file.write(''.join(f'{line}\n' for line in lines))
+    paths.append(path)
+  return paths
+
+
+def merged_items(result):
+  """items of the merged records by key and solver"""
+  records = load_db(result['out.txt'])
+  return {
+      key: dict(item.split(':', 1) for item in value.split(';'))
+      for key, value in records.items()
+  }
+
+
+def test_priority_policy(tmp_path):
+  """listed sources win in the order given, unlisted ones come after them, earlier first,
+  whatever their commas"""
+  paths = write_sources(tmp_path / 'sources',
+                        ['k1=S:1,1,1;T:1,1,1', 'k2=S:1,1,1', 'k3=S:1'],
+                        ['k1=S:2;T:2', 'k2=S:2', 'k3=S:2,2,2'],
+                        ['k1=S:3'],
+                        ['k1=S:4;T:4', 'k2=S:4'])
+  result = merge(tmp_path / 'merged', paths, '-r', 'priority', '--priority', paths[2],
+                 '--priority', paths[3])
+  assert result['code'] == 0
+  assert merged_items(result) == {
+      # c is listed first, d second, T is not in c
+      'k1': {'S': '3', 'T': '4'},
+      'k2': {'S': '4'},
+      # neither a nor b is listed, a comes first
+      'k3': {'S': '1'},
+  }
+
+
+def test_time_policy(tmp_path):
+  """the value with the lowest time wins, a value timed twice keeps its lowest time, and
+  items without times are resolved as by auto"""
+  paths = write_sources(tmp_path / 'sources',
+                        ['k1=S:1;T:1,1', 'k2=S:1'],
+                        ['k1=S:2,2,2;T:2', 'k2=S:2,2'],
+                        ['k1=S:3;T:3', 'k2=S:3,3'])
+  times = str(tmp_path / 'times.txt')
+  with open(times, 'w', encoding='utf-8') as times_file:
+    times_file.write('# key\tsolver\tparameters\ttime\n'
+                     'k1\tS\t1\t5.0\n'
+                     'k1\tS\t3\t2.0\n'
+                     '\n'
+                     'k1\tS\t1\t1.5\n'
+                     'k9\tS\t1\t0.1\n')
+  result = merge(tmp_path / 'merged', paths, '-r', 'time', '--times', times)
+  assert result['code'] == 0
+  assert merged_items(result) == {
+      'k1': {'S': '1', 'T': '1,1'},
+      # no times: the most commas, the latest on ties as by auto
+      'k2': {'S': '3,3'},
+  }
+
+
+def test_majority_policy(tmp_path):
+  """the value met in most sources wins, ties go to the value met first"""
+  paths = write_sources(tmp_path / 'sources',
+                        ['k1=S:1', 'k2=S:1', 'k3=S:1'],
+                        ['k1=S:2,2', 'k2=S:2', 'k3=S:2,2'],
+                        ['k1=S:2,2', 'k2=S:2'],
+                        ['k1=S:1'])
+  result = merge(tmp_path / 'merged', paths, '-r', 'majority')
+  assert result['code'] == 0
+  assert merged_items(result) == {
+      'k1': {'S': '1'},
+      'k2': {'S': '2'},
+      'k3': {'S': '1'},
+  }
+
+
+def test_replace_drops_items(tmp_path):
+  """the latest record of a conflicting key replaces the earlier ones, items only found in
+  those are dropped"""
+  paths = write_sources(tmp_path / 'sources',
+                        ['k1=S:1;T:1;U:1', 'k2=S:1'],
+                        ['k1=S:2;T:1'],
+                        ['k3=S:3'])
+  result = merge(tmp_path / 'merged', paths, '-r', 'replace')
+  assert result['code'] == 0
+  assert merged_items(result) == {
+      'k1': {'S': '2', 'T': '1'},
+      'k2': {'S': '1'},
+      'k3': {'S': '3'},
+  }
+
+
+def run_pdbmerge(*args):
+  """runs pdbmerge with the arguments as they are"""
+  return subprocess.run([PDBMERGE, *args], capture_output=True, check=False)
+
+
+def test_diff(tmp_path):
+  """--diff reports the keys and solvers added, removed and changed in the second db, as text
+  and as JSON, items are matched by id whatever their order"""
+  before, after, reordered = write_sources(tmp_path / 'sources',
+                                           ['k1=S:1;T:1', 'k2=S:1', 'k3=S:1;U:2'],
+                                           ['k1=S:1;T:1', 'k3=S:2;V:1', 'k4=S:4'],
+                                           ['k1=T:1;S:1', 'k2=S:1', 'k3=U:2;S:1'])
+  run = run_pdbmerge('--diff', before, after)
+  assert run.returncode == 1
+  assert run.stdout.decode().splitlines() == [
+      '-k2=S:1', '~k3', '\t~S:1\t2', '\t-U:2', '\t+V:1', '+k4=S:4'
+  ]
+  assert b'Keys same: 1, added: 1, removed: 1, changed: 1' in run.stderr
+
+  report = str(tmp_path / 'report.json')
+  assert run_pdbmerge('--diff', '--json', '-o', report, before, after).returncode == 1
+  with open(report, encoding='utf-8') as report_file:
+    keys = json.load(report_file)['keys']
+  assert keys[0] == {'key': 'k2', 'status': 'removed', 'value': 'S:1'}
+  assert keys[1]['key'] == 'k3' and keys[1]['status'] == 'changed'
+  assert keys[1]['solvers'] == [
+      {'id': 'S', 'status': 'changed', 'before': '1', 'after': '2'},
+      {'id': 'U', 'status': 'removed', 'before': '2'},
+      {'id': 'V', 'status': 'added', 'after': '1'},
+  ]
+  assert keys[2] == {'key': 'k4', 'status': 'added', 'value': 'S:4'}
+  assert len(keys) == 3
+
+  run = run_pdbmerge('--diff', before, reordered)
+  assert run.returncode == 0
+  assert run.stdout == b''
+  assert b'Keys same: 3, added: 0, removed: 0, changed: 0' in run.stderr
+
+
+def wait_for(predicate, timeout=30):
+  """polls until predicate holds, false if it still does not after timeout seconds"""
+  deadline = time.monotonic() + timeout
+  while not predicate():
+    if time.monotonic() > deadline:
+      return False
+    time.sleep(0.05)
+  return True
+
+
+def test_watch(tmp_path):
+  """--watch merges the files already in the inbox and the ones renamed into it, checkpoints
+  the output in place and writes the last checkpoint on SIGTERM"""
+  (source,) = write_sources(tmp_path / 'sources', ['k1=S:1;T:1', 'k2=S:2'])
+  inbox = tmp_path / 'inbox'
+  inbox.mkdir()
+  (inbox / 'first.txt').write_text('k1=S:1\nk3=S:3\n', encoding='utf-8')
+  output = tmp_path / 'out' / 'merged.txt'
+  output.parent.mkdir()
+
+  command = [
+      PDBMERGE, '--watch',
+      str(inbox), '--checkpoint', '1', '-r', 'auto', '-o',
+      str(output), source
+  ]
+  with subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE) as watch:
+    try:
+      assert wait_for(lambda: output.exists() and b'k3=S:3' in output.read_bytes())
+
+      # Written under a hidden name, which is skipped, and moved in once complete.
+      (inbox / '.second.txt').write_text('k1=S:1,1\nk4=S:4\n', encoding='utf-8')
+      os.rename(inbox / '.second.txt', inbox / 'second.txt')
+      assert wait_for(lambda: b'k4=S:4' in output.read_bytes())
+    finally:
+      watch.send_signal(signal.SIGTERM)
+      watch.communicate(timeout=30)
+
+  assert watch.returncode == 0
+  assert load_db(str(output)) == {
+      'k1': 'S:1,1;T:1',
+      'k2': 'S:2',
+      'k3': 'S:3',
+      'k4': 'S:4',
+  }
+  assert os.listdir(output.parent) == ['merged.txt']
+
+
+def test_streamed_sources_and_output(tmp_path):
+  """- and named pipes are merged in the order given like any other source, and the output can
+  be the standard output or a named pipe"""
+  first, last = write_sources(tmp_path / 'sources', ['k1=S:1;T:1', 'k2=S:2'], ['k1=S:3'])
+  run = subprocess.run([PDBMERGE, '-r', 'last', '-o', '-', first, '-', last],
+                       input=b'k1=S:2\nk3=S:3\n',
+                       capture_output=True,
+                       check=False)
+  assert run.returncode == 0, run.stderr.decode()
+  assert run.stdout == b'k1=S:3;T:1\nk2=S:2\nk3=S:3\n'
+
+  source = str(tmp_path / 'source.fifo')
+  output = str(tmp_path / 'output.fifo')
+  os.mkfifo(source)
+  os.mkfifo(output)
+  merged = []
+
+  def write_source():
+    with open(source, 'wb') as fifo:
+      fifo.write(b'k1=S:2\nk3=S:3\n')
+
+  def read_output():
+    with open(output, 'rb') as fifo:
+      merged.append(fifo.read())
+
+  # Daemons, so that a run failing before it opens the pipes does not hang the tests.
+  threads = [
+      threading.Thread(target=write_source, daemon=True),
+      threading.Thread(target=read_output, daemon=True)
+  ]
+  for thread in threads:
+    thread.start()
+  run = run_pdbmerge('-r', 'last', '-o', output, source, first)
+  for thread in threads:
+    thread.join(timeout=30)
+  assert run.returncode == 0, run.stderr.decode()
+  # The pipe comes first, so the first file wins the conflict.
+  assert merged == [b'k1=S:1;T:1\nk2=S:2\nk3=S:3\n']
+
+
+def test_shards_concat_to_the_merge(tmp_path, sources):
+  """shards by hash and by bounds split the keys of a merge, --concat joins their outputs
+  into the output of the whole merge and refuses keys found in two shards"""
+  whole = merge(tmp_path / 'whole', sources, '-r', 'auto')['out.txt']
+  keys = sorted(load_db(whole))
+  bounds = str(tmp_path / 'bounds.txt')
+  with open(bounds, 'w', encoding='utf-8') as bounds_file:
+    bounds_file.write(f'{keys[len(keys) // 3]}\n{keys[2 * len(keys) // 3]}\n')
+
+  for split in ([], ['--shard_bounds', bounds]):
+    shards, outputs = [], []
+    for index in range(3):
+      shard = merge(tmp_path / f'shard{index}', sources, '-r', 'auto', '--shard', f'{index}/3',
+                    *split)['out.txt']
+      assert shard and len(load_db(shard)) < len(keys)
+      shards.append(str(tmp_path / f'shard{index}' / 'out.txt'))
+      outputs.append(shard)
+
+    if split:
+      # Ranges in shard order are already sorted together.
+      assert b''.join(outputs) == whole
+
+    joined = str(tmp_path / 'joined.txt')
+    assert run_pdbmerge('--concat', '-o', joined, *shards).returncode == 0, split
+    with open(joined, 'rb') as joined_file:
+      assert joined_file.read() == whole, split
+    for index in range(3):
+      shutil.rmtree(tmp_path / f'shard{index}')
+
+  (first,) = write_sources(tmp_path / 'twice', ['k1=S:1'])
+  run = run_pdbmerge('--concat', '-o', str(tmp_path / 'twice.txt'), first, first)
+  assert run.returncode == 2
+  assert b'Key found in more than one shard: k1' in run.stderr
+
+
+KDB_SCHEMA = ('CREATE TABLE `kern_db` (`id` INTEGER PRIMARY KEY ASC,`kernel_name` TEXT NOT NULL,'
+              '`kernel_args` TEXT NOT NULL,`kernel_blob` BLOB NOT NULL,`kernel_hash` TEXT NOT NULL,'
+              '`uncompressed_size` INT NOT NULL);'
+              'CREATE UNIQUE INDEX `idx_kern_db` ON kern_db(kernel_name, kernel_args);')
+
+
+def write_kdb(path, kernels):
+  """writes a kernel db of (name, args, blob) rows"""
+  with sqlite3.connect(path) as cnx:
+    cnx.executescript(KDB_SCHEMA)
+    cnx.executemany(
+        'INSERT INTO kern_db(kernel_name, kernel_args, kernel_blob, kernel_hash, '
+        'uncompressed_size) VALUES(?, ?, ?, ?, ?)',
+        [(name, args, blob, f'hash{blob.hex()}', len(blob)) for name, args, blob in kernels])
+  cnx.close()
+
+
+@pytest.mark.parametrize('jobs', ['1', '2'])
+def test_kernel_dbs(tmp_path, jobs):
+  """kernels of later kdb sources replace the ones with the same name and arguments, the
+  blobs are copied as they are in source and row order"""
+  first = str(tmp_path / 'first.kdb')
+  second = str(tmp_path / 'second.kdb')
+  write_kdb(first, [('conv.s', '-DA=1', b'\x00\x01'), ('conv.s', '-DA=2', b'\x02'),
+                    ('gemm.s', '', b'\x03' * 1000)])
+  write_kdb(second, [('conv.s', '-DA=2', b'\x04\x05'), ('pool.cl', '-DB', b'\x06')])
+
+  output = str(tmp_path / 'merged.kdb')
+  run = run_pdbmerge('-j', jobs, '-o', output, first, second)
+  assert run.returncode == 0, run.stderr.decode()
+  with sqlite3.connect(output) as cnx:
+    rows = cnx.execute('SELECT kernel_name, kernel_args, kernel_blob, kernel_hash, '
+                       'uncompressed_size FROM kern_db ORDER BY id').fetchall()
+  cnx.close()
+  assert rows == [
+      ('conv.s', '-DA=1', b'\x00\x01', 'hash0001', 2),
+      ('gemm.s', '', b'\x03' * 1000, 'hash' + '03' * 1000, 1000),
+      ('conv.s', '-DA=2', b'\x04\x05', 'hash0405', 2),
+      ('pool.cl', '-DB', b'\x06', 'hash06', 1),
+  ]
+
+
+def fdb_item(algo, solver, time, workspace=0):
+  """find db item as MIOpen writes it"""
+  return f'{algo}:{solver},{time},{workspace},{algo},not used'
+
+
+def test_find_dbs(tmp_path):
+  """with --fdb items are ordered by kernel time and auto keeps the fastest of conflicting
+  ones, even where it has fewer commas"""
+  direct, gemm, winograd = ('miopenConvolutionFwdAlgoDirect', 'miopenConvolutionFwdAlgoGEMM',
+                            'miopenConvolutionFwdAlgoWinograd')
+  paths = write_sources(tmp_path / 'sources', [
+      f'k1={fdb_item(direct, "ConvAsm1x1U", 0.5)};{fdb_item(gemm, "GemmFwd1x1_0_1", 0.2)}',
+      f'k2={fdb_item(direct, "ConvAsm1x1U", 0.4)}'
+  ], [
+      f'k1={fdb_item(direct, "ConvAsm1x1U", 0.1)};{fdb_item(winograd, "ConvBinWinogradRxS", 0.3)}',
+      f'k2={fdb_item(direct, "ConvAsm1x1U", 0.9)},1'
+  ])
+  result = merge(tmp_path / 'merged', paths, '--fdb', '-r', 'auto')
+  assert result['code'] == 0
+  assert load_db(result['out.txt']) == {
+      'k1': ';'.join([
+          fdb_item(direct, 'ConvAsm1x1U', 0.1),
+          fdb_item(gemm, 'GemmFwd1x1_0_1', 0.2),
+          fdb_item(winograd, 'ConvBinWinogradRxS', 0.3)
+      ]),
+      'k2': fdb_item(direct, 'ConvAsm1x1U', 0.4),
+  }
+
+  # The same items sorted once merged, without conflicts.
+  (unsorted,) = write_sources(tmp_path / 'unsorted', [
+      f'k1={fdb_item(gemm, "GemmFwd1x1_0_1", 0.2)};{fdb_item(direct, "ConvAsm1x1U", 0.1)}'
+  ])
+  result = merge(tmp_path / 'sorted', [unsorted], '--fdb')
+  assert load_db(result['out.txt']) == {
+      'k1': f'{fdb_item(direct, "ConvAsm1x1U", 0.1)};{fdb_item(gemm, "GemmFwd1x1_0_1", 0.2)}'
+  }
+
+
+def test_compressed_sources_and_outputs(tmp_path, sources):
+  """gzip and zstd sources are found by their contents, concatenated members included, and
+  merge the same as their text, outputs named .gz or .zst are compressed with their side
+  outputs"""
+  plain = merge(tmp_path / 'plain', sources[:3])
+  gzipped = [str(tmp_path / 'first.gz'), str(tmp_path / 'second.db')]
+  with open(sources[0], 'rb') as first, gzip.open(gzipped[0], 'wb') as gz_file:
+    gz_file.write(first.read())
+  with open(sources[1], 'rb') as second, open(gzipped[1], 'wb') as gz_file:
+    # One gzip member per half of the file.
+    data = second.read()
+    gz_file.write(gzip.compress(data[:len(data) // 2]) + gzip.compress(data[len(data) // 2:]))
+
+  directory = tmp_path / 'gzip'
+  os.makedirs(directory)
+  run = run_pdbmerge('--verbosity', '3', '-o', str(directory / 'out.txt.gz'), '-c',
+                     str(directory / 'commands.txt'), *gzipped, sources[2])
+  assert run.returncode == plain['code'], run.stderr.decode()
+  assert sorted(os.listdir(directory)) == [
+      'commands.txt', 'out.txt.conflicts.gz', 'out.txt.gz', 'out.txt.options.gz'
+  ]
+  for name in ('out.txt', 'out.txt.conflicts', 'out.txt.options'):
+    with gzip.open(directory / f'{name}.gz', 'rb') as gz_file:
+      contents = gz_file.read()
+    # The side outputs name the sources.
+    for path, source in zip(gzipped, sources):
+      contents = contents.replace(path.encode(), source.encode())
+    assert contents == plain[name], name
+
+  zstd = shutil.which('zstd')
+  if not zstd:
+    return
+  compressed = str(tmp_path / 'first.txt.zst')
+  with open(sources[0], 'rb') as first, open(compressed, 'wb') as zst_file:
+    # One frame per half of the file.
+    lines = first.read().splitlines(keepends=True)
+    for half in (lines[:len(lines) // 2], lines[len(lines) // 2:]):
+      zst_file.write(
+          subprocess.run([zstd, '-c'], input=b''.join(half), capture_output=True,
+                         check=True).stdout)
+  output = str(tmp_path / 'zstd' / 'out.txt.zst')
+  os.makedirs(os.path.dirname(output))
+  run = run_pdbmerge('-o', output, compressed, *sources[1:3])
+  if b'built without zstd support' in run.stderr:
+    assert run.returncode == 2
+    # Outputs are refused before anything is merged as well.
+    run = run_pdbmerge('-o', output, *sources[1:3])
+    assert run.returncode == 2
+    assert b'built without zstd support' in run.stderr
+    assert not os.listdir(os.path.dirname(output))
+    return
+  assert run.returncode == plain['code'], run.stderr.decode()
+  assert subprocess.run([zstd, '-dc', output], capture_output=True,
+                        check=True).stdout == plain['out.txt']
+
+  truncated = str(tmp_path / 'truncated.zst')
+  with open(compressed, 'rb') as zst_file, open(truncated, 'wb') as truncated_file:
+    truncated_file.write(zst_file.read()[:-16])
+  run = run_pdbmerge('-o', str(tmp_path / 'truncated.txt'), truncated)
+  assert run.returncode == 2
+  assert b'Can not decompress' in run.stderr
+
+
+def test_driver_commands(tmp_path):
+  """-c writes the driver arguments of 2D, 3D, grouped and batchnorm keys, the keys that are
+  not configs are reported and have none"""
+  conv = '64-28-28-3x3-128-28-28-16-1x1-1x1-1x1-0'
+  conv_options = '-c 64 -H 28 -W 28 -x 3 -y 3 -k 128 -n 16 -p 1 -q 1 -u 1 -v 1 -l 1 -j 1 -b 0'
+  conv3d = '64-4-28-28-3x3x3-128-4-28-28-16-1x1x1-2x2x2-1x1x1-0'
+  conv3d_options = ('-c 64 -H 28 -W 28 -x 3 -y 3 -k 128 -n 16 -p 1 -q 1 -u 2 -v 2 -l 1 -j 1 -b 0 '
+                    '--spatial_dim 3 --in_d 4 --fil_d 3 --pad_d 1 --conv_stride_d 2 --dilation_d 1')
+  commands = {
+      f'{conv}-NCHW-FP32-F': f' {conv_options} -F 1',
+      f'{conv}-NCHW-FP16-B': f'fp16 {conv_options} -F 0',
+      f'{conv}-NCHW-NCHW-NHWC-BF16-W_g4':
+          f'bfp16 {conv_options} -g 4 --in_layout NCHW --fil_layout NCHW --out_layout NHWC -F 0',
+      f'{conv3d}-NCDHW-FP32-F': f' {conv3d_options} -F 1',
+      f'{conv3d}-NCDHW-NCDHW-NDHWC-FP16-F':
+          f'fp16 {conv3d_options} --in_layout NCDHW --fil_layout NCDHW --out_layout NDHWC -F 1',
+      '16-64-28-28-1-NCHW-FP32-Trn': 'bnorm -n 16 -c 64 -H 28 -W 28 -m 1 -F 1 -b 0',
+      '16-64-2-28-28-0-NCDHW-FP16-Bwd': 'bnormfp16 -n 16 -c 64 -H 28 -W 28 -D 2 -m 0 -F 0 -b 1',
+  }
+  invalid = [f'{conv}-NCHW-FP64-F', '64-28-28-3x-128-28-28-16-1x1-1x1-1x1-0-NCHW-FP32-F', 'k']
+  source, = write_sources(tmp_path, [f'{key}=S:1' for key in [*commands, *invalid]])
+
+  result = merge(tmp_path / 'merged', [source])
+  assert sorted(result['commands.txt'].decode().splitlines()) == sorted(commands.values())
+  for key in invalid:
+    assert f'W\tNo driver options for the key: {key}\n'.encode() in result['stderr'], key
+
+
+@pytest.mark.parametrize('verbosity', ['0', '1', '2', '3'])
+def test_diagnostics(tmp_path, verbosity):
+  """warnings are counted by category, --verbosity prints none, only the counts, the first
+  --max_messages of every category or all of them"""
+  source, = write_sources(tmp_path, [f'k{index}=' for index in range(15)] +
+                          [f'bad{index}' for index in range(12)] + ['k=S:1', 'k=S:2'])
+  run = run_pdbmerge('--verbosity', verbosity, '--max_messages', '3', '-o',
+                     str(tmp_path / 'out.txt'), source)
+  assert run.returncode in (0, 1), run.stderr.decode()
+  stderr = run.stderr.decode().splitlines()
+
+  empty = [line for line in stderr if line.startswith('W\tNone contents under the key: ')]
+  ill_formed = [line for line in stderr if line.startswith('W\tIll-formed record: ')]
+  assert len(empty) == {'0': 0, '1': 0, '2': 3, '3': 15}[verbosity]
+  assert len(ill_formed) == {'0': 0, '1': 0, '2': 3, '3': 12}[verbosity]
+  assert empty == [
+      f'W\tNone contents under the key: k{index} at {source}:{index + 1}'
+      for index in range(len(empty))
+  ]
+
+  # The conflicting key is not a config, the lack of its driver options is counted as well.
+  shown = {'0': None, '1': ' (0 shown)', '2': ' (3 shown)', '3': ''}[verbosity]
+  if shown is None:
+    assert not stderr
+  else:
+    assert stderr[-3:] == [
+        f'W\tIll-formed records: 13{shown}', f'W\tRecords without contents: 15{shown}',
+        f'E\tMerge conflicts: 1{shown if verbosity == "1" else ""}'
+    ]
+
+
+def test_stats(tmp_path):
+  """--stats writes the phases, what was read from every source and written to every output
+  and the counts of keys and diagnostics as JSON"""
+  sources = write_sources(tmp_path / 'sources', ['k1=S:1', 'k2=S:1', 'bad'],
+                          ['k1=T:1', 'k2=S:2', 'k3='])
+  output = str(tmp_path / 'out.txt')
+  stats_path = str(tmp_path / 'stats.json')
+  run = run_pdbmerge('--stats', stats_path, '-o', output, *sources)
+  assert run.returncode == 1, run.stderr.decode()
+  with open(stats_path, encoding='utf-8') as stats_file:
+    stats = json.load(stats_file)
+
+  assert [phase['name'] for phase in stats['phases']] == ['arguments', 'parse', 'process', 'write']
+  assert stats['peak_rss_bytes'] > 0
+  assert stats['throughput']['bytes_per_second'] > 0
+  assert [(source['path'], source['bytes'], source['records']) for source in stats['sources']
+         ] == [(path, os.path.getsize(path), 2) for path in sources]
+  outputs = {output['path']: output for output in stats['outputs']}
+  assert sorted(outputs) == sorted([output, f'{output}.conflicts', f'{output}.options'])
+  for path, written in outputs.items():
+    assert written['bytes'] == os.path.getsize(path), path
+  assert outputs[output]['records'] == 1
+
+  counts = stats['counts']
+  assert (counts['keys'], counts['conflicting_keys'], counts['trivial_merges'],
+          counts['merge_conflicts']) == (2, 2, 1, 1)
+  # The conflicting key is not a config, the lack of its driver options is counted as well.
+  assert (counts['ill_formed_records'], counts['records_without_contents']) == (2, 1)
+
+
+def test_limits(tmp_path):
+  """records with a longer key or contents or more ids than the limits are dropped with a
+  warning, the others are merged"""
+  source, = write_sources(tmp_path, [
+      'k1=S:1', f'{"k" * 20}=S:1', f'k2=S:{"1" * 21}', 'k3=A:1;B:1;C:1;D:1', 'k4=A:1;B:1;C:1'
+  ])
+  output = tmp_path / 'out.txt'
+  run = run_pdbmerge('--max_key_length', '8', '--max_value_length', '20', '--max_ids', '3',
+                     '-o', str(output), source)
+  assert run.returncode == 0, run.stderr.decode()
+  assert output.read_bytes() == b'k1=S:1\nk4=A:1;B:1;C:1\n'
+  assert run.stderr.decode().splitlines() == [
+      f'W\tRecord over the limits: key longer than 8 bytes at {source}:2',
+      f'W\tRecord over the limits: contents longer than 20 bytes under the key: k2 at {source}:3',
+      f'W\tRecord over the limits: more than 3 ids under the key: k3 at {source}:4',
+      'W\tRecords over the limits: 3',
+  ]
+
+
+@pytest.mark.parametrize('max_errors', ['2', '3'])
+def test_max_errors(tmp_path, max_errors):
+  """the run ends with code 2 and no output once more records than --max_errors are dropped"""
+  source, = write_sources(tmp_path, ['k1=', 'bad', 'k2=S:1', f'k3=S:{"1" * 21}'])
+  output = tmp_path / 'out.txt'
+  run = run_pdbmerge('--max_errors', max_errors, '--max_value_length', '20', '-o', str(output),
+                     source)
+  if max_errors == '2':
+    assert run.returncode == 2
+    assert run.stderr.decode().splitlines()[-1] == (
+        'F\tMore than 2 ill-formed records and items, see --max_errors.')
+    assert not output.exists()
+  else:
+    assert run.returncode == 0, run.stderr.decode()
+    assert output.read_bytes() == b'k2=S:1\n'
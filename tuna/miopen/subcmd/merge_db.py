@@ -35,6 +35,7 @@ from tuna.miopen.utils.analyze_parse_db import parse_pdb_filename, insert_solver
 from tuna.miopen.utils.analyze_parse_db import get_config_sqlite
 from tuna.miopen.utils.analyze_parse_db import get_sqlite_row, get_sqlite_table, get_sqlite_data
 from tuna.miopen.utils.helper import prune_cfg_dims
+from tuna.miopen.utils.pdbmerge_lib import load_pdbmerge, pdbmerge
 
 LOGGER = setup_logger('merge_pdb')
 
@@ -265,6 +266,21 @@ def write_merge_results(master_list, final_file, copy_files):
     LOGGER.info('Finished writing to file: %s', copy)
 
 
+def pdbmerge_text_file(lib, master_file, target_file, final_file, copy_files,
+                       keep_keys):
+  """merge db text files in process with pdbmerge_core, the same way as
+  update_master_list and write_merge_results do"""
+  LOGGER.info('Merging %s into %s with pdbmerge', target_file, master_file)
+  options = [('--resolve', 'last' if keep_keys else 'replace'), ('--fdb', None),
+             ('--verbosity', 0), ('--output', final_file)]
+  pdbmerge(lib, [master_file, target_file], options)
+  LOGGER.info('Finished writing to file: %s', final_file)
+
+  for copy in copy_files:
+    copyfile(final_file, copy)
+    LOGGER.info('Finished writing to file: %s', copy)
+
+
 def merge_text_file(master_file, copy_only, keep_keys, target_file=None):
   """merge db text files"""
   if not (target_file and isinstance(target_file, str) and target_file.strip()):
@@ -275,6 +291,16 @@ def merge_text_file(master_file, copy_only, keep_keys, target_file=None):
   else:
     _, _, final_file, copy_files = parse_text_pdb_name(master_file)
 
+  lib = load_pdbmerge()
+  if lib is not None:
+    if copy_only:
+      LOGGER.warning('Skipping file processing due to copy_only argument')
+      return None
+
+    pdbmerge_text_file(lib, master_file, target_file, final_file, copy_files,
+                       keep_keys)
+    return final_file
+
   master_list = load_master_list(master_file)
 
   local_paths = [target_file]
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+###############################################################################
+#
+# MIT License
+#
+# Copyright (c) 2022 Advanced Micro Devices, Inc.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+###############################################################################
+"""merges of text dbs in process through pdbmerge_core, see utils/pdbmerge
+
+The library runs whole merges, the same as the pdbmerge command line, and
+writes their outputs to files; it does not hand records back to Python."""
+import ctypes
+import ctypes.util
+import os
+from functools import lru_cache
+
+from tuna.utils.logger import setup_logger
+
+LOGGER = setup_logger('pdbmerge_lib')
+
+# Path of libpdbmerge_core.so, otherwise it is searched for as other libraries
+PDBMERGE_LIB = os.environ.get('TUNA_PDBMERGE_LIB')
+
+
+class PdbMergeError(Exception):
+  """pdbmerge_core failed to merge, the message is the error of the tool"""
+
+
+@lru_cache(maxsize=None)
+def load_pdbmerge():
+  """load pdbmerge_core, returns None if it is not available"""
+  path = PDBMERGE_LIB or ctypes.util.find_library('pdbmerge_core')
+  if not path:
+    return None
+
+  try:
+    lib = ctypes.CDLL(path)
+  except OSError as err:
+    LOGGER.warning('Can not load pdbmerge_core from %s: %s', path, err)
+    return None
+
+  lib.pdbmerge_session_create.restype = ctypes.c_void_p
+  lib.pdbmerge_session_create.argtypes = []
+  lib.pdbmerge_session_destroy.restype = None
+  lib.pdbmerge_session_destroy.argtypes = [ctypes.c_void_p]
+  lib.pdbmerge_session_set_option.restype = ctypes.c_int
+  lib.pdbmerge_session_set_option.argtypes = [
+      ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p
+  ]
+  lib.pdbmerge_session_add_source.restype = ctypes.c_int
+  lib.pdbmerge_session_add_source.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+  lib.pdbmerge_session_merge.restype = ctypes.c_int
+  lib.pdbmerge_session_merge.argtypes = [ctypes.c_void_p]
+  lib.pdbmerge_session_error.restype = ctypes.c_char_p
+  lib.pdbmerge_session_error.argtypes = [ctypes.c_void_p]
+
+  LOGGER.info('Loaded pdbmerge_core from %s', path)
+  return lib
+
+
+def pdbmerge(lib, sources, options):
+  """merge sources in order, options are (name, value) pairs of pdbmerge
+  arguments with None values for flags. Returns the exit code of pdbmerge,
+  raises PdbMergeError on errors."""
+  session = lib.pdbmerge_session_create()
+  if not session:
+    raise MemoryError('Can not create a pdbmerge session')
+
+  def check(ret):
+    if ret == 2:
+      raise PdbMergeError(lib.pdbmerge_session_error(session).decode())
+    return ret
+
+  try:
+    for name, value in options:
+      check(
+          lib.pdbmerge_session_set_option(
+              session, name.encode(),
+              None if value is None else str(value).encode()))
+    for source in sources:
+      check(lib.pdbmerge_session_add_source(session, source.encode()))
+    return check(lib.pdbmerge_session_merge(session))
+  finally:
+    lib.pdbmerge_session_destroy(session)
@@ -0,0 +1,197 @@
+#!/usr/bin/env python3
+###############################################################################
+#
+# MIT License
+#
+# Copyright (c) 2022 Advanced Micro Devices, Inc.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+#
+###############################################################################
+"""runs pdbmerge_bench and compares its cpu times with a baseline
+
+The baseline is either another build of pdbmerge_bench run on the same
+machine with --reference, or the committed baseline file.  The file holds the
+times and the machine they were recorded on, results of another machine are
+not compared against it; record a new one there with --update, or after an
+intended change.
+"""
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+
+def machine(context):
+  """what the times depend on in the context of google benchmark results, host names
+  change with every container and the clock read from /proc/cpuinfo with the load, they
+  are left out"""
+  return {
+      'num_cpus': context.get('num_cpus'),
+      'caches': [cache['size'] for cache in context.get('caches', [])]
+  }
+
+
+def load_results(path):
+  """machine and fastest cpu time in ns of every benchmark in a google benchmark json
+  file, the other repetitions are slowed down by whatever else runs on the machine"""
+  with open(path, encoding='utf-8') as json_file:
+    results = json.load(json_file)
+
+  scale = {'ns': 1, 'us': 1e3, 'ms': 1e6, 's': 1e9}
+  times = {}
+  for bench in results['benchmarks']:
+    if bench.get('run_type', 'iteration') != 'iteration' or bench.get('error_occurred'):
+      continue
+    name = bench.get('run_name', bench['name'])
+    time = bench['cpu_time'] * scale[bench.get('time_unit', 'ns')]
+    times[name] = min(time, times.get(name, time))
+  return machine(results.get('context', {})), times
+
+
+def fastest(*runs):
+  """fastest time of every benchmark over several runs"""
+  times = {}
+  for run in runs:
+    for name, time in run.items():
+      times[name] = min(time, times.get(name, time))
+  return times
+
+
+def compare(current, baseline, tolerance):
+  """prints every benchmark against the baseline, returns the number of regressions"""
+  regressions = 0
+  for name in sorted(set(current) | set(baseline)):
+    if name not in baseline:
+      print(f'W\tNot in the baseline: {name}')
+      continue
+    if name not in current:
+      print(f'W\tNot run, missing from the results: {name}')
+      continue
+
+    ratio = current[name] / baseline[name]
+    slower = ratio > 1 + tolerance
+    regressions += slower
+    print(f'{"E" if slower else "I"}\t{ratio:6.2f}x {current[name] / 1e6:12.3f} ms '
+          f'{baseline[name] / 1e6:12.3f} ms  {name}')
+  return regressions
+
+
+def run_bench(bench, bench_filter, min_time, repetitions):
+  """runs the benchmarks matching the filter, returns the machine and their times"""
+  with tempfile.TemporaryDirectory() as tmp_dir:
+    results = os.path.join(tmp_dir, 'results.json')
+    command = [
+        bench, f'--benchmark_filter={bench_filter}', f'--benchmark_min_time={min_time}',
+        f'--benchmark_repetitions={repetitions}', f'--benchmark_out={results}',
+        '--benchmark_out_format=json'
+    ]
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+    return load_results(results)
+
+
+def run_alternately(bench, reference, args):
+  """runs the two builds in turn, one repetition at a time, so that both see the same
+  load of the machine, returns the times of bench and reference"""
+  current, baseline = [], []
+  for _ in range(args.repetitions):
+    current.append(run_bench(bench, args.filter, args.min_time, 1)[1])
+    baseline.append(run_bench(reference, args.filter, args.min_time, 1)[1])
+  return fastest(*current), fastest(*baseline)
+
+
+def report(regressions, tolerance):
+  """prints the number of regressions, returns the exit code"""
+  if regressions:
+    print(f'E\t{regressions} benchmarks are more than {tolerance:.0%} slower '
+          'than the baseline.')
+    return 1
+  return 0
+
+
+def main():
+  """parses the arguments and compares, exits with 1 on a regression"""
+  parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+  parser.add_argument('baseline',
+                      nargs='?',
+                      help='committed baseline json, not needed with --reference')
+  source = parser.add_mutually_exclusive_group(required=True)
+  source.add_argument('--bench', help='pdbmerge_bench to run')
+  source.add_argument('--results', help='json written by --benchmark_out')
+  parser.add_argument('--reference',
+                      help='pdbmerge_bench of the build to compare with, run on this '
+                      'machine along with --bench instead of reading the baseline')
+  parser.add_argument('--filter',
+                      default='-Merge',
+                      help='benchmarks --bench runs, the spawning Merge ones are left out')
+  parser.add_argument('--min_time', default='0.1', help='seconds --bench runs each one')
+  parser.add_argument('--repetitions',
+                      type=int,
+                      default=5,
+                      help='times --bench runs each one, the fastest is compared')
+  parser.add_argument('--tolerance',
+                      type=float,
+                      default=0.25,
+                      help='allowed slowdown as a fraction of the baseline')
+  parser.add_argument('--update',
+                      action='store_true',
+                      help='replace the baseline with the results')
+  args = parser.parse_args()
+
+  if args.reference:
+    if not args.bench:
+      parser.error('--reference needs --bench')
+    current, baseline = run_alternately(args.bench, args.reference, args)
+    return report(compare(current, baseline, args.tolerance), args.tolerance)
+
+  if not args.baseline:
+    parser.error('the baseline is needed without --reference')
+
+  if args.bench:
+    current_machine, current = run_bench(args.bench, args.filter, args.min_time,
+                                         args.repetitions)
+  else:
+    current_machine, current = load_results(args.results)
+
+  if args.update:
+    baseline = {
+        'machine': current_machine,
+        'benchmarks': {name: round(time, 1) for name, time in sorted(current.items())}
+    }
+    with open(args.baseline, 'w', encoding='utf-8') as json_file:
+      json.dump(baseline, json_file, indent=2)
+      json_file.write('\n')
+    return 0
+
+  with open(args.baseline, encoding='utf-8') as json_file:
+    baseline = json.load(json_file)
+
+  if baseline.get('machine') != current_machine:
+    print(f'E\tThe baseline was recorded on another machine, {baseline.get("machine")}, '
+          f'not on this one, {current_machine}. Record it here with --update, or compare '
+          'with a build run here with --reference.')
+    return 1
+
+  return report(compare(current, baseline['benchmarks'], args.tolerance), args.tolerance)
+
+
+if __name__ == '__main__':
+  sys.exit(main())
@@ -0,0 +1,78 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_H_
+#define GUARD_PDBMERGE_H_
+
+/// C interface of pdbmerge_core. It only offers one-shot merges: a session gathers the options
+/// and sources of a merge, the same as the command line of the tool, and pdbmerge_session_merge
+/// runs the whole tool on them in the calling process, from parsing the files to writing the
+/// outputs. Records, conflicts and resolutions are not exposed, the results are the files the
+/// tool writes. Every merge has sources, memory, diagnostics and stats of its own, all freed when
+/// it ends, so sessions may merge on different threads at the same time. A session itself is
+/// used by one thread at a time, and --watch catches SIGINT and SIGTERM for the whole process
+/// while it runs.
+///
+/// Calls returning int return the exit codes of the tool: 0 on success, 1 if some conflicts were
+/// not resolved or the dbs compared with --diff differ and 2 on errors, which are described by
+/// pdbmerge_session_error.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PDBMERGE_EXPORT __attribute__((visibility("default")))
+
+typedef struct pdbmerge_session pdbmerge_session;
+
+/// Returns NULL if out of memory.
+PDBMERGE_EXPORT pdbmerge_session* pdbmerge_session_create(void);
+
+PDBMERGE_EXPORT void pdbmerge_session_destroy(pdbmerge_session* session);
+
+/// Adds an argument of the tool, such as "--resolve" with "auto" or "--fdb" with NULL. Arguments
+/// are only stored, they are checked by pdbmerge_session_merge.
+PDBMERGE_EXPORT int
+pdbmerge_session_set_option(pdbmerge_session* session, const char* name, const char* value);
+
+/// Adds a source, sources are merged in the order they are added.
+PDBMERGE_EXPORT int pdbmerge_session_add_source(pdbmerge_session* session, const char* path);
+
+/// Runs the tool on the options and sources added: parses the sources, resolves their conflicts
+/// and writes the outputs, as one call.
+PDBMERGE_EXPORT int pdbmerge_session_merge(pdbmerge_session* session);
+
+/// Message of the last error of the session, empty if there was none. Valid until the next call
+/// with the session.
+PDBMERGE_EXPORT const char* pdbmerge_session_error(const pdbmerge_session* session);
+
+/// Runs the tool with its command line and exits the process with its exit code.
+PDBMERGE_EXPORT __attribute__((noreturn)) void pdbmerge_main(int nargs, char** cargs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // GUARD_PDBMERGE_H_
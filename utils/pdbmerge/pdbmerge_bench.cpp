@@ -0,0 +1,451 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+
+#include "pdbmerge_internal.h"
+
+#include <benchmark/benchmark.h>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/filesystem.hpp>
+
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+extern char** environ; // NOLINT (readability-redundant-declaration)
+
+namespace {
+
+/// Writes text perf dbs of a given shape. Every key lands in one file, a share of the keys is
+/// repeated in the next file with one item changed so that merging them is a conflict.
+struct SyntheticDb
+{
+    std::size_t keys              = 10000;
+    std::size_t solvers           = 4;
+    unsigned int conflict_percent = 10;
+    std::size_t files             = 8;
+    unsigned int seed             = 1;
+
+    std::vector<std::vector<std::string>> Lines() const
+    {
+        static constexpr std::array<const char*, 8> solver_names = {"ConvAsm1x1U",
+                                                                    "ConvBinWinogradRxS",
+                                                                    "ConvOclDirectFwd",
+                                                                    "ConvAsmBwdWrW3x3",
+                                                                    "ConvHipImplicitGemmV4R1Fwd",
+                                                                    "ConvAsm3x3U",
+                                                                    "ConvOclBwdWrW2",
+                                                                    "ConvMlirIgemmFwd"};
+        static constexpr std::array<const char*, 3> types      = {"FP32", "FP16", "BF16"};
+        static constexpr std::array<const char*, 3> directions = {"F", "B", "W"};
+
+        std::mt19937 random{seed};
+        const auto number = [&](int low, int high) {
+            return std::uniform_int_distribution<int>{low, high}(random);
+        };
+
+        std::vector<std::vector<std::string>> lines(std::max<std::size_t>(files, 1));
+
+        for(std::size_t i = 0; i < keys; ++i)
+        {
+            // The batch size is unique per key, the rest is random.
+            std::ostringstream key;
+            key << number(1, 512) << '-' << number(1, 256) << '-' << number(1, 256) << '-'
+                << number(1, 7) << 'x' << number(1, 7) << '-' << number(1, 512) << '-'
+                << number(1, 256) << '-' << number(1, 256) << '-' << i + 1 << '-' << number(0, 3)
+                << 'x' << number(0, 3) << "-1x1-1x1-0-NCHW-" << types[number(0, 2)] << '-'
+                << directions[number(0, 2)];
+
+            std::vector<std::string> items;
+            for(std::size_t s = 0; s < solvers; ++s)
+            {
+                std::ostringstream item;
+                item << solver_names[s % solver_names.size()];
+                if(s >= solver_names.size())
+                    item << s / solver_names.size();
+                item << ':' << number(1, 16) << ',' << number(1, 16) << ',' << number(1, 16);
+                items.push_back(item.str());
+            }
+
+            const auto home = i % lines.size();
+            lines[home].push_back(key.str() + '=' + boost::algorithm::join(items, ";"));
+
+            if(lines.size() > 1 && !items.empty() &&
+               static_cast<unsigned int>(number(0, 99)) < conflict_percent)
+            {
+                items[number(0, static_cast<int>(items.size()) - 1)] += "1";
+                lines[(home + 1) % lines.size()].push_back(key.str() + '=' +
+                                                           boost::algorithm::join(items, ";"));
+            }
+        }
+
+        return lines;
+    }
+
+    /// Writes the files into the directory, returns their paths and the total size.
+    std::vector<boost::filesystem::path> Write(const boost::filesystem::path& directory,
+                                               std::size_t& bytes) const
+    {
+        boost::filesystem::create_directories(directory);
+        std::vector<boost::filesystem::path> paths;
+        bytes = 0;
+
+        for(const auto& file_lines : Lines())
+        {
+            paths.push_back(directory / ("db" + std::to_string(paths.size()) + ".txt"));
+            std::ofstream file(paths.back().string(), std::ios::binary);
+
+            for(const auto& line : file_lines)
+            {
+                file << line << '\n';
+                bytes += line.size() + 1;
+            }
+
+            if(!file)
+                throw std::runtime_error("Can not write file " + paths.back().string());
+        }
+
+        return paths;
+    }
+};
+
+/// Same db for all the benchmarks of an argument set, with at least one conflict per file pair.
+std::vector<std::string> FlatLines(std::size_t keys, std::size_t solvers)
+{
+    SyntheticDb db;
+    db.keys             = keys;
+    db.solvers          = solvers;
+    db.conflict_percent = 30;
+
+    std::vector<std::string> lines;
+    for(auto& file_lines : db.Lines())
+        std::move(file_lines.begin(), file_lines.end(), std::back_inserter(lines));
+    return lines;
+}
+
+/// Values of the items of one key met in several sources, as a conflict of them holds them.
+std::vector<std::string> ConflictingValues(std::size_t sources, std::size_t solvers, bool times)
+{
+    std::mt19937 random{1};
+    std::vector<std::string> values;
+
+    for(std::size_t source = 0; source < sources; ++source)
+    {
+        std::string value;
+        for(std::size_t s = 0; s < solvers; ++s)
+        {
+            if(!value.empty())
+                value += ';';
+
+            value += "Solver" + std::to_string(s) + ':';
+            if(times)
+                value += std::to_string(random() % 1000) + '.' + std::to_string(random() % 100) +
+                         ",kernel_" + std::to_string(s) + ".s";
+            else
+                value += std::to_string(random() % 16) + ',' + std::to_string(random() % 16);
+        }
+        values.push_back(std::move(value));
+    }
+
+    return values;
+}
+
+/// Mergers of the in-process benchmarks do not format messages, as the tool with --verbosity 0.
+pdbmerge::Merger::Settings Quiet()
+{
+    pdbmerge::Merger::Settings settings;
+    settings.verbosity = 0;
+    return settings;
+}
+
+/// Parses a whole text db as one source.
+void Parse(benchmark::State& state)
+{
+    const auto text  = boost::algorithm::join(FlatLines(state.range(0), state.range(1)), "\n");
+    const auto lines = std::count(text.begin(), text.end(), '\n') + 1;
+    pdbmerge::Merger merger(Quiet());
+
+    for(auto _ : state)
+    {
+        merger.Parse(text);
+
+        state.PauseTiming();
+        merger.Clear();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * lines);
+    state.SetBytesProcessed(state.iterations() * (text.size() + 1));
+}
+
+void DriverOptions(benchmark::State& state)
+{
+    std::vector<std::string> keys;
+    for(const auto& line : FlatLines(1000, 1))
+        keys.push_back(line.substr(0, line.find('=')));
+
+    for(auto _ : state)
+        for(const auto& key : keys)
+            benchmark::DoNotOptimize(pdbmerge::DriverOptions(key));
+
+    state.SetItemsProcessed(state.iterations() * keys.size());
+}
+
+/// Parses the records of one key, sources of their own, into a merger.
+void AddConflict(pdbmerge::Merger& merger,
+                 std::string_view key,
+                 const std::vector<std::string>& values)
+{
+    for(const auto& value : values)
+        merger.Parse(std::string{key} + '=' + value);
+}
+
+void AutoResolve(benchmark::State& state)
+{
+    const auto find_db = state.range(2) != 0;
+    const auto values  = ConflictingValues(state.range(0), state.range(1), find_db);
+    const auto resolve = find_db ? pdbmerge::Resolve::AutoFindDb : pdbmerge::Resolve::Auto;
+    pdbmerge::Merger merger(Quiet());
+    AddConflict(merger, "key", values);
+
+    for(auto _ : state)
+        benchmark::DoNotOptimize(merger.Emit(resolve));
+
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+void NoResolve(benchmark::State& state)
+{
+    const auto conflicting = state.range(2) != 0;
+    auto values            = ConflictingValues(state.range(0), state.range(1), false);
+    if(!conflicting)
+        std::fill(values.begin(), values.end(), values.front());
+
+    const auto line = FlatLines(1, 1).front();
+    pdbmerge::Merger merger(Quiet());
+    AddConflict(merger, std::string_view{line}.substr(0, line.find('=')), values);
+
+    for(auto _ : state)
+        benchmark::DoNotOptimize(merger.Emit(pdbmerge::Resolve::Off));
+
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+}
+
+/// Splits a whole text db into lines, records and items the way the parser and Conflict::Add do,
+/// with one of the scanners. Registered once per scanner, which names the benchmark.
+void Scan(benchmark::State& state, pdbmerge::Scanner scanner)
+{
+    if(!pdbmerge::IsSupported(scanner))
+    {
+        state.SkipWithError("Not supported here");
+        return;
+    }
+
+    const auto text = boost::algorithm::join(FlatLines(state.range(0), state.range(1)), "\n");
+
+    for(auto _ : state)
+        benchmark::DoNotOptimize(pdbmerge::ScanItems(scanner, text));
+
+    state.SetBytesProcessed(state.iterations() * text.size());
+}
+
+/// Parses the records of one key met in several sources, which merges them into a conflict.
+void ParseConflict(benchmark::State& state)
+{
+    const auto values = ConflictingValues(state.range(0), state.range(1), false);
+    pdbmerge::Merger merger(Quiet());
+
+    for(auto _ : state)
+    {
+        AddConflict(merger, "key", values);
+
+        state.PauseTiming();
+        merger.Clear();
+        state.ResumeTiming();
+    }
+
+    state.SetItemsProcessed(state.iterations() * values.size() * state.range(1));
+}
+
+boost::filesystem::path TempDirectory()
+{
+    static const auto path = [] {
+        auto directory = boost::filesystem::temp_directory_path() /
+                         boost::filesystem::unique_path("pdbmerge_bench_%%%%%%%%");
+        boost::filesystem::create_directories(directory);
+        return directory;
+    }();
+    return path;
+}
+
+/// Runs the whole tool over a synthetic db in a child process, so every run starts clean and
+/// exits the way the tool does.
+void Merge(benchmark::State& state)
+{
+    SyntheticDb db;
+    db.keys         = state.range(0);
+    db.files        = state.range(2);
+    const auto jobs = std::to_string(state.range(1));
+
+    const auto directory = TempDirectory() / ("merge_" + std::to_string(db.keys) + "_" +
+                                              std::to_string(db.files));
+    auto bytes           = std::size_t{0};
+    const auto paths     = db.Write(directory, bytes);
+    const auto output    = (directory / "merged.txt").string();
+
+    std::vector<std::string> args = {
+        "/proc/self/exe", "--pdbmerge", "-r", "auto", "-j", jobs, "--verbosity", "0", "-o", output};
+    for(const auto& path : paths)
+        args.push_back(path.string());
+
+    std::vector<char*> argv;
+    for(auto& arg : args)
+        argv.push_back(arg.data());
+    argv.push_back(nullptr);
+
+    for(auto _ : state)
+    {
+        pid_t child = 0;
+        if(posix_spawn(&child, argv[0], nullptr, nullptr, argv.data(), environ) != 0)
+        {
+            state.SkipWithError("Can not start the merge");
+            break;
+        }
+
+        auto status = 0;
+        if(waitpid(child, &status, 0) != child || !WIFEXITED(status) ||
+           WEXITSTATUS(status) != 0)
+        {
+            state.SkipWithError("The merge failed");
+            break;
+        }
+    }
+
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.counters["input_bytes"] = static_cast<double>(bytes);
+}
+
+void Configurations(benchmark::internal::Benchmark* bench)
+{
+    bench->ArgNames({"keys", "solvers"});
+    for(const auto keys : {1000, 100000})
+        for(const auto solvers : {1, 8})
+            bench->Args({keys, solvers});
+}
+
+void ScanConfigurations(benchmark::internal::Benchmark* bench)
+{
+    bench->ArgNames({"keys", "solvers"})->ArgsProduct({{100000}, {1, 8}});
+}
+
+void ConflictConfigurations(benchmark::internal::Benchmark* bench)
+{
+    bench->ArgNames({"sources", "solvers"});
+    for(const auto sources : {2, 16})
+        for(const auto solvers : {4, 32})
+            bench->Args({sources, solvers});
+}
+
+} // namespace
+
+BENCHMARK(Parse)->Apply(Configurations);
+BENCHMARK_CAPTURE(Scan, scalar, pdbmerge::Scanner::Scalar)->Apply(ScanConfigurations);
+BENCHMARK_CAPTURE(Scan, sse2, pdbmerge::Scanner::Sse2)->Apply(ScanConfigurations);
+BENCHMARK_CAPTURE(Scan, avx2, pdbmerge::Scanner::Avx2)->Apply(ScanConfigurations);
+BENCHMARK(ParseConflict)->Apply(ConflictConfigurations);
+BENCHMARK(DriverOptions);
+BENCHMARK(AutoResolve)
+    ->ArgNames({"sources", "solvers", "fdb"})
+    ->ArgsProduct({{2, 16}, {4, 32}, {0, 1}});
+BENCHMARK(NoResolve)
+    ->ArgNames({"sources", "solvers", "conflicting"})
+    ->ArgsProduct({{2, 16}, {4, 32}, {0, 1}});
+BENCHMARK(Merge)
+    ->ArgNames({"keys", "jobs", "files"})
+    ->ArgsProduct({{10000, 200000}, {1, 2, 4, 8}, {8}})
+    ->Args({200000, 4, 64})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+/// Besides the benchmark flags:
+///   --pdbmerge <args>  runs the tool itself, the merge benchmarks start it so;
+///   --generate <dir> [keys [solvers [conflict_percent [files [seed]]]]]  writes a synthetic db
+///   to run other builds of the tool against.
+/// The pdbmerge_bench_check target runs all but the merge benchmarks through bench_compare.py.
+int main(int nargs, char** cargs)
+{
+    const auto arg = [&](int i) { return std::string_view{i < nargs ? cargs[i] : ""}; };
+
+    if(arg(1) == "--pdbmerge")
+    {
+        cargs[1] = cargs[0];
+        pdbmerge_main(nargs - 1, cargs + 1);
+    }
+
+    if(arg(1) == "--generate")
+    {
+        if(nargs < 3)
+        {
+            std::cerr << "F\tExpected a directory after --generate argument." << std::endl;
+            return 2;
+        }
+
+        SyntheticDb db;
+        const auto number = [&](int i, auto& value) {
+            if(i < nargs)
+                value = std::stoul(cargs[i]);
+        };
+        number(3, db.keys);
+        number(4, db.solvers);
+        number(5, db.conflict_percent);
+        number(6, db.files);
+        number(7, db.seed);
+
+        auto bytes = std::size_t{0};
+        for(const auto& path : db.Write(cargs[2], bytes))
+            std::cout << path.string() << '\n';
+        return 0;
+    }
+
+    benchmark::Initialize(&nargs, cargs);
+    if(benchmark::ReportUnrecognizedArguments(nargs, cargs))
+        return 1;
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    boost::filesystem::remove_all(TempDirectory());
+    return 0;
+}
@@ -0,0 +1,315 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_binary.h"
+
+#include "pdbmerge_merger.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+
+BinaryReader::BinaryReader(const bpath& path) : file(path.string(), false)
+{
+    const auto data = file.View();
+    if(data.size() < BinaryPerfDb::magic.size() + sizeof(BinaryPerfDb::Footer))
+        return;
+
+    std::memcpy(&footer, data.data() + data.size() - sizeof(footer), sizeof(footer));
+
+    if(footer.magic != BinaryPerfDb::magic)
+    {
+        // The magic ends every version of the footer.
+        error = "written by another version of pdbmerge";
+        return;
+    }
+
+    if(footer.byte_order != BinaryPerfDb::byte_order)
+    {
+        error = "written on a host of the other byte order";
+        return;
+    }
+
+    const auto fits = [&](std::uint64_t offset, std::uint64_t count, std::size_t size) {
+        return offset % alignof(std::uint64_t) == 0 && offset <= data.size() &&
+               count <= (data.size() - offset) / size;
+    };
+
+    auto valid = fits(footer.records, footer.record_count, sizeof(BinaryPerfDb::RecordEntry)) &&
+                 fits(footer.items, footer.item_count, sizeof(BinaryPerfDb::ItemEntry)) &&
+                 fits(footer.ids, footer.id_count, sizeof(BinaryPerfDb::IdEntry));
+
+    if(!valid)
+    {
+        error = "truncated";
+        return;
+    }
+
+    // NOLINTBEGIN (cppcoreguidelines-pro-type-reinterpret-cast)
+    records = reinterpret_cast<const BinaryPerfDb::RecordEntry*>(data.data() + footer.records);
+    items   = reinterpret_cast<const BinaryPerfDb::ItemEntry*>(data.data() + footer.items);
+    ids     = reinterpret_cast<const BinaryPerfDb::IdEntry*>(data.data() + footer.ids);
+    // NOLINTEND (cppcoreguidelines-pro-type-reinterpret-cast)
+
+    // Tables are checked once, so that lookups do not have to.
+    for(std::uint64_t i = 0; valid && i < footer.id_count; ++i)
+        valid = ids[i].offset + ids[i].size <= footer.records;
+
+    for(std::uint64_t i = 0; valid && i < footer.record_count; ++i)
+    {
+        const auto& record = records[i];
+        const auto end     = std::uint64_t{record.first_item} + record.item_count;
+        std::uint64_t size = 0;
+
+        valid = record.offset + record.key_size + record.value_size <= footer.records &&
+                end <= footer.item_count;
+
+        for(auto item = record.first_item; valid && item < end; ++item)
+        {
+            size += items[item].size;
+            valid = items[item].id < footer.id_count ||
+                    (items[item].id == BinaryPerfDb::raw_value && record.item_count == 1);
+        }
+
+        valid = valid && size == record.value_size;
+    }
+
+    error = valid ? nullptr : "tables out of bounds";
+}
+
+std::string_view BinaryReader::Key(std::size_t record) const
+{
+    return file.View().substr(records[record].offset, records[record].key_size);
+}
+
+void BinaryReader::Value(std::size_t record, std::string& value) const
+{
+    const auto& entry = records[record];
+    auto offset       = entry.offset + entry.key_size;
+
+    value.clear();
+
+    for(auto i = entry.first_item; i < entry.first_item + entry.item_count; ++i)
+    {
+        if(items[i].id != BinaryPerfDb::raw_value)
+            value.append(i == entry.first_item ? "" : ";").append(Id(items[i].id)).append(":");
+
+        value.append(file.View().substr(offset, items[i].size));
+        offset += items[i].size;
+    }
+}
+
+std::size_t BinaryReader::Find(std::string_view key) const
+{
+    std::size_t first = 0;
+    std::size_t count = Size();
+
+    while(count > 0)
+    {
+        const auto step = count / 2;
+
+        if(Key(first + step) < key)
+        {
+            first += step + 1;
+            count -= step + 1;
+        }
+        else
+        {
+            count = step;
+        }
+    }
+
+    return first < Size() && Key(first) == key ? first : Size();
+}
+
+std::string_view BinaryReader::Item(std::size_t record, std::string_view id) const
+{
+    const auto& entry = records[record];
+    auto offset       = entry.offset + entry.key_size;
+
+    for(auto i = entry.first_item; i < entry.first_item + entry.item_count; ++i)
+    {
+        if(items[i].id != BinaryPerfDb::raw_value && Id(items[i].id) == id)
+            return file.View().substr(offset, items[i].size);
+
+        offset += items[i].size;
+    }
+
+    return {};
+}
+
+std::string_view BinaryReader::Id(std::uint32_t id) const
+{
+    return file.View().substr(ids[id].offset, ids[id].size);
+}
+
+BinaryWriter::BinaryWriter(const bpath& path, bool write_behind) : file(path, false, write_behind)
+{
+    Put(BinaryPerfDb::magic.data(), BinaryPerfDb::magic.size());
+}
+
+void BinaryWriter::Write(std::string_view key, std::string_view value)
+{
+    if(!records.empty() && key <= last_key)
+        Diagnostics::Fatal("F\tRecords are not sorted: ", key, " after ", last_key);
+
+    last_key.assign(key.data(), key.size());
+    Put(key.data(), key.size());
+
+    const auto first_item = items.size();
+    std::size_t text_size = 0;
+    auto split            = true;
+    values.clear();
+
+    for(std::size_t start = 0; split && start < value.size();)
+    {
+        auto end = value.find(';', start);
+        if(end == std::string_view::npos)
+            end = value.size();
+
+        std::string_view id, params;
+        split = SplitString(value.substr(start, end - start), id, params, ':');
+
+        if(split)
+        {
+            items.push_back({Intern(id), static_cast<std::uint32_t>(params.size())});
+            values.push_back(params);
+            text_size += (values.size() == 1 ? 0 : 1) + id.size() + 1 + params.size();
+        }
+
+        start = end + 1;
+    }
+
+    // Values which would not come back the same from their items are kept whole.
+    if(!split || text_size != value.size())
+    {
+        items.resize(first_item);
+        values.assign(1, value);
+
+        if(!value.empty())
+        {
+            const auto value_size = static_cast<std::uint32_t>(value.size());
+            items.push_back({BinaryPerfDb::raw_value, value_size});
+        }
+    }
+
+    std::size_t value_size = 0;
+
+    for(const auto& item_value : values)
+    {
+        Put(item_value.data(), item_value.size());
+        value_size += item_value.size();
+    }
+
+    records.push_back({size - key.size() - value_size,
+                       static_cast<std::uint32_t>(key.size()),
+                       static_cast<std::uint32_t>(value_size),
+                       static_cast<std::uint32_t>(first_item),
+                       static_cast<std::uint32_t>(items.size() - first_item)});
+}
+
+bool BinaryWriter::Close()
+{
+    if(!file.IsOpen())
+        return false;
+
+    for(auto& id : ids)
+    {
+        id_entries[id.second].offset = size;
+        Put(id.first.data(), id.first.size());
+    }
+
+    BinaryPerfDb::Footer footer{};
+    footer.record_count = records.size();
+    footer.item_count   = items.size();
+    footer.id_count     = id_entries.size();
+    footer.byte_order   = BinaryPerfDb::byte_order;
+    footer.magic        = BinaryPerfDb::magic;
+    footer.records      = Table(records);
+    footer.items        = Table(items);
+    footer.ids          = Table(id_entries);
+
+    Put(&footer, sizeof(footer));
+    return file.Close();
+}
+
+std::uint32_t BinaryWriter::Intern(std::string_view id)
+{
+    auto found = ids.find(id);
+
+    if(found == ids.end())
+    {
+        const auto index = static_cast<std::uint32_t>(id_entries.size());
+        found            = ids.emplace(std::string{id}, index).first;
+        id_entries.push_back({0, id.size()});
+    }
+
+    return found->second;
+}
+
+void BinaryWriter::Put(const void* data, std::size_t count)
+{
+    file.Stream().write(static_cast<const char*>(data), static_cast<std::streamsize>(count));
+    size += count;
+}
+
+void DbMerger::ParseBinary(unsigned int source, Diagnostics& log)
+{
+    const BinaryReader reader(SourceFiles::Get(source));
+    std::string value;
+
+    if(!reader.IsValid())
+        Diagnostics::Fatal("F\tCan not read binary perf db ",
+                           SourceFiles::Get(source).c_str(),
+                           ": ",
+                           reader.Error());
+
+    for(std::size_t record = 0; record < reader.Size();)
+    {
+        {
+            // Spilling waits until no thread is in the middle of a batch.
+            const std::shared_lock<std::shared_mutex> lock(parsing);
+
+            for(auto i = 0; i < spill_check_interval && record < reader.Size(); ++i, ++record)
+            {
+                if(!shard.Owns(reader.Key(record)))
+                    continue;
+
+                const FilePos pos{source, static_cast<unsigned int>(record + 1)};
+                reader.Value(record, value);
+
+                if(limits.Admit(pos, reader.Key(record), value, log))
+                    AddRecord(pos, reader.Key(record), value, log);
+            }
+        }
+
+        if(max_memory != 0 && MemoryUsed() > max_memory)
+            Spill();
+    }
+}
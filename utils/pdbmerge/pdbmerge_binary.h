@@ -0,0 +1,180 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_BINARY_H_
+#define GUARD_PDBMERGE_BINARY_H_
+
+#include "pdbmerge_context.h"
+#include "pdbmerge_io.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Compact binary perf db (.pdbx). The text part of the file holds the key and the item values
+/// of every record, solver ids are interned and stored once. Fixed width tables after the text
+/// keep the records sorted by key and the items of every record, a footer at the end of the file
+/// locates them. The tables are mapped in place, so numbers are in the byte order of the host
+/// that wrote the file. The footer records it, files are only read on hosts of the same order.
+struct BinaryPerfDb
+{
+    static constexpr std::array<char, 8> magic = {'P', 'D', 'B', 'X', '2', '\0', '\0', '\0'};
+    /// Bytes of the magic every version starts with, the rest is the version.
+    static constexpr std::size_t magic_prefix = 4;
+    /// Reads back byte swapped on a host of the other order.
+    static constexpr std::uint64_t byte_order = 0x0102030405060708;
+    /// Id of an item holding a whole record value that does not split into "id:value" items.
+    static constexpr std::uint32_t raw_value = 0xFFFFFFFF;
+
+    struct RecordEntry
+    {
+        std::uint64_t offset;
+        std::uint32_t key_size;
+        /// Size of the item values, which follow the key.
+        std::uint32_t value_size;
+        std::uint32_t first_item;
+        std::uint32_t item_count;
+    };
+
+    struct ItemEntry
+    {
+        std::uint32_t id;
+        std::uint32_t size;
+    };
+
+    struct IdEntry
+    {
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+
+    struct Footer
+    {
+        std::uint64_t records;
+        std::uint64_t items;
+        std::uint64_t ids;
+        std::uint64_t record_count;
+        std::uint64_t item_count;
+        std::uint64_t id_count;
+        std::uint64_t byte_order;
+        std::array<char, 8> magic;
+    };
+
+    static bool IsDatabase(const bpath& path)
+    {
+        std::array<char, magic.size()> header = {};
+
+        if(IsStream(path))
+            return false;
+
+        std::ifstream file(path.string(), std::ios::binary);
+        return file.read(header.data(), header.size()) &&
+               std::equal(magic.begin(), magic.begin() + magic_prefix, header.begin());
+    }
+};
+
+/// Read access to a mapped .pdbx file.
+class BinaryReader
+{
+    public:
+    explicit BinaryReader(const bpath& path);
+
+    bool IsValid() const { return error == nullptr; }
+    /// Why the file can not be read, nullptr if it can.
+    const char* Error() const { return error; }
+    std::size_t Size() const { return footer.record_count; }
+
+    std::string_view Key(std::size_t record) const;
+
+    /// Rebuilds the "id:value;id:value" text of the record.
+    void Value(std::size_t record, std::string& value) const;
+
+    /// Binary searches the key table. Returns Size() if the key is not there.
+    std::size_t Find(std::string_view key) const;
+
+    /// Value of the solver in the record, empty if the record does not have it.
+    std::string_view Item(std::size_t record, std::string_view id) const;
+
+    private:
+    MappedFile file;
+    BinaryPerfDb::Footer footer{};
+    const BinaryPerfDb::RecordEntry* records = nullptr;
+    const BinaryPerfDb::ItemEntry* items     = nullptr;
+    const BinaryPerfDb::IdEntry* ids         = nullptr;
+    const char* error                        = "truncated";
+
+    std::string_view Id(std::uint32_t id) const;
+};
+
+/// Writes merged records as a .pdbx file. The text goes out as records arrive, the tables are
+/// kept in memory until Close. Records have to come sorted by key, as every merge emits them.
+class BinaryWriter : public RecordWriter
+{
+    public:
+    BinaryWriter(const bpath& path, bool write_behind);
+
+    bool IsOpen() const override { return file.IsOpen(); }
+    const bpath& Path() const override { return file.Path(); }
+
+    void Write(std::string_view key, std::string_view value) override;
+
+    bool Close() override;
+
+    private:
+    OutputFile file;
+    std::uint64_t size = 0;
+    std::string last_key;
+    std::vector<std::string_view> values;
+    std::vector<BinaryPerfDb::RecordEntry> records;
+    std::vector<BinaryPerfDb::ItemEntry> items;
+    std::vector<BinaryPerfDb::IdEntry> id_entries;
+    std::map<std::string, std::uint32_t, std::less<>> ids;
+
+    std::uint32_t Intern(std::string_view id);
+
+    void Put(const void* data, std::size_t count);
+
+    /// Writes an aligned table, returns its offset.
+    template <class Entry>
+    std::uint64_t Table(const std::vector<Entry>& entries)
+    {
+        static constexpr std::array<char, alignof(std::uint64_t)> padding = {};
+        Put(padding.data(), (padding.size() - size % padding.size()) % padding.size());
+
+        const auto offset = size;
+        Put(entries.data(), entries.size() * sizeof(Entry));
+        return offset;
+    }
+};
+
+#endif // GUARD_PDBMERGE_BINARY_H_
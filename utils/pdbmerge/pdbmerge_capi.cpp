@@ -0,0 +1,153 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge.h"
+
+#include "pdbmerge_merger.h"
+
+#include <exception>
+#include <string>
+#include <vector>
+
+struct pdbmerge_session
+{
+    std::vector<std::string> options;
+    std::vector<std::string> sources;
+    std::string error;
+};
+
+extern "C" {
+
+pdbmerge_session* pdbmerge_session_create(void)
+{
+    return new(std::nothrow) pdbmerge_session{};
+}
+
+void pdbmerge_session_destroy(pdbmerge_session* session) { delete session; }
+
+int pdbmerge_session_set_option(pdbmerge_session* session, const char* name, const char* value)
+{
+    if(session == nullptr)
+        return 2;
+
+    if(name == nullptr || name[0] != '-')
+    {
+        session->error = "F\tExpected an argument name starting with -";
+        return 2;
+    }
+
+    try
+    {
+        session->options.emplace_back(name);
+        if(value != nullptr)
+            session->options.emplace_back(value);
+    }
+    catch(const std::exception& error)
+    {
+        session->error = std::string{"F\t"} + error.what();
+        return 2;
+    }
+
+    return 0;
+}
+
+int pdbmerge_session_add_source(pdbmerge_session* session, const char* path)
+{
+    if(session == nullptr)
+        return 2;
+
+    if(path == nullptr || path[0] == '\0')
+    {
+        session->error = "F\tExpected a source path";
+        return 2;
+    }
+
+    try
+    {
+        session->sources.emplace_back(path);
+    }
+    catch(const std::exception& error)
+    {
+        session->error = std::string{"F\t"} + error.what();
+        return 2;
+    }
+
+    return 0;
+}
+
+int pdbmerge_session_merge(pdbmerge_session* session)
+{
+    if(session == nullptr)
+        return 2;
+
+    session->error.clear();
+    auto exit_code = 0;
+
+    try
+    {
+        std::vector<std::string> args = {"pdbmerge"};
+        args.insert(args.end(), session->options.begin(), session->options.end());
+        if(!session->sources.empty())
+            args.emplace_back("--sources");
+        args.insert(args.end(), session->sources.begin(), session->sources.end());
+
+        std::vector<char*> cargs;
+        for(auto& arg : args)
+            cargs.push_back(arg.data());
+        cargs.push_back(nullptr);
+
+        // Everything the merge allocates, reports and counts goes away with its context.
+        MergeContext context;
+        const MergeContext::Scope scope(context);
+
+        exit_code = DbMerger{}.Run(static_cast<int>(args.size()), cargs.data());
+    }
+    catch(const MergeError& error)
+    {
+        session->error = error.what();
+        exit_code      = error.Code();
+    }
+    catch(const std::exception& error)
+    {
+        session->error = std::string{"F\t"} + error.what();
+        exit_code      = 2;
+    }
+    catch(...)
+    {
+        session->error = "F\tUnknown error";
+        exit_code      = 2;
+    }
+
+    return exit_code;
+}
+
+const char* pdbmerge_session_error(const pdbmerge_session* session)
+{
+    return session == nullptr ? "" : session->error.c_str();
+}
+
+void pdbmerge_main(int nargs, char** cargs) { DbMerger{}.Execute(nargs, cargs); }
+
+} // extern "C"
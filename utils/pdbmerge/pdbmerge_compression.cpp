@@ -0,0 +1,357 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_compression.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <zlib.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <fstream>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+Compression CompressionOfName(const bpath& path)
+{
+    if(path.extension() == ".gz")
+        return Compression::Gzip;
+    if(path.extension() == ".zst")
+        return Compression::Zstd;
+    return Compression::None;
+}
+
+bool IsStream(const bpath& path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && !S_ISREG(info.st_mode) && !S_ISDIR(info.st_mode);
+}
+
+Compression CompressionOfContents(const bpath& path)
+{
+    if(IsStream(path))
+        return CompressionOfName(path);
+
+    std::array<unsigned char, 4> header = {};
+
+    std::ifstream file(path.string(), std::ios::binary);
+    // NOLINTNEXTLINE (cppcoreguidelines-pro-type-reinterpret-cast)
+    if(!file.read(reinterpret_cast<char*>(header.data()), header.size()))
+        return Compression::None;
+    if(header[0] == 0x1F && header[1] == 0x8B)
+        return Compression::Gzip;
+    if(header == std::array<unsigned char, 4>{0x28, 0xB5, 0x2F, 0xFD})
+        return Compression::Zstd;
+    return Compression::None;
+}
+
+Compressor::Compressor(Compression compression_) : compression(compression_)
+{
+    if(compression == Compression::Gzip)
+    {
+        // Gzip header and trailer, fastest level: the output is written once and merges
+        // should not wait for it.
+        const auto result =
+            deflateInit2(&gzip, Z_BEST_SPEED, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+        failed = result != Z_OK;
+    }
+#if PDBMERGE_ZSTD
+    else if(compression == Compression::Zstd)
+    {
+        zstd   = ZSTD_createCCtx();
+        failed = zstd == nullptr;
+    }
+#endif
+    else
+    {
+        failed = true;
+    }
+}
+
+Compressor::~Compressor()
+{
+    if(compression == Compression::Gzip)
+        deflateEnd(&gzip);
+#if PDBMERGE_ZSTD
+    if(zstd != nullptr)
+        ZSTD_freeCCtx(zstd);
+#endif
+}
+
+bool Compressor::Compress(std::string_view data, bool finish, std::vector<char>& out)
+{
+    if(failed)
+        return false;
+
+    if(compression == Compression::Gzip)
+    {
+        // NOLINTBEGIN (cppcoreguidelines-pro-type-reinterpret-cast)
+        gzip.next_in  = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+        gzip.avail_in = static_cast<uInt>(data.size());
+
+        while(true)
+        {
+            const auto used = out.size();
+            out.resize(used + chunk_size);
+            gzip.next_out  = reinterpret_cast<Bytef*>(out.data() + used);
+            gzip.avail_out = static_cast<uInt>(chunk_size);
+
+            const auto result = deflate(&gzip, finish ? Z_FINISH : Z_NO_FLUSH);
+            out.resize(out.size() - gzip.avail_out);
+
+            if(result == Z_STREAM_ERROR)
+                return !(failed = true);
+            if(finish ? result == Z_STREAM_END : gzip.avail_out != 0)
+                return true;
+        }
+        // NOLINTEND (cppcoreguidelines-pro-type-reinterpret-cast)
+    }
+
+#if PDBMERGE_ZSTD
+    ZSTD_inBuffer input = {data.data(), data.size(), 0};
+
+    while(true)
+    {
+        const auto used = out.size();
+        out.resize(used + chunk_size);
+        ZSTD_outBuffer output = {out.data() + used, chunk_size, 0};
+
+        const auto left =
+            ZSTD_compressStream2(zstd, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+        out.resize(used + output.pos);
+
+        if(ZSTD_isError(left) != 0)
+            return !(failed = true);
+        if(finish ? left == 0 : input.pos == input.size && output.pos != output.size)
+            return true;
+    }
+#else
+    return false;
+#endif
+}
+
+Decompressor::Decompressor(Compression compression_) : compression(compression_)
+{
+    if(compression == Compression::Gzip)
+    {
+        failed = inflateInit2(&gzip, 15 + 16) != Z_OK;
+    }
+#if PDBMERGE_ZSTD
+    else if(compression == Compression::Zstd)
+    {
+        zstd   = ZSTD_createDCtx();
+        failed = zstd == nullptr;
+    }
+#endif
+    else
+    {
+        failed = true;
+    }
+}
+
+Decompressor::~Decompressor()
+{
+    if(compression == Compression::Gzip)
+        inflateEnd(&gzip);
+#if PDBMERGE_ZSTD
+    if(zstd != nullptr)
+        ZSTD_freeDCtx(zstd);
+#endif
+}
+
+std::size_t Decompressor::Decompress(std::string_view& input, char* out, std::size_t size)
+{
+    if(failed)
+        return 0;
+
+    if(compression == Compression::Gzip)
+    {
+        if(at_end)
+        {
+            if(input.empty())
+                return 0;
+            inflateReset(&gzip);
+        }
+
+        // NOLINTBEGIN (cppcoreguidelines-pro-type-reinterpret-cast)
+        gzip.next_in   = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+        gzip.avail_in  = static_cast<uInt>(input.size());
+        gzip.next_out  = reinterpret_cast<Bytef*>(out);
+        gzip.avail_out = static_cast<uInt>(size);
+        // NOLINTEND (cppcoreguidelines-pro-type-reinterpret-cast)
+
+        const auto result = inflate(&gzip, Z_NO_FLUSH);
+
+        at_end = result == Z_STREAM_END;
+        failed = result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR;
+        input.remove_prefix(input.size() - gzip.avail_in);
+        return size - gzip.avail_out;
+    }
+
+#if PDBMERGE_ZSTD
+    // Without input the next frame has not started, zstd would report it as unfinished.
+    if(at_end && input.empty())
+        return 0;
+
+    ZSTD_inBuffer in      = {input.data(), input.size(), 0};
+    ZSTD_outBuffer output = {out, size, 0};
+
+    const auto left = ZSTD_decompressStream(zstd, &output, &in);
+
+    at_end = left == 0;
+    failed = ZSTD_isError(left) != 0;
+    input.remove_prefix(in.pos);
+    return output.pos;
+#else
+    return 0;
+#endif
+}
+
+CompressedInput::CompressedInput(const bpath& path, Compression compression)
+    : decompressor(compression)
+{
+    fd = open(path.c_str(), O_RDONLY);
+
+    if(fd < 0 || decompressor.Failed())
+    {
+        failed = true;
+        done   = true;
+        return;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    reader = std::thread([this]() { Run(); });
+}
+
+CompressedInput::~CompressedInput()
+{
+    if(reader.joinable())
+    {
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            stopped = true;
+        }
+        ready.notify_all();
+        reader.join();
+    }
+
+    if(fd >= 0)
+        close(fd);
+}
+
+bool CompressedInput::Next(std::vector<char>& block)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if(block.capacity() != 0)
+        spare.push_back(std::move(block));
+
+    ready.wait(lock, [&]() { return !blocks.empty() || done; });
+
+    if(blocks.empty())
+        return false;
+
+    block = std::move(blocks.front());
+    blocks.pop_front();
+    lock.unlock();
+    ready.notify_all();
+    return true;
+}
+
+void CompressedInput::Run()
+{
+    std::vector<char> compressed(block_size);
+    std::string_view input;
+    auto eof      = false;
+    auto finished = false;
+
+    while(!finished)
+    {
+        std::vector<char> block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&]() { return blocks.size() < blocks_ahead || stopped; });
+
+            if(stopped)
+                return;
+
+            if(!spare.empty())
+            {
+                block = std::move(spare.back());
+                spare.pop_back();
+            }
+        }
+
+        block.resize(block_size);
+        std::size_t size = 0;
+
+        while(size < block.size())
+        {
+            if(input.empty() && !eof)
+            {
+                const auto count = read(fd, compressed.data(), compressed.size());
+
+                if(count < 0 && errno == EINTR)
+                    continue;
+
+                failed = failed || count < 0;
+                eof    = count <= 0;
+                input  = {compressed.data(), count > 0 ? static_cast<std::size_t>(count) : 0};
+            }
+
+            const auto written =
+                decompressor.Decompress(input, block.data() + size, block.size() - size);
+            size += written;
+
+            failed   = failed || decompressor.Failed();
+            finished = failed || (eof && input.empty() && written == 0);
+
+            if(finished)
+                break;
+        }
+
+        block.resize(size);
+        const std::lock_guard<std::mutex> lock(mutex);
+
+        if(size != 0)
+            blocks.push_back(std::move(block));
+        ready.notify_all();
+    }
+
+    // A stream cut short is an error, not just the end of the records.
+    failed = failed || !decompressor.AtEnd();
+
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    ready.notify_all();
+}
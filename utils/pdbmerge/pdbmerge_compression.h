@@ -0,0 +1,162 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_COMPRESSION_H_
+#define GUARD_PDBMERGE_COMPRESSION_H_
+
+#include "pdbmerge_context.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <zlib.h>
+
+#ifndef PDBMERGE_ZSTD
+#define PDBMERGE_ZSTD 0
+#endif
+#if PDBMERGE_ZSTD
+#include <zstd.h>
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class Compression
+{
+    None,
+    Gzip,
+    Zstd,
+};
+
+/// Picks the compression of an output from its extension.
+Compression CompressionOfName(const bpath& path);
+
+/// Pipes, the standard input and other files which can only be read once, front to back. They
+/// are never probed for their contents, as that would consume them.
+bool IsStream(const bpath& path);
+
+/// Path standing for "-" in the sources.
+const char* const standard_input = "/dev/stdin";
+
+/// Detects a compressed source by its magic number, whatever it is named. Streams are only
+/// detected by their extension.
+Compression CompressionOfContents(const bpath& path);
+
+/// Streaming gzip or zstd compression. Zstd is only there when built with PDBMERGE_ZSTD.
+class Compressor
+{
+    public:
+    explicit Compressor(Compression compression_);
+
+    Compressor(const Compressor&)            = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    ~Compressor();
+
+    bool IsOpen() const { return !failed; }
+
+    /// Appends the compressed data to out, finish ends the stream. Returns false on errors.
+    bool Compress(std::string_view data, bool finish, std::vector<char>& out);
+
+    private:
+    static constexpr std::size_t chunk_size = 256 << 10;
+
+    Compression compression;
+    bool failed    = false;
+    z_stream gzip = {};
+#if PDBMERGE_ZSTD
+    ZSTD_CCtx* zstd = nullptr;
+#endif
+};
+
+/// Streaming gzip or zstd decompression. Concatenated gzip members and zstd frames are read as
+/// one stream, like the command line tools do.
+class Decompressor
+{
+    public:
+    explicit Decompressor(Compression compression_);
+
+    Decompressor(const Decompressor&)            = delete;
+    Decompressor& operator=(const Decompressor&) = delete;
+
+    ~Decompressor();
+
+    bool Failed() const { return failed; }
+    /// True between the end of one gzip member or zstd frame and the start of the next one.
+    bool AtEnd() const { return at_end; }
+
+    /// Decompresses from the front of input into out, returns the number of bytes written.
+    std::size_t Decompress(std::string_view& input, char* out, std::size_t size);
+
+    private:
+    Compression compression;
+    bool failed    = false;
+    bool at_end    = false;
+    z_stream gzip = {};
+#if PDBMERGE_ZSTD
+    ZSTD_DCtx* zstd = nullptr;
+#endif
+};
+
+/// Reads and decompresses a source on a thread of its own, a few blocks ahead of the parser.
+class CompressedInput
+{
+    public:
+    CompressedInput(const bpath& path, Compression compression);
+
+    CompressedInput(const CompressedInput&)            = delete;
+    CompressedInput& operator=(const CompressedInput&) = delete;
+
+    ~CompressedInput();
+
+    /// Replaces block with the next decompressed one. Returns false at the end of the source.
+    bool Next(std::vector<char>& block);
+
+    /// The source could not be read or decompressed to the end. Valid once Next returns false.
+    bool Failed() const { return failed; }
+
+    private:
+    static constexpr std::size_t block_size   = 1 << 20;
+    static constexpr std::size_t blocks_ahead = 4;
+
+    int fd = -1;
+    Decompressor decompressor;
+    std::thread reader;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::deque<std::vector<char>> blocks;
+    std::vector<std::vector<char>> spare;
+    std::atomic<bool> failed{false};
+    bool done    = false;
+    bool stopped = false;
+
+    void Run();
+};
+
+#endif // GUARD_PDBMERGE_COMPRESSION_H_
@@ -0,0 +1,305 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_context.h"
+
+#include <boost/filesystem/operations.hpp>
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+
+void Arena::Release()
+{
+    auto& context = MergeContext::Current();
+
+    if(cached.merge != context.Id())
+        return;
+
+    {
+        const std::lock_guard<std::mutex> lock(context.arenas.mutex);
+        context.arenas.idle.push_back(cached.arena);
+    }
+
+    cached = {};
+}
+
+void Arena::ResetAll()
+{
+    auto& registry = MergeContext::Current().arenas;
+    const std::lock_guard<std::mutex> lock(registry.mutex);
+
+    for(auto& arena : registry.arenas)
+        arena->Reset();
+}
+
+std::size_t Arena::Used()
+{
+    auto& registry = MergeContext::Current().arenas;
+    const std::lock_guard<std::mutex> lock(registry.mutex);
+    auto total = std::size_t{0};
+
+    for(const auto& arena : registry.arenas)
+        total += arena->used.load(std::memory_order_relaxed);
+
+    return total;
+}
+
+std::ostream& operator<<(std::ostream& stream, const FilePos& pos)
+{
+    stream << SourceFiles::Get(pos.source).c_str() << ':' << pos.line;
+    return stream;
+}
+
+void Diagnostics::Merge(Diagnostics& other)
+{
+    for(auto category = 0; category < categories; ++category)
+        counts[category] += other.counts[category];
+
+    for(auto& message : other.messages)
+        if(Admit(message.first))
+            Print(message.first, message.second);
+
+    other = Diagnostics{};
+    CheckErrors();
+}
+
+void Diagnostics::Summary() const
+{
+    static constexpr std::array<const char*, categories> labels = {
+        "W\tIll-formed items",
+        "W\tItems without contents",
+        "W\tIll-formed records",
+        "W\tRecords without contents",
+        "W\tRecords over the limits",
+        "W\tRecords merged without conflicts",
+        "E\tMerge conflicts",
+    };
+
+    if(Verbosity() < 1)
+        return;
+
+    for(auto category = 0; category < categories; ++category)
+    {
+        if(counts[category] == 0)
+            continue;
+
+        std::cerr << labels[category] << ": " << counts[category];
+        if(printed[category] < counts[category])
+            std::cerr << " (" << printed[category] << " shown)";
+        std::cerr << '\n';
+    }
+}
+
+bool Diagnostics::Admit(Category category)
+{
+    if(Verbosity() < 2 || (Verbosity() == 2 && printed[category] >= Limit()))
+        return false;
+
+    ++printed[category];
+    return true;
+}
+
+void Diagnostics::Print(Category category, const std::string& message)
+{
+    if(!buffered)
+        std::cerr << message;
+    else if(messages.size() < max_buffered)
+        messages.emplace_back(category, message);
+    else
+        --printed[category];
+}
+
+void Diagnostics::CheckErrors() const
+{
+    if(MaxErrors() == 0)
+        return;
+
+    std::size_t errors = 0;
+    for(auto category = 0; category < TrivialMerge; ++category)
+        errors += counts[category];
+
+    if(errors > MaxErrors())
+        Fatal("F\tMore than ", MaxErrors(), " ill-formed records and items, see --max_errors.");
+}
+
+void RunStats::AddSources()
+{
+    for(auto id = static_cast<unsigned int>(sources.size()); id < SourceFiles::Count(); ++id)
+    {
+        boost::system::error_code error;
+        const auto bytes = boost::filesystem::file_size(SourceFiles::Get(id), error);
+        sources.push_back({{}, error ? 0 : bytes, 0});
+    }
+}
+
+bool RunStats::Write(const Diagnostics& diagnostics) const
+{
+    static constexpr std::array<const char*, Diagnostics::categories> counts = {
+        "ill_formed_items",
+        "items_without_contents",
+        "ill_formed_records",
+        "records_without_contents",
+        "records_over_limits",
+        "trivial_merges",
+        "merge_conflicts",
+    };
+
+    const auto total = Since(started, CLOCK_PROCESS_CPUTIME_ID);
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+
+    std::uint64_t bytes   = 0;
+    std::uint64_t records = 0;
+
+    for(const auto& source : sources)
+    {
+        bytes += source.bytes;
+        records += source.records;
+    }
+
+    std::ofstream out(path.string());
+    out << "{\n  \"wall_seconds\": " << total.wall << ",\n  \"cpu_seconds\": " << total.cpu
+        << ",\n  \"peak_rss_bytes\": " << static_cast<std::uint64_t>(usage.ru_maxrss) * 1024
+        << ",\n  \"phases\": [";
+
+    for(std::size_t i = 0; i < phases.size(); ++i)
+        out << (i == 0 ? "" : ",") << "\n    {\"name\": \"" << phases[i].first << "\", "
+            << TimesJson(phases[i].second) << "}";
+
+    out << "\n  ],\n  \"sources\": [";
+
+    for(std::size_t i = 0; i < sources.size() && i < SourceFiles::Count(); ++i)
+        out << (i == 0 ? "" : ",") << "\n    {\"path\": "
+            << Quoted(SourceFiles::Get(i).string()) << ", \"bytes\": " << sources[i].bytes
+            << ", \"records\": " << sources[i].records << ", " << TimesJson(sources[i].times)
+            << "}";
+
+    out << "\n  ],\n  \"outputs\": [";
+
+    for(std::size_t i = 0; i < outputs.size(); ++i)
+        out << (i == 0 ? "" : ",") << "\n    {\"path\": " << Quoted(outputs[i].path)
+            << ", \"bytes\": " << outputs[i].bytes << ", \"records\": " << outputs[i].records
+            << ", \"wall_seconds\": " << outputs[i].wall << "}";
+
+    out << "\n  ],\n  \"counts\": {\"keys\": " << keys
+        << ", \"conflicting_keys\": " << conflicting_keys
+        << ", \"identical_keys\": " << identical_keys << ", \"spills\": " << spills;
+
+    for(auto category = 0; category < Diagnostics::categories; ++category)
+        out << ", \"" << counts[category] << "\": "
+            << diagnostics.Count(static_cast<Diagnostics::Category>(category));
+
+    const auto rate = [&](std::uint64_t count) {
+        return total.wall > 0 ? static_cast<double>(count) / total.wall : 0.0;
+    };
+
+    out << "},\n  \"throughput\": {\"bytes_per_second\": " << rate(bytes)
+        << ", \"records_per_second\": " << rate(records) << "}\n}\n";
+
+    out.close();
+    return !out.fail();
+}
+
+std::string RunStats::Quoted(std::string_view text)
+{
+    std::string quoted = "\"";
+
+    for(const auto ch : text)
+    {
+        if(ch == '"' || ch == '\\')
+        {
+            quoted.append(1, '\\').append(1, ch);
+        }
+        else if(static_cast<unsigned char>(ch) < 0x20)
+        {
+            std::array<char, 8> escaped = {};
+            std::snprintf(escaped.data(), escaped.size(), "\\u%04x", ch);
+            quoted.append(escaped.data());
+        }
+        else
+        {
+            quoted.append(1, ch);
+        }
+    }
+
+    return quoted.append("\"");
+}
+
+RunStats::Times RunStats::Now(clockid_t cpu_clock)
+{
+    const auto wall = std::chrono::steady_clock::now().time_since_epoch();
+    timespec cpu    = {};
+    clock_gettime(cpu_clock, &cpu);
+    return {std::chrono::duration<double>(wall).count(),
+            static_cast<double>(cpu.tv_sec) + static_cast<double>(cpu.tv_nsec) * 1e-9};
+}
+
+RunStats::Times RunStats::Since(const Times& start, clockid_t cpu_clock)
+{
+    const auto now = Now(cpu_clock);
+    return {now.wall - start.wall, now.cpu - start.cpu};
+}
+
+void RunStats::AddPhase(const char* name, const Times& spent)
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+
+    auto phase = std::find_if(
+        phases.begin(), phases.end(), [&](const auto& other) { return other.first == name; });
+
+    if(phase == phases.end())
+        phase = phases.insert(phases.end(), {name, {}});
+
+    phase->second.wall += spent.wall;
+    phase->second.cpu += spent.cpu;
+}
+
+std::string RunStats::TimesJson(const Times& times)
+{
+    std::ostringstream out;
+    out << "\"wall_seconds\": " << times.wall << ", \"cpu_seconds\": " << times.cpu;
+    return out.str();
+}
+
+MergeContext::MergeContext()
+    : diagnostics(std::make_unique<Diagnostics>(false)), stats(std::make_unique<RunStats>())
+{
+}
+
+MergeContext::~MergeContext() = default;
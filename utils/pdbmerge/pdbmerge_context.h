@@ -0,0 +1,691 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_CONTEXT_H_
+#define GUARD_PDBMERGE_CONTEXT_H_
+
+#include <boost/filesystem/path.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+using bpath = boost::filesystem::path;
+
+enum class ResolveModes
+{
+    Off,
+    Auto,
+    Last,
+    Replace,
+    Majority,
+    Priority,
+    Time,
+};
+
+enum class OutputFormats
+{
+    Auto,
+    Text,
+    Binary,
+    Sqlite,
+};
+
+/// Ends a run. The tool prints the message and exits with the code, sessions of the library
+/// return them. The help ends a run with code 0 and no message.
+class MergeError : public std::runtime_error
+{
+    public:
+    MergeError(const std::string& message, int code_) : std::runtime_error(message), code(code_)
+    {
+    }
+
+    int Code() const { return code; }
+
+    private:
+    int code;
+};
+
+/// Bump allocator for parsed records. Memory is handed out of large blocks and is only given
+/// back all at once, at the end of a run or of a spill. Every thread allocates from an arena of
+/// its own, see Local(), which belongs to the merge the thread is part of.
+class Arena
+{
+    public:
+    /// Arenas of the threads of a merge, freed with it. The arena of a thread that ended is
+    /// handed to the next thread of the merge, so a merge has at most one per running thread.
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<Arena>> arenas;
+        std::vector<Arena*> idle;
+    };
+
+    void* Allocate(std::size_t size, std::size_t alignment)
+    {
+        if(size > block_size / 4)
+        {
+            large_blocks.emplace_back(new char[size + alignment]);
+            used.fetch_add(size, std::memory_order_relaxed);
+            return Align(large_blocks.back().get(), alignment);
+        }
+
+        auto result = Align(current, alignment);
+
+        if(current == nullptr || result + size > current + left)
+        {
+            blocks.emplace_back(new char[block_size]);
+            current = blocks.back().get();
+            left    = block_size;
+            result  = Align(current, alignment);
+        }
+
+        left -= result + size - current;
+        current = result + size;
+        used.fetch_add(size, std::memory_order_relaxed);
+        return result;
+    }
+
+    std::string_view Store(std::string_view str)
+    {
+        if(str.empty())
+            return {};
+
+        const auto copy = static_cast<char*>(Allocate(str.size(), 1));
+        std::memcpy(copy, str.data(), str.size());
+        return {copy, str.size()};
+    }
+
+    /// Gives back everything allocated so far, all of it must be unused by now. The first block
+    /// is kept to serve the next allocations.
+    void Reset()
+    {
+        large_blocks.clear();
+        used = 0;
+
+        if(blocks.empty())
+            return;
+
+        blocks.resize(1);
+        current = blocks.front().get();
+        left    = block_size;
+    }
+
+    /// The arena of the calling thread in the current merge.
+    static Arena& Local();
+
+    /// Gives the arena of the calling thread back to the current merge, once the thread is done
+    /// allocating for it. What it allocated stays with the merge.
+    static void Release();
+
+    /// Resets the arenas of all threads of the current merge. None of the threads may use its
+    /// arena meanwhile.
+    static void ResetAll();
+
+    /// Bytes handed out by the arenas of all threads of the current merge since they were reset.
+    static std::size_t Used();
+
+    private:
+    static constexpr std::size_t block_size = 4 << 20;
+
+    /// The arena of the thread and the id of the merge it was taken from.
+    struct Cached
+    {
+        std::uint64_t merge = 0;
+        Arena* arena        = nullptr;
+    };
+
+    static thread_local Cached cached;
+
+    std::vector<std::unique_ptr<char[]>> blocks;       // NOLINT (modernize-avoid-c-arrays)
+    std::vector<std::unique_ptr<char[]>> large_blocks; // NOLINT (modernize-avoid-c-arrays)
+    std::atomic<std::size_t> used{0};
+    char* current    = nullptr;
+    std::size_t left = 0;
+
+    static char* Align(char* ptr, std::size_t alignment)
+    {
+        const auto address = reinterpret_cast<std::uintptr_t>(ptr); // NOLINT
+        return ptr + (alignment - address % alignment) % alignment;
+    }
+};
+
+class Diagnostics;
+class RunStats;
+
+/// State of a merge: its sources, the arenas of its threads, the diagnostics and the stats. The
+/// tool runs a single merge in the merge of the process, every merge of a library session gets
+/// one of its own, so sessions on different threads share nothing. Threads join the merge of the
+/// thread starting them through Thread().
+class MergeContext
+{
+    public:
+    MergeContext();
+    ~MergeContext();
+
+    MergeContext(const MergeContext&)            = delete;
+    MergeContext& operator=(const MergeContext&) = delete;
+
+    /// The merge the calling thread is part of, the merge of the process unless a Scope set one.
+    static MergeContext& Current() { return current != nullptr ? *current : Process(); }
+
+    /// Makes the calling thread part of a merge until destruction.
+    class Scope
+    {
+        public:
+        explicit Scope(MergeContext& context_) : context(context_), previous(current)
+        {
+            current = &context;
+        }
+
+        Scope(const Scope&)            = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope()
+        {
+            Arena::Release();
+            current = previous;
+        }
+
+        private:
+        MergeContext& context;
+        MergeContext* previous;
+    };
+
+    /// Starts a thread running function as part of the current merge.
+    template <class Function>
+    static std::thread Thread(Function function)
+    {
+        return std::thread([&context = Current(), function = std::move(function)]() mutable {
+            const Scope scope(context);
+            function();
+        });
+    }
+
+    /// Unique over the life of the process, unlike the address of a merge.
+    std::uint64_t Id() const { return id; }
+
+    Arena::Registry arenas;
+    std::vector<bpath> sources;
+    /// Source merged before all the others although it was added last, the --master.
+    unsigned int first_source = std::numeric_limits<unsigned int>::max();
+    std::unique_ptr<Diagnostics> diagnostics;
+    int verbosity          = 2;
+    std::size_t limit      = 10;
+    std::size_t max_errors = 0;
+    std::unique_ptr<RunStats> stats;
+
+    private:
+    static inline thread_local MergeContext* current = nullptr;
+    static inline std::atomic<std::uint64_t> next_id{1};
+
+    std::uint64_t id = next_id++;
+
+    static MergeContext& Process()
+    {
+        static MergeContext process;
+        return process;
+    }
+};
+
+inline thread_local Arena::Cached Arena::cached;
+
+inline Arena& Arena::Local()
+{
+    auto& context = MergeContext::Current();
+
+    if(cached.merge != context.Id())
+    {
+        auto& registry = context.arenas;
+        const std::lock_guard<std::mutex> lock(registry.mutex);
+
+        if(registry.idle.empty())
+        {
+            registry.arenas.emplace_back(std::make_unique<Arena>());
+            registry.idle.push_back(registry.arenas.back().get());
+        }
+
+        cached = {context.Id(), registry.idle.back()};
+        registry.idle.pop_back();
+    }
+
+    return *cached.arena;
+}
+/// Allocates from the arena of the calling thread and never frees.
+template <class T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    ArenaAllocator() = default;
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U>&) // NOLINT (hicpp-explicit-conversions)
+    {
+    }
+
+    T* allocate(std::size_t count)
+    {
+        return static_cast<T*>(Arena::Local().Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T*, std::size_t) noexcept {}
+
+    template <class U>
+    bool operator==(const ArenaAllocator<U>&) const
+    {
+        return true;
+    }
+
+    template <class U>
+    bool operator!=(const ArenaAllocator<U>&) const
+    {
+        return false;
+    }
+};
+
+/// Vector of trivially copyable elements keeping up to Inline of them in place, longer contents
+/// move to the arena of the calling thread and are never freed. Copies get storage of their own.
+template <class T, std::size_t Inline>
+class SmallVector
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Elements are copied as plain data");
+
+    public:
+    SmallVector() = default;
+    SmallVector(std::initializer_list<T> values)
+    {
+        for(const auto& value : values)
+            push_back(value);
+    }
+
+    SmallVector(const SmallVector& other) { Assign(other); }
+    SmallVector(SmallVector&& other) noexcept { Take(other); }
+
+    SmallVector& operator=(const SmallVector& other)
+    {
+        if(this != &other)
+            Assign(other);
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept
+    {
+        if(this != &other)
+            Take(other);
+        return *this;
+    }
+
+    ~SmallVector() = default;
+
+    T* begin() { return data(); }
+    T* end() { return data() + count; }
+    const T* begin() const { return data(); }
+    const T* end() const { return data() + count; }
+
+    T* data() { return heap != nullptr ? heap : in_place.data(); }
+    const T* data() const { return heap != nullptr ? heap : in_place.data(); }
+
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+
+    T& operator[](std::size_t index) { return data()[index]; }
+    const T& operator[](std::size_t index) const { return data()[index]; }
+    const T& front() const { return data()[0]; }
+    const T& back() const { return data()[count - 1]; }
+
+    void push_back(const T& value)
+    {
+        if(count == capacity)
+            Reserve(capacity * 2);
+        data()[count++] = value;
+    }
+
+    private:
+    std::array<T, Inline> in_place{};
+    T* heap                = nullptr;
+    std::uint32_t count    = 0;
+    std::uint32_t capacity = Inline;
+
+    void Reserve(std::size_t size)
+    {
+        if(size <= capacity)
+            return;
+
+        const auto moved = static_cast<T*>(Arena::Local().Allocate(size * sizeof(T), alignof(T)));
+        std::copy_n(data(), count, moved);
+        heap     = moved;
+        capacity = static_cast<std::uint32_t>(size);
+    }
+
+    void Assign(const SmallVector& other)
+    {
+        count = 0;
+        Reserve(other.count);
+        std::copy_n(other.data(), other.count, data());
+        count = other.count;
+    }
+
+    void Take(SmallVector& other)
+    {
+        if(other.heap == nullptr)
+        {
+            Assign(other);
+            return;
+        }
+
+        heap           = other.heap;
+        count          = other.count;
+        capacity       = other.capacity;
+        other.heap     = nullptr;
+        other.count    = 0;
+        other.capacity = Inline;
+    }
+};
+
+/// Paths of the files being merged, interned once so records only carry an index. They belong to
+/// the current merge.
+class SourceFiles
+{
+    public:
+    static unsigned int Add(bpath path)
+    {
+        Paths().emplace_back(std::move(path));
+        return static_cast<unsigned int>(Paths().size() - 1);
+    }
+
+    /// Adds a source read after the others which ranks before them, as if it was the first one.
+    static unsigned int AddFirst(bpath path)
+    {
+        const auto source                    = Add(std::move(path));
+        MergeContext::Current().first_source = source;
+        return source;
+    }
+
+    /// Place of the source in the merge, records of lower ranks come before.
+    static unsigned int Rank(unsigned int source)
+    {
+        return source == MergeContext::Current().first_source ? 0 : source + 1;
+    }
+
+    static const bpath& Get(unsigned int source) { return Paths()[source]; }
+    static unsigned int Count() { return static_cast<unsigned int>(Paths().size()); }
+    static const std::vector<bpath>& All() { return Paths(); }
+
+    private:
+    static std::vector<bpath>& Paths() { return MergeContext::Current().sources; }
+};
+
+struct FilePos
+{
+    /// Index in SourceFiles, records of earlier sources are met earlier.
+    unsigned int source;
+    unsigned int line;
+
+    bool operator<(const FilePos& other) const
+    {
+        return std::tie(source, line) < std::tie(other.source, other.line);
+    }
+
+    /// As operator<, but the master comes before the sources. Only records merged into the master
+    /// are compared so.
+    bool MergedBefore(const FilePos& other) const
+    {
+        const auto rank       = SourceFiles::Rank(source);
+        const auto other_rank = SourceFiles::Rank(other.source);
+        return std::tie(rank, line) < std::tie(other_rank, other.line);
+    }
+};
+
+inline bool SplitString(std::string_view str,
+                        std::string_view& key,
+                        std::string_view& value,
+                        const char separator)
+{
+    const auto key_size = str.find(separator);
+    const auto is_key   = key_size != std::string_view::npos && key_size != 0;
+
+    if(!is_key)
+        return false;
+
+    key   = str.substr(0, key_size);
+    value = str.substr(key_size + 1);
+    return true;
+}
+
+std::ostream& operator<<(std::ostream& stream, const FilePos& pos);
+
+/// Warnings and errors about records, counted by category. Only the first Limit() messages of
+/// every category are printed, Summary() prints the counts at the end. Messages of sources parsed
+/// concurrently are buffered in one of these per source and printed by merging it into Main() in
+/// source order, so the same messages are printed as with a single job, up to max_buffered
+/// messages per source. Not thread safe.
+class Diagnostics
+{
+    public:
+    enum Category
+    {
+        IllFormedItem,
+        EmptyItem,
+        IllFormedRecord,
+        EmptyRecord,
+        OversizedRecord,
+        /// Categories before this one are records and items rejected, counted by MaxErrors().
+        TrivialMerge,
+        MergeConflict,
+        categories,
+    };
+
+    /// Prints messages to std::cerr unless they are buffered for a later Merge.
+    explicit Diagnostics(bool buffered_ = true) : buffered(buffered_) {}
+
+    /// The log of the current merge, the settings below are those of the merge as well.
+    static Diagnostics& Main() { return *MergeContext::Current().diagnostics; }
+
+    /// 0: nothing is printed, 1: only the summary, 2: the first messages of every category and
+    /// the summary, 3: all messages and the summary.
+    static int& Verbosity() { return MergeContext::Current().verbosity; }
+
+    /// Messages printed per category with verbosity 2.
+    static std::size_t& Limit() { return MergeContext::Current().limit; }
+
+    /// Rejected records and items after which the run ends, 0 for no limit, see --max_errors.
+    static std::size_t& MaxErrors() { return MergeContext::Current().max_errors; }
+
+    /// Counts a message and formats it only if it is going to be printed.
+    template <class... Args>
+    void Report(Category category, const Args&... args)
+    {
+        ++counts[category];
+
+        if(category < TrivialMerge)
+            CheckErrors();
+
+        if(!Admit(category))
+            return;
+
+        line.str({});
+        (line << ... << args) << '\n';
+        Print(category, line.str());
+    }
+
+    /// Fatal errors end the run with code 2 and are printed whatever the verbosity.
+    template <class... Args>
+    [[noreturn]] static void Fatal(const Args&... args)
+    {
+        std::ostringstream message;
+        (message << ... << args);
+        throw MergeError(message.str(), 2);
+    }
+
+    /// Takes over the counts and messages of other, as if they were reported here.
+    void Merge(Diagnostics& other);
+
+    std::size_t Count(Category category) const { return counts[category]; }
+
+    void Summary() const;
+
+    private:
+    /// Messages kept by a buffered log, the rest are only counted. Without a bound a corrupt
+    /// source parsed with --verbosity 3 would be held in memory message by message.
+    static constexpr std::size_t max_buffered = 1 << 16;
+
+    bool buffered;
+    std::array<std::size_t, categories> counts  = {};
+    std::array<std::size_t, categories> printed = {};
+    std::vector<std::pair<Category, std::string>> messages;
+    std::ostringstream line;
+
+    bool Admit(Category category);
+
+    void Print(Category category, const std::string& message);
+
+    void CheckErrors() const;
+};
+
+/// Timing and counters of a run, written as JSON by --stats. Phases may nest and accumulate
+/// over repeated runs, e.g. spills during the parse. Every source is only updated by the thread
+/// parsing it, AddSources has to be called before the sources are parsed.
+class RunStats
+{
+    public:
+    struct Times
+    {
+        double wall = 0;
+        double cpu  = 0;
+    };
+
+    struct Source
+    {
+        Times times;
+        std::uint64_t bytes   = 0;
+        std::uint64_t records = 0;
+    };
+
+    struct Output
+    {
+        std::string path;
+        /// Time spent in writes and closing, which is all of it without --async_write.
+        double wall           = 0;
+        std::uint64_t bytes   = 0;
+        std::uint64_t records = 0;
+    };
+
+    /// The stats of the current merge.
+    static RunStats& Get() { return *MergeContext::Current().stats; }
+
+    /// Adds the wall and process CPU time from construction to destruction to a phase.
+    class Phase
+    {
+        public:
+        explicit Phase(const char* name_) : name(name_), start(Now(CLOCK_PROCESS_CPUTIME_ID))
+        {
+            // Phases are listed in the order they start.
+            Get().AddPhase(name, {});
+        }
+
+        Phase(const Phase&)            = delete;
+        Phase& operator=(const Phase&) = delete;
+        ~Phase() { Get().AddPhase(name, Since(start, CLOCK_PROCESS_CPUTIME_ID)); }
+
+        private:
+        const char* name;
+        Times start;
+    };
+
+    /// Adds the wall and CPU time of the calling thread from construction to destruction to a
+    /// source.
+    class SourceTimer
+    {
+        public:
+        explicit SourceTimer(unsigned int source_)
+            : source(source_), start(Now(CLOCK_THREAD_CPUTIME_ID))
+        {
+        }
+        SourceTimer(const SourceTimer&)            = delete;
+        SourceTimer& operator=(const SourceTimer&) = delete;
+
+        ~SourceTimer()
+        {
+            const auto spent = Since(start, CLOCK_THREAD_CPUTIME_ID);
+            auto& times      = Get().sources[source].times;
+            times.wall += spent.wall;
+            times.cpu += spent.cpu;
+        }
+
+        private:
+        unsigned int source;
+        Times start;
+    };
+
+    bool IsEnabled() const { return !path.empty(); }
+    void Enable(const bpath& path_) { path = path_; }
+    /// Adds the sources known so far, with their file sizes as the bytes read.
+    void AddSources();
+    Source& GetSource(unsigned int source) { return sources[source]; }
+    void AddOutput(Output output) { outputs.push_back(std::move(output)); }
+
+    std::uint64_t keys             = 0;
+    std::uint64_t conflicting_keys = 0;
+    std::uint64_t identical_keys   = 0;
+    std::uint64_t spills           = 0;
+
+    /// Writes the JSON, counts are taken from diagnostics. Returns false if that failed.
+    bool Write(const Diagnostics& diagnostics) const;
+
+    /// JSON string literal of text.
+    static std::string Quoted(std::string_view text);
+
+    static Times Now(clockid_t cpu_clock);
+
+    static Times Since(const Times& start, clockid_t cpu_clock);
+
+    private:
+    bpath path;
+    Times started = Now(CLOCK_PROCESS_CPUTIME_ID);
+    std::mutex mutex;
+    std::vector<std::pair<std::string, Times>> phases;
+    std::vector<Source> sources;
+    std::vector<Output> outputs;
+
+    void AddPhase(const char* name, const Times& spent);
+
+    static std::string TimesJson(const Times& times);
+};
+
+#endif // GUARD_PDBMERGE_CONTEXT_H_
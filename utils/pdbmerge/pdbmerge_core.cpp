@@ -0,0 +1,974 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_merger.h"
+
+#include "pdbmerge_binary.h"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/variant.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+DbMerger::~DbMerger()
+{
+    // Runs are only left behind by a failed merge.
+    for(const auto& run : runs)
+    {
+        boost::system::error_code error;
+        boost::filesystem::remove(run, error);
+    }
+}
+
+void DbMerger::Execute(int nargs, char** cargs)
+{
+    try
+    {
+        std::exit(Run(nargs, cargs));
+    }
+    catch(const MergeError& error)
+    {
+        if(*error.what() != '\0')
+            std::cerr << error.what() << std::endl;
+        std::exit(error.Code());
+    }
+}
+
+int DbMerger::Run(int nargs, char** cargs)
+{
+    {
+        const RunStats::Phase phase("arguments");
+        ParseArguments(nargs, cargs);
+        RunStats::Get().AddSources();
+    }
+
+    if(kernel_dbs)
+    {
+        {
+            const RunStats::Phase phase("merge");
+            MergeKernelDbs();
+        }
+        WriteStats();
+        return 0;
+    }
+
+    if(diff)
+        return Diff();
+
+    if(concat)
+        return Concat();
+
+    if(sorted_inputs)
+        return MergeSorted();
+
+    {
+        const RunStats::Phase phase("parse");
+        prefetcher = std::make_unique<Prefetcher>(SourceFiles::All(), prefetch);
+
+        if(jobs > 1 && SourceFiles::Count() > 1)
+        {
+            ParseFilesConcurrently();
+        }
+        else
+        {
+            for(auto id = 0u; id < SourceFiles::Count(); ++id)
+                ParseFile(id, Diagnostics::Main());
+        }
+
+        prefetcher.reset();
+    }
+
+    if(!watch_dir.empty())
+        return Watch();
+
+    if(!runs.empty())
+    {
+        SpillRun();
+        return MergeRuns();
+    }
+
+    return Process();
+}
+
+void DbMerger::ExitWithError(const std::string& message, int exit_code)
+{
+    throw MergeError(message, exit_code);
+}
+
+void DbMerger::ParseFilesConcurrently()
+{
+    ForEachSourceConcurrently([&](unsigned int id, Diagnostics& log) { ParseFile(id, log); });
+
+    data.ForEach([](RecordTable::Entry& entry) {
+        if(const auto conflict = boost::get<Conflict>(&entry.second))
+            conflict->SortItems();
+    });
+}
+
+void DbMerger::ForEachSourceConcurrently(
+    const std::function<void(unsigned int, Diagnostics&)>& action)
+{
+    const auto count = SourceFiles::Count();
+    std::vector<Diagnostics> logs(count);
+    std::vector<std::promise<void>> done(count);
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<unsigned int> next{0};
+    std::atomic<bool> failed{false};
+    std::vector<std::thread> workers;
+
+    for(auto i = 0u; i < std::min(jobs, count); ++i)
+    {
+        workers.push_back(MergeContext::Thread([&]() {
+            for(auto id = next++; id < count; id = next++)
+            {
+                try
+                {
+                    if(!failed)
+                        action(id, logs[id]);
+                }
+                catch(...)
+                {
+                    errors[id] = std::current_exception();
+                    failed     = true;
+                }
+                done[id].set_value();
+            }
+        }));
+    }
+
+    std::exception_ptr error;
+
+    for(auto id = 0u; id < count; ++id)
+    {
+        done[id].get_future().wait();
+
+        if(error != nullptr)
+            continue;
+
+        try
+        {
+            Diagnostics::Main().Merge(logs[id]);
+            error = errors[id];
+        }
+        catch(...)
+        {
+            // The sources together reported too many errors, see --max_errors.
+            error  = std::current_exception();
+            failed = true;
+        }
+    }
+
+    for(auto& worker : workers)
+        worker.join();
+
+    if(error != nullptr)
+        std::rethrow_exception(error);
+}
+
+void DbMerger::ParseFile(unsigned int source, Diagnostics& log)
+{
+    const RunStats::SourceTimer timer(source);
+
+    if(prefetcher)
+        prefetcher->Started(source);
+
+    if(SqlitePerfDb::IsDatabase(SourceFiles::Get(source)))
+    {
+        ParseSqlite(source, log);
+        return;
+    }
+
+    if(BinaryPerfDb::IsDatabase(SourceFiles::Get(source)))
+    {
+        ParseBinary(source, log);
+        return;
+    }
+
+    LineReader reader(SourceFiles::Get(source), use_mmap, limits.LineLength());
+    TextLine line;
+    unsigned int line_number = 0;
+    auto more                = true;
+
+    while(more)
+    {
+        {
+            // Spilling waits until no thread is in the middle of a batch.
+            const std::shared_lock<std::shared_mutex> lock(parsing);
+
+            for(auto i = 0; i < spill_check_interval && (more = reader.Next(line)); ++i)
+            {
+                line_number++;
+                ParseLine({source, line_number}, line, log);
+            }
+        }
+
+        if(max_memory != 0 && MemoryUsed() > max_memory)
+            Spill();
+    }
+
+    if(reader.Failed())
+        ExitWithError("F\tCan not decompress " + SourceFiles::Get(source).string(), 2);
+}
+
+std::size_t DbMerger::MemoryUsed() const
+{
+    return Arena::Used() + data.Size() * RecordTable::entry_overhead;
+}
+
+void DbMerger::Spill()
+{
+    const std::unique_lock<std::shared_mutex> lock(parsing);
+
+    // Another thread could have spilled while this one was waiting.
+    if(MemoryUsed() > max_memory)
+        SpillRun();
+}
+
+void DbMerger::SpillRun()
+{
+    const RunStats::Phase phase("spill");
+    RunStats::Get().spills++;
+
+    const auto dir = temp_dir.empty() ? boost::filesystem::temp_directory_path() : temp_dir;
+    runs.push_back(dir / boost::filesystem::unique_path("pdbmerge-%%%%-%%%%-%%%%-%%%%.run"));
+
+    OutputFile run(runs.back(), false, write_behind);
+
+    if(!run.IsOpen())
+        ExitWithError("F\tCan not open file " + runs.back().string(), 2);
+
+    for(const auto* entry : data.Sorted())
+        SpilledRun::Write(run.Stream(), entry->first, entry->second);
+
+    if(!run.Close())
+        ExitWithError("F\tCan not write file " + runs.back().string(), 2);
+
+    data.Clear();
+    Arena::ResetAll();
+}
+
+void DbMerger::ParseLine(const FilePos& pos, const TextLine& line, Diagnostics& log)
+{
+    std::string_view key, value;
+
+    if(ParseRecord(pos, line, shard, limits, key, value, log))
+        AddRecord(pos, key, value, log);
+}
+
+void DbMerger::AddRecord(const FilePos& pos,
+                         std::string_view key,
+                         std::string_view value,
+                         Diagnostics& log)
+{
+    const auto hash = UniqueValue::Hash(value);
+    RunStats::Get().GetSource(pos.source).records++;
+
+    // Repeated values are not stored again.
+    data.Upsert(
+        key,
+        [&]() { return Record{UniqueValue({pos, Arena::Local().Store(value)}, hash)}; },
+        [&](Record& existing) {
+            if(!AddRepeat(existing, value, hash, pos))
+                MakeConflict(existing, log).Add(Arena::Local().Store(value), pos, log);
+        });
+}
+
+std::unique_ptr<OutputFile> DbMerger::OpenOutput(const bpath& path, bool append) const
+{
+    if(path.empty())
+        return nullptr;
+
+    auto file = std::make_unique<OutputFile>(path, append, write_behind);
+
+    if(!file->IsOpen())
+        ExitWithError("F\tCan not open file " + path.string(), 2);
+
+    return file;
+}
+
+std::ostream* DbMerger::StreamOf(const std::unique_ptr<OutputFile>& file)
+{
+    return file ? &file->Stream() : nullptr;
+}
+
+std::unique_ptr<RecordWriter> DbMerger::OpenRecords(const bpath& path) const
+{
+    if(path.empty())
+        return nullptr;
+
+    std::unique_ptr<RecordWriter> file;
+    auto chosen = format;
+
+    if(chosen == OutputFormats::Auto)
+    {
+        if(path.extension() == ".db")
+            chosen = OutputFormats::Sqlite;
+        else if(path.extension() == ".pdbx")
+            chosen = OutputFormats::Binary;
+        else
+            chosen = OutputFormats::Text;
+    }
+
+    if(chosen != OutputFormats::Text && CompressionOfName(path) != Compression::None)
+        ExitWithError("F\tOnly text outputs can be compressed: " + path.string(), 2);
+    if(chosen != OutputFormats::Text && (path == "-" || IsStream(path)))
+        ExitWithError("F\tOnly text outputs can be written to streams: " + path.string(), 2);
+
+    if(chosen == OutputFormats::Sqlite)
+        file = std::make_unique<SqliteWriter>(path);
+    else if(chosen == OutputFormats::Binary)
+        file = std::make_unique<BinaryWriter>(path, write_behind);
+    else
+        file = std::make_unique<TextWriter>(path, write_behind);
+
+    if(!file->IsOpen())
+        ExitWithError("F\tCan not open file " + path.string(), 2);
+
+    return file;
+}
+
+DbMerger::Outputs DbMerger::OpenOutputs() const
+{
+    Outputs outputs;
+
+    // Without conflict resolution the side outputs start from scratch on every run,
+    // otherwise commands are appended and conflicts are never written.
+    const auto resolving = resolve_mode != ResolveModes::Off;
+
+    if(!resolving)
+    {
+        outputs.options   = OpenOutput(conflict_commands_path, false);
+        outputs.conflicts = OpenOutput(conflicts_path, conflict_commands_path.empty());
+    }
+
+    outputs.commands = OpenOutput(commands_path, resolving);
+
+    if(master_path.empty())
+    {
+        outputs.file = OpenRecords(destination_path);
+    }
+    else
+    {
+        auto master = std::make_unique<MasterDb>(master_path, write_behind);
+
+        if(!master->IsOpen())
+        {
+            boost::system::error_code error;
+            if(boost::filesystem::exists(master->Journal(), error))
+                ExitWithError("F\tCan not apply the journal of an interrupted run: " +
+                                  master->Journal().string(),
+                              2);
+            ExitWithError("F\tCan not open file " + master_path.string(), 2);
+        }
+
+        outputs.master = master.get();
+        outputs.file   = std::move(master);
+
+        if(policy)
+            policy->SourcesAdded();
+    }
+
+    if(find_db && outputs.file)
+        outputs.file = std::make_unique<FindDbWriter>(std::move(outputs.file));
+    if(RunStats::Get().IsEnabled() && outputs.file)
+        outputs.file = std::make_unique<TimedWriter>(std::move(outputs.file));
+
+    return outputs;
+}
+
+int DbMerger::Finish(Outputs& outputs, int exit_code)
+{
+    Close(outputs);
+    Diagnostics::Main().Summary();
+    WriteStats();
+    return exit_code;
+}
+
+void DbMerger::Close(Outputs& outputs)
+{
+    {
+        const RunStats::Phase phase("write");
+
+        if(outputs.file && !outputs.file->Close())
+            ExitWithError("F\tCan not write file " + outputs.file->Path().string(), 2);
+
+        for(auto* output : {&outputs.commands, &outputs.options, &outputs.conflicts})
+        {
+            const auto start = std::chrono::steady_clock::now();
+
+            if(*output && !(*output)->Close())
+                ExitWithError("F\tCan not write file " + (*output)->Path().string(), 2);
+
+            if(*output && RunStats::Get().IsEnabled())
+            {
+                const auto& path = (*output)->Path();
+                const std::chrono::duration<double> spent =
+                    std::chrono::steady_clock::now() - start;
+                boost::system::error_code error;
+                const auto bytes = boost::filesystem::file_size(path, error);
+                RunStats::Get().AddOutput({path.string(), spent.count(), error ? 0 : bytes, 0});
+            }
+        }
+    }
+}
+
+void DbMerger::WriteStats()
+{
+    auto& stats = RunStats::Get();
+
+    if(stats.IsEnabled() && !stats.Write(Diagnostics::Main()))
+        ExitWithError("F\tCan not write stats file", 2);
+}
+
+DbMerger::Sinks DbMerger::SinksOf(const Outputs& outputs, Diagnostics& log)
+{
+    return {outputs.file.get(),
+            StreamOf(outputs.commands),
+            StreamOf(outputs.options),
+            StreamOf(outputs.conflicts),
+            log};
+}
+
+bool DbMerger::Emit(const Outputs& outputs,
+                    std::string_view key,
+                    const Record& record,
+                    Diagnostics& log) const
+{
+    auto& stats = RunStats::Get();
+    stats.keys++;
+    if(IsMerged(record))
+        stats.conflicting_keys++;
+    if(IsRepeated(record))
+        stats.identical_keys++;
+
+    if(outputs.master != nullptr)
+        return EmitToMaster(outputs, key, record);
+
+    return EmitRecord(SinksOf(outputs, log), key, record);
+}
+
+bool DbMerger::EmitToMaster(const Outputs& outputs,
+                            std::string_view key,
+                            const Record& record) const
+{
+    std::vector<FileData> lines;
+
+    if(!outputs.master->Find(key, lines))
+    {
+        if(EmitRecord(SinksOf(outputs), key, record))
+            return true;
+
+        outputs.master->Drop(key);
+        return false;
+    }
+
+    Record merged = UniqueValue(lines.front());
+
+    for(auto i = 1u; i < lines.size(); ++i)
+        MakeConflict(merged, Diagnostics::Main()).Add(lines[i].value, lines[i].source);
+
+    auto& conflict = MakeConflict(merged, Diagnostics::Main());
+
+    if(const auto value = boost::get<UniqueValue>(&record))
+    {
+        for(const auto& source : value->Sources())
+            conflict.Add(value->value, source);
+    }
+    else
+    {
+        for(const auto& id : boost::get<Conflict>(record).items)
+            for(const auto& item : id.sources)
+                conflict.Insert(id.name, item);
+    }
+
+    if(EmitRecord(SinksOf(outputs), key, merged))
+        return true;
+
+    outputs.master->Drop(key);
+    return false;
+}
+
+bool DbMerger::EmitRecord(const Sinks& sinks, std::string_view key, const Record& record) const
+{
+    if(sinks.commands != nullptr)
+    {
+        const auto options = OptionsFromKey(key, sinks.log);
+        if(!options.empty())
+            *sinks.commands << options << '\n';
+    }
+
+    if(const auto value = boost::get<UniqueValue>(&record))
+    {
+        if(value->repeats != nullptr)
+            return EmitRepeated(sinks, key, *value);
+
+        if(sinks.file != nullptr)
+            sinks.file->Write(key, value->value);
+        return true;
+    }
+
+    return ProcessConflict(sinks, key, boost::get<Conflict>(record));
+}
+
+bool DbMerger::EmitRepeated(const Sinks& sinks,
+                            std::string_view key,
+                            const UniqueValue& value) const
+{
+    struct Item
+    {
+        std::string_view id;
+        std::string_view text;
+    };
+
+    std::vector<Item> items;
+
+    DelimiterScanner::Get().ForEachItem(value.value,
+                                        [&](std::string_view item, std::size_t colon) {
+                                            items.push_back({item.substr(0, colon), item});
+                                        });
+
+    std::sort(items.begin(), items.end(), [](const Item& left, const Item& right) {
+        return left.id < right.id;
+    });
+
+    for(auto i = 1u; i < items.size(); ++i)
+        if(items[i].id == items[i - 1].id)
+        {
+            Record conflict = value;
+            return ProcessConflict(sinks, key, MakeConflict(conflict, sinks.log));
+        }
+
+    if(resolve_mode == ResolveModes::Off)
+        sinks.log.Report(Diagnostics::TrivialMerge, "W\tMerged without conflicts: ", key);
+
+    if(sinks.file == nullptr)
+        return true;
+
+    std::string merged;
+    merged.reserve(value.value.size());
+
+    for(const auto& item : items)
+        merged.append(merged.empty() ? "" : ";").append(item.text);
+
+    sinks.file->Write(key, merged);
+    return true;
+}
+
+int DbMerger::Process() const
+{
+    auto exit_code = 0;
+    auto outputs   = OpenOutputs();
+
+    {
+        const RunStats::Phase phase("process");
+        const auto sorted = data.Sorted();
+
+        if(jobs > 1 && sorted.size() > emit_chunk_size && outputs.master == nullptr &&
+           (!outputs.file || outputs.file->IsText()))
+        {
+            exit_code = EmitConcurrently(outputs, sorted);
+        }
+        else
+        {
+            for(const auto* entry : sorted)
+                if(!Emit(outputs, entry->first, entry->second))
+                    exit_code = 1;
+        }
+    }
+
+    return Finish(outputs, exit_code);
+}
+
+std::unique_ptr<DbMerger::EmittedChunk> DbMerger::EmitChunk(
+    const Outputs& outputs,
+    const std::vector<const RecordTable::Entry*>& sorted,
+    std::size_t chunk) const
+{
+    auto emitted = std::make_unique<EmittedChunk>();
+    auto buffer  = std::make_unique<BufferWriter>();
+
+    emitted->records = buffer.get();
+    emitted->file    = std::move(buffer);
+    if(find_db)
+        emitted->file = std::make_unique<FindDbWriter>(std::move(emitted->file));
+
+    const Sinks sinks{outputs.file ? emitted->file.get() : nullptr,
+                      outputs.commands ? &emitted->commands : nullptr,
+                      outputs.options ? &emitted->options : nullptr,
+                      outputs.conflicts ? &emitted->conflicts : nullptr,
+                      emitted->log};
+
+    const auto end = std::min(sorted.size(), (chunk + 1) * emit_chunk_size);
+
+    try
+    {
+        for(auto i = chunk * emit_chunk_size; i < end; ++i)
+        {
+            emitted->keys++;
+            if(IsMerged(sorted[i]->second))
+                emitted->conflicting_keys++;
+            if(IsRepeated(sorted[i]->second))
+                emitted->identical_keys++;
+
+            if(!EmitRecord(sinks, sorted[i]->first, sorted[i]->second))
+                emitted->unresolved = true;
+        }
+    }
+    catch(...)
+    {
+        emitted->error = std::current_exception();
+    }
+
+    return emitted;
+}
+
+void DbMerger::Append(const std::unique_ptr<OutputFile>& file, const std::ostringstream& buffer)
+{
+    if(!file)
+        return;
+
+    const auto text = buffer.str();
+    file->Stream().write(text.data(), static_cast<std::streamsize>(text.size()));
+}
+
+int DbMerger::EmitConcurrently(const Outputs& outputs,
+                               const std::vector<const RecordTable::Entry*>& sorted) const
+{
+    const auto count  = (sorted.size() + emit_chunk_size - 1) / emit_chunk_size;
+    const auto window = std::size_t{jobs} * 4;
+    std::vector<std::unique_ptr<EmittedChunk>> chunks(count);
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::size_t next    = 0;
+    std::size_t written = 0;
+    auto stopped        = false;
+    std::vector<std::thread> workers;
+
+    for(auto i = 0u; i < jobs; ++i)
+    {
+        workers.push_back(MergeContext::Thread([&]() {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            while(true)
+            {
+                changed.wait(lock, [&]() {
+                    return stopped || next >= count || next < written + window;
+                });
+                if(stopped || next >= count)
+                    return;
+
+                const auto chunk = next++;
+                lock.unlock();
+                auto emitted = EmitChunk(outputs, sorted, chunk);
+                lock.lock();
+
+                chunks[chunk] = std::move(emitted);
+                changed.notify_all();
+            }
+        }));
+    }
+
+    auto exit_code = 0;
+    auto& stats    = RunStats::Get();
+    std::exception_ptr error;
+
+    for(auto chunk = 0u; chunk < count && error == nullptr; ++chunk)
+    {
+        std::unique_ptr<EmittedChunk> emitted;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            changed.wait(lock, [&]() { return chunks[chunk] != nullptr; });
+            emitted = std::move(chunks[chunk]);
+        }
+
+        try
+        {
+            Diagnostics::Main().Merge(emitted->log);
+            error = emitted->error;
+        }
+        catch(...)
+        {
+            // The chunks together reported too many errors, see --max_errors.
+            error = std::current_exception();
+        }
+
+        stats.keys += emitted->keys;
+        stats.conflicting_keys += emitted->conflicting_keys;
+        stats.identical_keys += emitted->identical_keys;
+
+        if(error == nullptr)
+        {
+            if(outputs.file)
+                outputs.file->WriteFormatted(emitted->records->Text(),
+                                             emitted->records->Records());
+            Append(outputs.commands, emitted->commands);
+            Append(outputs.options, emitted->options);
+            Append(outputs.conflicts, emitted->conflicts);
+            if(emitted->unresolved)
+                exit_code = 1;
+        }
+
+        {
+            const std::lock_guard<std::mutex> lock(mutex);
+            written = chunk + 1;
+            stopped = error != nullptr;
+        }
+        changed.notify_all();
+    }
+
+    for(auto& worker : workers)
+        worker.join();
+
+    if(error != nullptr)
+        std::rethrow_exception(error);
+
+    return exit_code;
+}
+
+int DbMerger::MergeSorted() const
+{
+    auto exit_code = 0;
+    auto& arena    = Arena::Local();
+    std::vector<std::unique_ptr<SortedSource>> sources;
+    std::vector<SortedSource*> heap;
+    Record record;
+    Prefetcher ahead(SourceFiles::All(), prefetch);
+
+    for(auto id = 0u; id < SourceFiles::Count(); ++id)
+    {
+        ahead.Started(id);
+        sources.emplace_back(std::make_unique<SortedSource>(id, use_mmap, shard, limits));
+        if(sources.back()->Next(Diagnostics::Main()))
+            heap.push_back(sources.back().get());
+    }
+
+    // The master is added to the sources as it is opened.
+    auto outputs = OpenOutputs();
+
+    {
+        const RunStats::Phase phase("merge");
+
+        MergeCursors(
+            std::move(heap),
+            [&](const SortedSource& source, bool first) {
+                const auto value = source.Value();
+                const auto hash  = UniqueValue::Hash(value);
+
+                if(first)
+                    record = UniqueValue({source.Pos(), arena.Store(value)}, hash);
+                else if(!AddRepeat(record, value, hash, source.Pos()))
+                    MakeConflict(record, Diagnostics::Main())
+                        .Add(arena.Store(value), source.Pos());
+            },
+            [&](std::string_view key) {
+                if(!Emit(outputs, key, record))
+                    exit_code = 1;
+
+                record = UniqueValue{};
+                arena.Reset();
+            });
+    }
+
+    return Finish(outputs, exit_code);
+}
+
+int DbMerger::MergeRuns() const
+{
+    auto exit_code = 0;
+    auto outputs   = OpenOutputs();
+    auto& arena    = Arena::Local();
+    std::vector<std::unique_ptr<SpilledRun>> cursors;
+    std::vector<SpilledRun*> heap;
+    Record record;
+
+    for(const auto& run : runs)
+    {
+        cursors.emplace_back(std::make_unique<SpilledRun>(run));
+        if(cursors.back()->Next(Diagnostics::Main()))
+            heap.push_back(cursors.back().get());
+    }
+
+    {
+        const RunStats::Phase phase("merge");
+
+        MergeCursors(
+            std::move(heap),
+            [&](const SpilledRun& run, bool first) {
+                run.Take(record, first, Diagnostics::Main());
+            },
+            [&](std::string_view key) {
+                // Runs written by concurrent parsers are not in source order.
+                if(const auto conflict = boost::get<Conflict>(&record))
+                    conflict->SortItems();
+
+                if(!Emit(outputs, key, record))
+                    exit_code = 1;
+
+                record = UniqueValue{};
+                arena.Reset();
+            });
+    }
+
+    cursors.clear();
+
+    for(const auto& run : runs)
+        boost::filesystem::remove(run);
+
+    return Finish(outputs, exit_code);
+}
+
+bool DbMerger::ProcessConflict(const Sinks& sinks,
+                               std::string_view key,
+                               const Conflict& conflict) const
+{
+    if(resolve_mode == ResolveModes::Replace)
+    {
+        ReplaceResolve::Process(sinks.file, key, conflict);
+        return true;
+    }
+
+    if(policy)
+    {
+        PolicyResolve::Process(sinks.file, key, conflict, *policy);
+        return true;
+    }
+
+    return NoResolve(sinks.options, sinks.conflicts, sinks.file, key, conflict, sinks.log)
+        .Process();
+}
+
+namespace pdbmerge {
+
+struct Merger::State
+{
+    MergeContext context;
+    std::unique_ptr<DbMerger> merger;
+    Resolve resolve = Resolve::Off;
+    Diagnostics log;
+    BufferWriter records;
+    std::ostringstream commands;
+    std::ostringstream options;
+    std::ostringstream conflicts;
+};
+
+Merger::Merger(const Settings& settings) : state(std::make_unique<State>())
+{
+    const MergeContext::Scope scope(state->context);
+    state->context.verbosity = settings.verbosity;
+    state->merger            = std::make_unique<DbMerger>();
+
+    auto& limits        = state->merger->limits;
+    limits.key_length   = settings.key_length;
+    limits.value_length = settings.value_length;
+    limits.ids          = settings.ids;
+}
+
+Merger::~Merger()
+{
+    // The records live in the arenas of the merge and go first.
+    const MergeContext::Scope scope(state->context);
+    state->merger.reset();
+}
+
+void Merger::Parse(std::string_view text)
+{
+    const MergeContext::Scope scope(state->context);
+    const auto source = SourceFiles::Add("source" + std::to_string(SourceFiles::Count()) + ".txt");
+    RunStats::Get().AddSources();
+
+    unsigned int line_number = 0;
+
+    for(std::size_t offset = 0; offset < text.size();)
+    {
+        const auto line = SplitLine(text.substr(offset));
+        offset += line.text.size() + 1;
+        state->merger->ParseLine({source, ++line_number}, line, state->log);
+    }
+}
+
+std::size_t Merger::Emit(Resolve resolve)
+{
+    const MergeContext::Scope scope(state->context);
+    auto& merger = *state->merger;
+
+    if(resolve != state->resolve)
+    {
+        if(resolve == Resolve::Off)
+            merger.policy.reset();
+        else if(resolve == Resolve::Auto)
+            merger.policy = std::make_unique<AutoPolicy>(false);
+        else if(resolve == Resolve::AutoFindDb)
+            merger.policy = std::make_unique<AutoPolicy>(true);
+        else
+            merger.policy = std::make_unique<MajorityPolicy>();
+
+        if(merger.policy)
+            merger.policy->SourcesAdded();
+        state->resolve = resolve;
+    }
+
+    state->records.Clear();
+    state->commands.str({});
+    state->options.str({});
+    state->conflicts.str({});
+
+    const DbMerger::Sinks sinks{
+        &state->records, &state->commands, &state->options, &state->conflicts, state->log};
+
+    for(const auto* entry : merger.data.Sorted())
+        merger.EmitRecord(sinks, entry->first, entry->second);
+
+    return state->records.Text().size();
+}
+
+void Merger::Clear()
+{
+    const MergeContext::Scope scope(state->context);
+    state->merger->data.Clear();
+    Arena::ResetAll();
+
+    state->context.sources.clear();
+    state->context.stats = std::make_unique<RunStats>();
+    state->log           = Diagnostics{};
+}
+
+} // namespace pdbmerge
@@ -0,0 +1,356 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_merger.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Report of the differences between two dbs, written as they are found so that only the records
+/// being compared are kept. Items of a record are matched by solver id, records differing only in
+/// the order of their items are the same. The text report has a line per added (+), removed (-)
+/// and changed (~) key, changed keys are followed by a line per added, removed or changed item.
+/// The JSON report has an object per key in a "keys" array and the counts in "summary".
+class DbDiff
+{
+    public:
+    struct Counts
+    {
+        std::uint64_t same            = 0;
+        std::uint64_t added           = 0;
+        std::uint64_t removed         = 0;
+        std::uint64_t changed         = 0;
+        std::uint64_t solvers_added   = 0;
+        std::uint64_t solvers_removed = 0;
+        std::uint64_t solvers_changed = 0;
+    };
+
+    DbDiff(std::ostream& out_, bool json_) : out(out_), json(json_)
+    {
+        if(json)
+            out << "{\n  \"keys\": [";
+    }
+
+    void Added(std::string_view key, std::string_view value)
+    {
+        ++counts.added;
+        WriteRecord(key, "added", '+', value);
+    }
+
+    void Removed(std::string_view key, std::string_view value)
+    {
+        ++counts.removed;
+        WriteRecord(key, "removed", '-', value);
+    }
+
+    /// Compares the values of a key found in both dbs.
+    void Compare(std::string_view key, std::string_view before, std::string_view after)
+    {
+        if(before == after)
+        {
+            ++counts.same;
+            return;
+        }
+
+        Split(before, before_items);
+        Split(after, after_items);
+        changes.clear();
+
+        auto left  = before_items.begin();
+        auto right = after_items.begin();
+
+        while(left != before_items.end() || right != after_items.end())
+        {
+            if(right == after_items.end() || (left != before_items.end() && left->id < right->id))
+            {
+                changes.push_back({'-', left->id, left->params, {}});
+                ++left;
+            }
+            else if(left == before_items.end() || right->id < left->id)
+            {
+                changes.push_back({'+', right->id, {}, right->params});
+                ++right;
+            }
+            else
+            {
+                if(left->params != right->params)
+                    changes.push_back({'~', left->id, left->params, right->params});
+                ++left;
+                ++right;
+            }
+        }
+
+        if(changes.empty())
+        {
+            ++counts.same;
+            return;
+        }
+
+        ++counts.changed;
+        WriteChanges(key);
+    }
+
+    /// Ends the report, returns false if writing it failed.
+    bool Finish()
+    {
+        if(json)
+        {
+            out << (Differs() ? "\n  " : "") << "],\n  \"summary\": {\"same\": " << counts.same
+                << ", \"added\": " << counts.added << ", \"removed\": " << counts.removed
+                << ", \"changed\": " << counts.changed
+                << ", \"solvers_added\": " << counts.solvers_added
+                << ", \"solvers_removed\": " << counts.solvers_removed
+                << ", \"solvers_changed\": " << counts.solvers_changed << "}\n}\n";
+        }
+
+        out.flush();
+        return !out.fail();
+    }
+
+    const Counts& GetCounts() const { return counts; }
+    bool Differs() const { return counts.added + counts.removed + counts.changed != 0; }
+
+    private:
+    struct Item
+    {
+        std::string_view id;
+        std::string_view params;
+    };
+
+    struct Change
+    {
+        char kind;
+        std::string_view id;
+        std::string_view before;
+        std::string_view after;
+    };
+
+    std::ostream& out;
+    bool json;
+    Counts counts;
+    std::vector<Item> before_items;
+    std::vector<Item> after_items;
+    std::vector<Change> changes;
+
+    /// Items of a value sorted by id, items with the same id stay in their order.
+    static void Split(std::string_view value, std::vector<Item>& items)
+    {
+        items.clear();
+
+        DelimiterScanner::Get().ForEachItem(value, [&](std::string_view item, std::size_t colon) {
+            if(colon == std::string_view::npos)
+                items.push_back({item, {}});
+            else
+                items.push_back({item.substr(0, colon), item.substr(colon + 1)});
+        });
+
+        std::stable_sort(items.begin(), items.end(), [](const Item& left, const Item& right) {
+            return left.id < right.id;
+        });
+    }
+
+    void Separate()
+    {
+        out << (counts.added + counts.removed + counts.changed == 1 ? "\n    " : ",\n    ");
+    }
+
+    void WriteRecord(std::string_view key, const char* status, char kind, std::string_view value)
+    {
+        if(!json)
+        {
+            out << kind << key << '=' << value << '\n';
+            return;
+        }
+
+        Separate();
+        out << "{\"key\": " << RunStats::Quoted(key) << ", \"status\": \"" << status
+            << "\", \"value\": " << RunStats::Quoted(value) << "}";
+    }
+
+    void WriteChanges(std::string_view key)
+    {
+        for(const auto& change : changes)
+        {
+            if(change.kind == '+')
+                ++counts.solvers_added;
+            else if(change.kind == '-')
+                ++counts.solvers_removed;
+            else
+                ++counts.solvers_changed;
+        }
+
+        if(!json)
+        {
+            out << '~' << key << '\n';
+
+            for(const auto& change : changes)
+            {
+                out << '\t' << change.kind << change.id << ':';
+                if(change.kind == '~')
+                    out << change.before << '\t' << change.after << '\n';
+                else
+                    out << (change.kind == '+' ? change.after : change.before) << '\n';
+            }
+
+            return;
+        }
+
+        Separate();
+        out << "{\"key\": " << RunStats::Quoted(key) << ", \"status\": \"changed\", \"solvers\": [";
+
+        for(std::size_t i = 0; i < changes.size(); ++i)
+        {
+            const auto& change = changes[i];
+            const auto status  = change.kind == '+' ? "added"
+                                 : change.kind == '-' ? "removed"
+                                                      : "changed";
+
+            out << (i == 0 ? "" : ", ") << "{\"id\": " << RunStats::Quoted(change.id)
+                << ", \"status\": \"" << status << "\"";
+            if(change.kind != '+')
+                out << ", \"before\": " << RunStats::Quoted(change.before);
+            if(change.kind != '-')
+                out << ", \"after\": " << RunStats::Quoted(change.after);
+            out << "}";
+        }
+
+        out << "]}";
+    }
+};
+
+int DbMerger::Diff() const
+{
+    Prefetcher ahead(SourceFiles::All(), prefetch);
+    ahead.Started(0);
+    SortedSource before(0, use_mmap, shard, limits);
+    ahead.Started(1);
+    SortedSource after(1, use_mmap, shard, limits);
+
+    const auto file = OpenOutput(destination_path, false);
+    DbDiff report(file ? file->Stream() : std::cout, json_report);
+
+    {
+        const RunStats::Phase phase("diff");
+        auto& log       = Diagnostics::Main();
+        auto has_before = before.Next(log);
+        auto has_after  = after.Next(log);
+
+        while(has_before || has_after)
+        {
+            if(has_before && (!has_after || before.Key() < after.Key()))
+            {
+                report.Removed(before.Key(), before.Value());
+                has_before = before.Next(log);
+                continue;
+            }
+
+            if(!has_before || after.Key() < before.Key())
+            {
+                report.Added(after.Key(), after.Value());
+                has_after = after.Next(log);
+                continue;
+            }
+
+            report.Compare(before.Key(), before.Value(), after.Value());
+            has_before = before.Next(log);
+            has_after  = after.Next(log);
+        }
+    }
+
+    {
+        const RunStats::Phase phase("write");
+
+        if(!report.Finish() || (file && !file->Close()))
+            ExitWithError("F\tCan not write file " +
+                              (file ? file->Path().string() : std::string{"to stdout"}),
+                          2);
+    }
+
+    const auto& counts = report.GetCounts();
+    auto& stats        = RunStats::Get();
+    stats.keys         = counts.same + counts.added + counts.removed + counts.changed;
+
+    if(Diagnostics::Verbosity() > 0)
+        std::cerr << "Keys same: " << counts.same << ", added: " << counts.added
+                  << ", removed: " << counts.removed << ", changed: " << counts.changed
+                  << " (solvers added: " << counts.solvers_added
+                  << ", removed: " << counts.solvers_removed
+                  << ", changed: " << counts.solvers_changed << ")" << std::endl;
+
+    Diagnostics::Main().Summary();
+    WriteStats();
+    return report.Differs() ? 1 : 0;
+}
+
+int DbMerger::Concat() const
+{
+    const KeyShard all;
+    auto file = OpenRecords(destination_path);
+    std::vector<std::unique_ptr<SortedSource>> sources;
+    std::vector<SortedSource*> heap;
+    Prefetcher ahead(SourceFiles::All(), prefetch);
+
+    for(auto id = 0u; id < SourceFiles::Count(); ++id)
+    {
+        ahead.Started(id);
+        sources.emplace_back(std::make_unique<SortedSource>(id, use_mmap, all, limits));
+        if(sources.back()->Next(Diagnostics::Main()))
+            heap.push_back(sources.back().get());
+    }
+
+    {
+        const RunStats::Phase phase("concat");
+
+        MergeCursors(
+            std::move(heap),
+            [&](const SortedSource& source, bool first) {
+                if(!first)
+                    Diagnostics::Fatal("F\tKey found in more than one shard: ",
+                                       source.Key(),
+                                       " at ",
+                                       source.Pos());
+
+                RunStats::Get().keys++;
+                file->Write(source.Key(), source.Value());
+            },
+            [](std::string_view /*key*/) {});
+    }
+
+    {
+        const RunStats::Phase phase("write");
+
+        if(!file->Close())
+            ExitWithError("F\tCan not write file " + destination_path.string(), 2);
+    }
+
+    Diagnostics::Main().Summary();
+    WriteStats();
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+
+#include "pdbmerge_internal.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/// Runs libFuzzer inputs through the text parser the way a corrupt source would reach it: every
+/// line is split and checked against the limits, records are stored and combined, and the merged
+/// records are written with their driver commands, resolved by the policy the first byte picks.
+/// Nothing in there may throw, only --max_errors ends a run, which is not set here.
+extern "C" int LLVMFuzzerTestOneInput(const std::uint8_t* data, std::size_t size)
+{
+    // Messages are formatted and buffered, as with --jobs, but never printed.
+    static pdbmerge::Merger merger{{3, 1024, 1 << 16, 256}};
+    static constexpr std::array modes{
+        pdbmerge::Resolve::Off,
+        pdbmerge::Resolve::Auto,
+        pdbmerge::Resolve::AutoFindDb,
+        pdbmerge::Resolve::Majority,
+    };
+
+    const std::string_view contents{reinterpret_cast<const char*>(data), size}; // NOLINT
+    const auto mode = contents.empty() ? 0 : static_cast<unsigned char>(contents.front()) % 4;
+
+    merger.Parse(contents);
+    merger.Emit(modes[mode]);
+    merger.Clear();
+    return 0;
+}
@@ -0,0 +1,105 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_INTERNAL_H_
+#define GUARD_PDBMERGE_INTERNAL_H_
+
+#include "pdbmerge.h"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+/// C++ interface of pdbmerge_core for its benchmarks and fuzzer, which need parts of a merge the
+/// C interface does not reach. It changes along with the library, nothing else should use it.
+namespace pdbmerge {
+
+/// Implementations of the delimiter scanner of the text parsers.
+enum class Scanner
+{
+    Scalar,
+    Sse2,
+    Avx2,
+};
+
+/// Whether the build has the scanner and the CPU runs it.
+PDBMERGE_EXPORT bool IsSupported(Scanner scanner);
+
+/// Splits a text db into lines, records and items the way the parsers do, returns the items.
+PDBMERGE_EXPORT std::size_t ScanItems(Scanner scanner, std::string_view text);
+
+/// Driver command reproducing a key, as written to --commands. Empty if the key is not one.
+PDBMERGE_EXPORT std::string DriverOptions(std::string_view key);
+
+/// Conflict resolution of Merger::Emit, as by --resolve off, --resolve auto, --resolve auto with
+/// --fdb and --resolve majority.
+enum class Resolve
+{
+    Off,
+    Auto,
+    AutoFindDb,
+    Majority,
+};
+
+/// Text sources merged in memory as by the tool. Every merger is a merge of its own, with the
+/// memory of its records, its sources and its diagnostics. Messages are formatted as with the
+/// verbosity but never printed.
+class PDBMERGE_EXPORT Merger
+{
+    public:
+    struct Settings
+    {
+        int verbosity = 2;
+        /// --max_key_length, --max_value_length and --max_ids, 0 for no limit.
+        std::size_t key_length   = 0;
+        std::size_t value_length = 0;
+        std::size_t ids          = 0;
+    };
+
+    explicit Merger(const Settings& settings);
+    ~Merger();
+
+    Merger(const Merger&)            = delete;
+    Merger& operator=(const Merger&) = delete;
+
+    /// Parses text as the next source.
+    void Parse(std::string_view text);
+
+    /// Writes the records merged so far, their driver commands, and with Resolve::Off their
+    /// conflicts, to memory. Returns the size of the records written. The records are kept.
+    std::size_t Emit(Resolve resolve);
+
+    /// Forgets the sources and records, their memory is reused by the next ones.
+    void Clear();
+
+    private:
+    struct State;
+    std::unique_ptr<State> state;
+};
+
+} // namespace pdbmerge
+
+#endif // GUARD_PDBMERGE_INTERNAL_H_
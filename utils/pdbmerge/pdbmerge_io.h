@@ -0,0 +1,651 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_IO_H_
+#define GUARD_PDBMERGE_IO_H_
+
+#include "pdbmerge_compression.h"
+#include "pdbmerge_context.h"
+#include "pdbmerge_scanner.h"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+/// Read-only private mapping of a whole file. Records parsed from it are views into the mapping
+/// and must be copied before the mapping goes away.
+class MappedFile
+{
+    public:
+    /// Sequential files are read ahead aggressively.
+    explicit MappedFile(const std::string& path, bool sequential = true)
+    {
+        const auto fd = open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+            return;
+
+        struct stat info;
+        if(fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            const auto size = static_cast<std::size_t>(info.st_size);
+            // NOLINTNEXTLINE (hicpp-signed-bitwise)
+            const auto addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if(addr != MAP_FAILED)
+            {
+                madvise(addr, size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+                data   = static_cast<const char*>(addr);
+                length = size;
+            }
+        }
+
+        close(fd);
+    }
+
+    MappedFile(const MappedFile&)            = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if(data != nullptr)
+            // NOLINTNEXTLINE (cppcoreguidelines-pro-type-const-cast)
+            munmap(const_cast<char*>(data), length);
+    }
+
+    std::string_view View() const { return {data, length}; }
+
+    private:
+    const char* data   = nullptr;
+    std::size_t length = 0;
+};
+
+/// Reads a source line by line, either in place from a mapping of the whole file or through a
+/// stream. Compressed sources are always read through a CompressedInput. Lines are split the
+/// same way as by std::getline and stay valid until the next call. With a max_line only the first
+/// max_line + 1 bytes of longer lines are copied, enough to tell they are too long.
+class LineReader
+{
+    public:
+    LineReader(const bpath& path, bool use_mmap, std::size_t max_line_ = 0) : max_line(max_line_)
+    {
+        const auto compression = CompressionOfContents(path);
+
+        if(compression != Compression::None)
+            compressed = std::make_unique<CompressedInput>(path, compression);
+        else if(use_mmap && !IsStream(path))
+            mapped = std::make_unique<MappedFile>(path.string());
+        else
+            stream.open(path.string());
+    }
+
+    /// The source could not be read to the end. Valid once Next returns false.
+    bool Failed() const { return compressed && compressed->Failed(); }
+
+    bool Next(TextLine& line)
+    {
+        if(compressed)
+            return NextDecompressed(line);
+
+        if(!mapped && max_line != 0)
+            return NextBounded(line);
+
+        if(!mapped)
+        {
+            if(!std::getline(stream, buffer))
+                return false;
+
+            line = SplitLine(buffer);
+            return true;
+        }
+
+        const auto contents = mapped->View();
+
+        if(offset >= contents.size())
+            return false;
+
+        line = SplitLine(contents.substr(offset));
+        offset += line.text.size() + 1;
+        return true;
+    }
+
+    private:
+    std::unique_ptr<MappedFile> mapped;
+    std::unique_ptr<CompressedInput> compressed;
+    std::vector<char> block;
+    std::size_t offset = 0;
+    std::ifstream stream;
+    std::string buffer;
+    std::size_t max_line;
+    std::vector<char> bounded;
+
+    /// Reads into a buffer of max_line + 2 bytes allocated once, the rest of a longer line is
+    /// skipped.
+    bool NextBounded(TextLine& line)
+    {
+        if(bounded.empty())
+            bounded.resize(max_line + 2);
+
+        stream.getline(bounded.data(), static_cast<std::streamsize>(bounded.size()));
+        auto size = static_cast<std::size_t>(stream.gcount());
+
+        if(stream.bad() || (stream.fail() && size == 0))
+            return false;
+
+        if(stream.fail())
+        {
+            stream.clear();
+            stream.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        else if(!stream.eof())
+        {
+            // The newline is counted, not stored.
+            --size;
+        }
+
+        line = SplitLine({bounded.data(), size});
+        return true;
+    }
+
+    /// Appends to buffer up to max_line + 1 bytes of a line.
+    void Keep(std::string_view text)
+    {
+        if(max_line != 0)
+            text = text.substr(0, max_line + 1 - std::min(buffer.size(), max_line + 1));
+
+        buffer.append(text.data(), text.size());
+    }
+
+    /// Lines are views into the current block, only lines spanning blocks are copied to buffer.
+    bool NextDecompressed(TextLine& line)
+    {
+        buffer.clear();
+
+        while(true)
+        {
+            const auto contents = std::string_view{block.data(), block.size()}.substr(offset);
+            line                = SplitLine(contents);
+
+            if(line.text.size() < contents.size())
+            {
+                offset += line.text.size() + 1;
+
+                if(!buffer.empty())
+                {
+                    Keep(line.text);
+                    line = SplitLine(buffer);
+                }
+
+                return true;
+            }
+
+            Keep(contents);
+            offset = 0;
+
+            if(!compressed->Next(block))
+            {
+                block.clear();
+                line = SplitLine(buffer);
+                return !buffer.empty();
+            }
+        }
+    }
+};
+
+/// Output file opened once for the whole run. Everything written to Stream() is collected in a
+/// large buffer and only goes to the file when the buffer fills up or on Close(). With
+/// write_behind full buffers are written by a background thread while the next one is filled.
+/// Paths ending with .gz or .zst are compressed on the way, by the background thread if any.
+class OutputFile : private std::streambuf
+{
+    public:
+    OutputFile(const bpath& path_, bool append, bool write_behind) : path(path_), stream(this)
+    {
+        // NOLINTNEXTLINE (hicpp-signed-bitwise)
+        const auto flags = O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+
+        // - is the standard output, whatever it is redirected to.
+        if(path == "-")
+            fd = dup(STDOUT_FILENO);
+        else
+            fd = open(path.c_str(), flags, 0666); // NOLINT (hicpp-vararg)
+
+        const auto compression = CompressionOfName(path);
+
+        if(compression != Compression::None && fd >= 0)
+        {
+            compressor = std::make_unique<Compressor>(compression);
+
+            if(!compressor->IsOpen())
+            {
+                close(fd);
+                fd = -1;
+            }
+        }
+
+        buffer.resize(buffer_size);
+        setp(buffer.data(), buffer.data() + buffer.size());
+
+        if(write_behind && fd >= 0)
+            writer = std::thread([this]() { WriteBehind(); });
+    }
+
+    OutputFile(const OutputFile&)            = delete;
+    OutputFile& operator=(const OutputFile&) = delete;
+
+    ~OutputFile() override { Close(); }
+
+    bool IsOpen() const { return fd >= 0; }
+    const bpath& Path() const { return path; }
+    std::ostream& Stream() { return stream; }
+
+    /// Writes out everything buffered and closes the file. Returns false if any write failed.
+    bool Close()
+    {
+        if(fd < 0)
+            return !failed;
+
+        Submit();
+
+        if(writer.joinable())
+        {
+            {
+                const std::lock_guard<std::mutex> lock(mutex);
+                done = true;
+            }
+            ready.notify_all();
+            writer.join();
+        }
+
+        if(compressor)
+            Flush(nullptr, 0, true);
+
+        close(fd);
+        fd = -1;
+        return !failed;
+    }
+
+    private:
+    static constexpr std::size_t buffer_size = 1 << 20;
+
+    bpath path;
+    std::ostream stream;
+    int fd = -1;
+    std::vector<char> buffer;
+    std::atomic<bool> failed{false};
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<char> pending;
+    bool has_pending = false;
+    bool done        = false;
+
+    std::unique_ptr<Compressor> compressor;
+    std::vector<char> compressed;
+
+    int_type overflow(int_type ch) override
+    {
+        Submit();
+
+        if(!traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+
+        return traits_type::not_eof(ch);
+    }
+
+    void Submit()
+    {
+        const auto size = static_cast<std::size_t>(pptr() - pbase());
+
+        if(size != 0 && !writer.joinable())
+        {
+            Flush(buffer.data(), size);
+        }
+        else if(size != 0)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait(lock, [&]() { return !has_pending; });
+            buffer.resize(size);
+            std::swap(buffer, pending);
+            has_pending = true;
+            lock.unlock();
+            ready.notify_all();
+        }
+
+        buffer.resize(buffer_size);
+        setp(buffer.data(), buffer.data() + buffer.size());
+    }
+
+    void WriteBehind()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        while(true)
+        {
+            ready.wait(lock, [&]() { return has_pending || done; });
+
+            if(!has_pending)
+                return;
+
+            lock.unlock();
+            Flush(pending.data(), pending.size());
+            lock.lock();
+
+            has_pending = false;
+            ready.notify_all();
+        }
+    }
+
+    void Flush(const char* data, std::size_t size, bool finish = false)
+    {
+        if(!compressor)
+        {
+            WriteAll(data, size);
+            return;
+        }
+
+        compressed.clear();
+
+        if(!compressor->Compress({data, size}, finish, compressed))
+            failed = true;
+
+        WriteAll(compressed.data(), compressed.size());
+    }
+
+    void WriteAll(const char* data, std::size_t size)
+    {
+        while(size > 0)
+        {
+            const auto written = write(fd, data, size);
+
+            if(written < 0)
+            {
+                if(errno == EINTR)
+                    continue;
+
+                failed = true;
+                return;
+            }
+
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+    }
+};
+
+/// Destination of merged records.
+class RecordWriter
+{
+    public:
+    RecordWriter()                               = default;
+    RecordWriter(const RecordWriter&)            = delete;
+    RecordWriter& operator=(const RecordWriter&) = delete;
+    virtual ~RecordWriter()                      = default;
+
+    virtual bool IsOpen() const       = 0;
+    virtual const bpath& Path() const = 0;
+    virtual void Write(std::string_view key, std::string_view value) = 0;
+    /// Finishes the output. Returns false if anything failed to be written.
+    virtual bool Close() = 0;
+
+    /// Text outputs also take records formatted in advance in a BufferWriter, behind the same
+    /// decorators as this writer has, see WriteFormatted.
+    virtual bool IsText() const { return false; }
+    virtual void WriteFormatted(std::string_view /*text*/, std::uint64_t /*records*/) {}
+};
+
+class TextWriter : public RecordWriter
+{
+    public:
+    TextWriter(const bpath& path, bool write_behind) : file(path, false, write_behind) {}
+
+    bool IsOpen() const override { return file.IsOpen(); }
+    const bpath& Path() const override { return file.Path(); }
+
+    void Write(std::string_view key, std::string_view value) override
+    {
+        file.Stream() << key << '=' << value << '\n';
+    }
+
+    bool Close() override { return file.Close(); }
+
+    bool IsText() const override { return true; }
+
+    void WriteFormatted(std::string_view text, std::uint64_t /*records*/) override
+    {
+        file.Stream().write(text.data(), static_cast<std::streamsize>(text.size()));
+    }
+
+    private:
+    OutputFile file;
+};
+
+/// Formats records the same way as TextWriter, into memory.
+class BufferWriter : public RecordWriter
+{
+    public:
+    bool IsOpen() const override { return true; }
+    const bpath& Path() const override { return path; }
+
+    void Write(std::string_view key, std::string_view value) override
+    {
+        text.append(key).append(1, '=').append(value).append(1, '\n');
+        ++records;
+    }
+
+    bool Close() override { return true; }
+
+    const std::string& Text() const { return text; }
+    std::uint64_t Records() const { return records; }
+
+    void Clear()
+    {
+        text.clear();
+        records = 0;
+    }
+
+    private:
+    bpath path;
+    std::string text;
+    std::uint64_t records = 0;
+};
+
+/// Items of a find db record are "id:solver,time,workspace,..." with the algorithm as id, or
+/// "solver:time,workspace,..." in the solver indexed layout.
+struct FindDb
+{
+    /// Reads the kernel time of an item value. Returns false if it is not a number.
+    static bool Time(std::string_view value, double& time)
+    {
+        const auto end   = value.find(',');
+        const auto first = value.substr(0, end);
+
+        if(Number(first, time))
+            return true;
+
+        if(end == std::string_view::npos)
+            return false;
+
+        value.remove_prefix(end + 1);
+        return Number(value.substr(0, value.find(',')), time);
+    }
+
+    /// Sorts the items of a record by kernel time and then by id, the fastest comes first.
+    /// Items without a time go last in their original order.
+    static std::string SortByTime(std::string_view record)
+    {
+        struct Item
+        {
+            std::string_view text;
+            std::string_view id;
+            double time;
+        };
+
+        std::vector<Item> items;
+
+        for(std::size_t start = 0; start <= record.size();)
+        {
+            auto end = record.find(';', start);
+            if(end == std::string_view::npos)
+                end = record.size();
+
+            const auto text = record.substr(start, end - start);
+            std::string_view id, value;
+            auto time = std::numeric_limits<double>::infinity();
+
+            if(SplitString(text, id, value, ':') && !Time(value, time))
+                time = std::numeric_limits<double>::infinity();
+
+            items.push_back({text, id, time});
+            start = end + 1;
+        }
+
+        std::stable_sort(items.begin(), items.end(), [](const Item& left, const Item& right) {
+            if(left.time != right.time)
+                return left.time < right.time;
+            return left.time != std::numeric_limits<double>::infinity() && left.id < right.id;
+        });
+
+        std::string sorted;
+        sorted.reserve(record.size());
+
+        for(const auto& item : items)
+            sorted.append(&item == &items.front() ? "" : ";").append(item.text);
+
+        return sorted;
+    }
+
+    private:
+    static bool Number(std::string_view text, double& number)
+    {
+        if(text.empty())
+            return false;
+
+        const std::string copy{text};
+        char* end = nullptr;
+        number    = std::strtod(copy.c_str(), &end);
+        return end == copy.c_str() + copy.size() && std::isfinite(number);
+    }
+};
+
+/// Writes find db records with their items ordered by kernel time.
+class FindDbWriter : public RecordWriter
+{
+    public:
+    explicit FindDbWriter(std::unique_ptr<RecordWriter> records_) : records(std::move(records_)) {}
+
+    bool IsOpen() const override { return records->IsOpen(); }
+    const bpath& Path() const override { return records->Path(); }
+
+    void Write(std::string_view key, std::string_view value) override
+    {
+        records->Write(key, FindDb::SortByTime(value));
+    }
+
+    bool Close() override { return records->Close(); }
+
+    bool IsText() const override { return records->IsText(); }
+
+    /// The text was sorted by the FindDbWriter in front of the buffer.
+    void WriteFormatted(std::string_view text, std::uint64_t count) override
+    {
+        records->WriteFormatted(text, count);
+    }
+
+    private:
+    std::unique_ptr<RecordWriter> records;
+};
+
+/// Measures the time spent writing records for --stats.
+class TimedWriter : public RecordWriter
+{
+    public:
+    explicit TimedWriter(std::unique_ptr<RecordWriter> records_) : records(std::move(records_)) {}
+
+    bool IsOpen() const override { return records->IsOpen(); }
+    const bpath& Path() const override { return records->Path(); }
+
+    void Write(std::string_view key, std::string_view value) override
+    {
+        const auto start = std::chrono::steady_clock::now();
+        records->Write(key, value);
+        spent += std::chrono::steady_clock::now() - start;
+        ++count;
+    }
+
+    bool IsText() const override { return records->IsText(); }
+
+    void WriteFormatted(std::string_view text, std::uint64_t records_) override
+    {
+        const auto start = std::chrono::steady_clock::now();
+        records->WriteFormatted(text, records_);
+        spent += std::chrono::steady_clock::now() - start;
+        count += records_;
+    }
+
+    bool Close() override
+    {
+        const auto start = std::chrono::steady_clock::now();
+        const auto done  = records->Close();
+        spent += std::chrono::steady_clock::now() - start;
+
+        boost::system::error_code error;
+        const auto bytes = boost::filesystem::file_size(Path(), error);
+        const std::chrono::duration<double> wall = spent;
+        RunStats::Get().AddOutput({Path().string(), wall.count(), error ? 0 : bytes, count});
+        return done;
+    }
+
+    private:
+    std::unique_ptr<RecordWriter> records;
+    std::chrono::steady_clock::duration spent{};
+    std::uint64_t count = 0;
+};
+
+#endif // GUARD_PDBMERGE_IO_H_
@@ -0,0 +1,287 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_internal.h"
+#include "pdbmerge_key.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <string>
+#include <string_view>
+
+bool ConvKey::Parse(std::string_view key, ConvKey& parsed)
+{
+    parsed = {};
+
+    const auto suffix = key.find('_');
+    if(suffix != std::string_view::npos)
+    {
+        const auto groups = key.substr(suffix + 1);
+        if(groups.empty() || groups[0] != 'g' ||
+           !Number(groups.substr(1), parsed.group_count))
+            return false;
+        key = key.substr(0, suffix);
+    }
+
+    std::array<std::string_view, max_parts> parts;
+    std::size_t count = 0;
+
+    for(std::size_t start = 0; start <= key.size(); ++count)
+    {
+        auto end = key.find('-', start);
+        if(end == std::string_view::npos)
+            end = key.size();
+        if(count == parts.size())
+            return false;
+
+        parts[count] = key.substr(start, end - start);
+        start        = end + 1;
+    }
+
+    parsed.direction = parts[count - 1];
+
+    if(parsed.direction == "Trn" || parsed.direction == "Inf" || parsed.direction == "Bwd")
+        return ParseBatchNorm(parts, count, parsed);
+
+    // The weights sizes are the 4th part of 2D keys and the 5th of 3D ones.
+    parsed.spatial_dims = count > 4 && parts[3].find('x') == std::string_view::npos ? 3 : 2;
+
+    const auto dims  = static_cast<std::size_t>(parsed.spatial_dims);
+    const auto first = 3 - dims;
+    const auto tail  = count - (2 * dims + 8);
+
+    if(tail != 3 && tail != 5)
+        return false;
+
+    auto ok = Number(parts[0], parsed.in_channels) &&
+              Number(parts[dims + 2], parsed.out_channels) &&
+              Number(parts[2 * dims + 3], parsed.batch_size) &&
+              Number(parts[2 * dims + 7], parsed.bias) &&
+              Dims(parts[dims + 1], first, parsed.filter) &&
+              Dims(parts[2 * dims + 4], first, parsed.pad) &&
+              Dims(parts[2 * dims + 5], first, parsed.stride) &&
+              Dims(parts[2 * dims + 6], first, parsed.dilation);
+
+    for(auto i = first; ok && i < 3; ++i)
+        ok = Number(parts[1 + i - first], parsed.in[i]) &&
+             Number(parts[dims + 3 + i - first], parsed.out[i]);
+
+    const auto layouts = 2 * dims + 8;
+    parsed.layouts     = {parts[layouts], parts[layouts], parts[layouts]};
+    if(tail == 5)
+        parsed.layouts = {parts[layouts], parts[layouts + 1], parts[layouts + 2]};
+
+    parsed.data_type = parts[count - 2];
+    return ok;
+}
+
+std::string ConvKey::Format() const
+{
+    const auto first = static_cast<std::size_t>(3 - spatial_dims);
+    std::string key;
+    key.reserve(96);
+
+    const auto number = [&](int value, const char* separator) {
+        std::array<char, 16> digits = {};
+        const auto end = std::to_chars(digits.data(), digits.data() + digits.size(), value).ptr;
+        key.append(digits.data(), end).append(separator);
+    };
+    const auto sizes = [&](const Sizes& values, const char* separator) {
+        for(auto i = first; i < values.size(); ++i)
+            number(values[i], i + 1 < values.size() ? separator : "-");
+    };
+
+    number(in_channels, "-");
+    sizes(in, "-");
+    sizes(filter, "x");
+    number(out_channels, "-");
+    sizes(out, "-");
+    number(batch_size, "-");
+    sizes(pad, "x");
+    sizes(stride, "x");
+    sizes(dilation, "x");
+    number(bias, "-");
+
+    key.append(layouts[0]).append("-");
+    if(layouts[1] != layouts[0] || layouts[2] != layouts[0])
+        key.append(layouts[1]).append("-").append(layouts[2]).append("-");
+    key.append(data_type).append("-").append(direction);
+
+    if(group_count != 1)
+    {
+        key.append("_g");
+        number(group_count, "");
+    }
+
+    return key;
+}
+
+bool ConvKey::ParseBatchNorm(const std::array<std::string_view, max_parts>& parts,
+                             std::size_t count,
+                             ConvKey& parsed)
+{
+    if(count != 8 && count != 9)
+        return false;
+
+    parsed.kind         = Kinds::BatchNorm;
+    parsed.spatial_dims = count == 9 ? 3 : 2;
+    parsed.layouts      = {parts[count - 3], parts[count - 3], parts[count - 3]};
+    parsed.data_type    = parts[count - 2];
+
+    const auto first = static_cast<std::size_t>(3 - parsed.spatial_dims);
+    auto ok = Number(parts[0], parsed.batch_size) && Number(parts[1], parsed.in_channels) &&
+              Number(parts[count - 4], parsed.mode);
+
+    for(auto i = first; ok && i < 3; ++i)
+        ok = Number(parts[2 + i - first], parsed.in[i]);
+
+    parsed.out          = parsed.in;
+    parsed.out_channels = parsed.in_channels;
+    return ok;
+}
+
+bool ConvKey::Number(std::string_view text, int& number)
+{
+    const auto* end   = text.data() + text.size();
+    const auto result = std::from_chars(text.data(), end, number);
+    return result.ec == std::errc{} && result.ptr == end;
+}
+
+bool ConvKey::Dims(std::string_view text, std::size_t first, Sizes& sizes)
+{
+    for(auto i = first; i < sizes.size(); ++i)
+    {
+        const auto end = i + 1 < sizes.size() ? text.find('x') : text.size();
+        if(end == std::string_view::npos || !Number(text.substr(0, end), sizes[i]))
+            return false;
+        text = text.substr(std::min(end + 1, text.size()));
+    }
+
+    return true;
+}
+
+std::string OptionsFromKey(std::string_view key, Diagnostics& log)
+{
+    std::string options;
+    ConvKey parsed;
+
+    if(ConvKey::Parse(key, parsed))
+        options = DriverOptions(parsed);
+
+    if(options.empty())
+        log.Report(Diagnostics::IllFormedRecord, "W\tNo driver options for the key: ", key);
+
+    return options;
+}
+
+std::string DriverOptions(const ConvKey& key)
+{
+    std::string options;
+    options.reserve(128);
+
+    const auto add = [&](const char* flag, int value) {
+        std::array<char, 16> digits = {};
+        const auto end = std::to_chars(digits.data(), digits.data() + digits.size(), value).ptr;
+        options.append(flag).append(digits.data(), end);
+    };
+
+    std::string_view main_arg;
+    if(key.data_type == "FP16")
+        main_arg = "fp16";
+    else if(key.data_type == "BF16")
+        main_arg = "bfp16";
+    else if(key.data_type != "FP32")
+        return {};
+
+    if(key.kind == ConvKey::Kinds::BatchNorm)
+    {
+        options.append("bnorm").append(main_arg);
+        add(" -n ", key.batch_size);
+        add(" -c ", key.in_channels);
+        add(" -H ", key.in[1]);
+        add(" -W ", key.in[2]);
+        if(key.spatial_dims == 3)
+            add(" -D ", key.in[0]);
+        add(" -m ", key.mode);
+        add(" -F ", key.direction == "Trn" ? 1 : key.direction == "Inf" ? 2 : 0);
+        add(" -b ", key.direction == "Bwd" ? 1 : 0);
+        return options;
+    }
+
+    options.append(main_arg);
+    add(" -c ", key.in_channels);
+    add(" -H ", key.in[1]);
+    add(" -W ", key.in[2]);
+    add(" -x ", key.filter[2]);
+    add(" -y ", key.filter[1]);
+    add(" -k ", key.out_channels);
+    add(" -n ", key.batch_size);
+    add(" -p ", key.pad[1]);
+    add(" -q ", key.pad[2]);
+    add(" -u ", key.stride[2]);
+    add(" -v ", key.stride[1]);
+    add(" -l ", key.dilation[2]);
+    add(" -j ", key.dilation[1]);
+    add(" -b ", key.bias);
+
+    if(key.group_count != 1)
+        add(" -g ", key.group_count);
+
+    if(key.spatial_dims == 3)
+    {
+        add(" --spatial_dim ", 3);
+        add(" --in_d ", key.in[0]);
+        add(" --fil_d ", key.filter[0]);
+        add(" --pad_d ", key.pad[0]);
+        add(" --conv_stride_d ", key.stride[0]);
+        add(" --dilation_d ", key.dilation[0]);
+    }
+
+    const auto is_default = [](std::string_view layout) {
+        return layout == "NCHW" || layout == "NCDHW";
+    };
+
+    if(!is_default(key.layouts[0]) || !is_default(key.layouts[1]) ||
+       !is_default(key.layouts[2]))
+    {
+        options.append(" --in_layout ").append(key.layouts[0]);
+        options.append(" --fil_layout ").append(key.layouts[1]);
+        options.append(" --out_layout ").append(key.layouts[2]);
+    }
+
+    add(" -F ", key.direction == "F" ? 1 : 0);
+    return options;
+}
+
+namespace pdbmerge {
+
+std::string DriverOptions(std::string_view key)
+{
+    Diagnostics log;
+    return OptionsFromKey(key, log);
+}
+
+} // namespace pdbmerge
@@ -0,0 +1,100 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_KEY_H_
+#define GUARD_PDBMERGE_KEY_H_
+
+#include "pdbmerge_context.h"
+
+#include <array>
+#include <string>
+#include <string_view>
+
+/// Problem of a text db key, parsed in one pass. Text fields are views into the key. Conv keys
+/// are serialized by MIOpen as
+///     c-[d-]h-w-[fd x]fh x fw-k-[od-]oh-ow-n-pads-strides-dilations-bias-layout[s]-type-direction
+/// with one layout for all tensors or in, weights and out layouts, and an optional _g<groups>
+/// suffix. In and out are as serialized, that is swapped for backward directions. Batchnorm
+/// keys are n-c-[d-]h-w-mode-layout-type-direction with a Trn, Inf or Bwd direction.
+struct ConvKey
+{
+    enum class Kinds
+    {
+        Conv,
+        BatchNorm,
+    };
+
+    /// Sizes are depth, height, width. 2D problems have a depth of 1 and no depth padding.
+    using Sizes = std::array<int, 3>;
+
+    Kinds kind       = Kinds::Conv;
+    int spatial_dims = 2;
+    int in_channels  = 0;
+    int out_channels = 0;
+    int batch_size   = 0;
+    int bias         = 0;
+    int group_count  = 1;
+    /// Batchnorm mode.
+    int mode = 0;
+    Sizes in       = {1, 1, 1};
+    Sizes filter   = {1, 1, 1};
+    Sizes out      = {1, 1, 1};
+    Sizes pad      = {0, 0, 0};
+    Sizes stride   = {1, 1, 1};
+    Sizes dilation = {1, 1, 1};
+    /// In, weights and out layouts.
+    std::array<std::string_view, 3> layouts;
+    std::string_view data_type;
+    std::string_view direction;
+
+    static bool Parse(std::string_view key, ConvKey& parsed);
+
+    /// Conv key as MIOpen serializes it, the inverse of Parse. Layouts are written once if they
+    /// are all the same.
+    std::string Format() const;
+
+    private:
+    /// 3D conv keys with separate layouts have the most parts.
+    static constexpr std::size_t max_parts = 19;
+
+    static bool ParseBatchNorm(const std::array<std::string_view, max_parts>& parts,
+                               std::size_t count,
+                               ConvKey& parsed);
+
+    static bool Number(std::string_view text, int& number);
+
+    /// Reads "h x w" or "d x h x w" into sizes from index first on.
+    static bool Dims(std::string_view text, std::size_t first, Sizes& sizes);
+};
+
+/// Driver options of a config key. Keys that are not configs are reported and have none, the
+/// merge goes on without their commands.
+std::string OptionsFromKey(std::string_view key, Diagnostics& log);
+
+/// Driver arguments of a parsed key. Conv arguments are preceded by fp16 or bfp16 for these
+/// data types, batchnorm ones by the whole bnorm command. Empty for unknown data types.
+std::string DriverOptions(const ConvKey& key);
+
+#endif // GUARD_PDBMERGE_KEY_H_
@@ -0,0 +1,508 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_master.h"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+std::uint64_t DbIndex::Hash(std::string_view key)
+{
+    // FNV-1a, the index has to read back the same on every platform.
+    auto hash = std::uint64_t{14695981039346656037ULL};
+
+    for(const auto c : key)
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ULL;
+
+    return hash;
+}
+
+DbIndex::DbIndex(const bpath& db_, int db_fd) : db(db_), path(db_.string() + ".idx")
+{
+    if(!Load(db_fd))
+        Build();
+}
+
+void DbIndex::Find(std::uint64_t hash, std::vector<Entry>& found) const
+{
+    found.clear();
+
+    const auto* begin = sorted.empty() ? mapped_entries : sorted.data();
+    const auto* end   = begin + sorted_count;
+    const auto* first = std::lower_bound(begin, end, hash, [](const Entry& entry, auto value) {
+        return entry.hash < value;
+    });
+
+    for(; first != end && first->hash == hash; ++first)
+        found.push_back(*first);
+
+    for(const auto& entry : added)
+        if(entry.hash == hash)
+            found.push_back(entry);
+}
+
+std::int64_t DbIndex::ModificationTime(const struct stat& info)
+{
+    return static_cast<std::int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+}
+
+bool DbIndex::Read(int fd, void* data, std::size_t size, std::size_t offset)
+{
+    return static_cast<std::size_t>(pread(fd, data, size, static_cast<off_t>(offset))) == size;
+}
+
+bool DbIndex::Write(int fd, const void* data, std::size_t size, std::size_t offset)
+{
+    return static_cast<std::size_t>(pwrite(fd, data, size, static_cast<off_t>(offset))) == size;
+}
+
+bool DbIndex::Save(int db_fd)
+{
+    if(!rebuilt && added.size() > sorted_count / 4 + rebuild_slack)
+    {
+        mapped.reset();
+        Build();
+    }
+
+    struct stat info;
+    if(fstat(db_fd, &info) != 0)
+        return false;
+
+    Header header{};
+    std::copy(magic.begin(), magic.end(), header.magic);
+    header.db_size  = static_cast<std::uint64_t>(info.st_size);
+    header.db_mtime = ModificationTime(info);
+    header.lines    = lines;
+
+    if(rebuilt)
+    {
+        sorted.insert(sorted.end(), added.begin(), added.end());
+        std::sort(sorted.begin(), sorted.end(), [](const Entry& left, const Entry& right) {
+            return std::tie(left.hash, left.offset) < std::tie(right.hash, right.offset);
+        });
+        header.sorted = header.total = sorted.size();
+
+        // The old index stays valid for the old db until the new one replaces it.
+        const auto temp = path.string() + ".tmp";
+        const auto fd   = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666); // NOLINT
+        auto written    = fd >= 0 && Write(fd, &header, sizeof(header), 0) &&
+                       Write(fd, sorted.data(), sorted.size() * sizeof(Entry), sizeof(header));
+
+        if(fd >= 0)
+            written &= close(fd) == 0;
+
+        return written && rename(temp.c_str(), path.c_str()) == 0;
+    }
+
+    header.sorted = sorted_count;
+    header.total  = sorted_count + added.size();
+
+    const auto fd     = open(path.c_str(), O_WRONLY);
+    const auto tail   = sizeof(Header) + (sorted_count + loaded_added) * sizeof(Entry);
+    const auto* begin = added.data() + loaded_added;
+    auto written      = fd >= 0 &&
+                   Write(fd, begin, (added.size() - loaded_added) * sizeof(Entry), tail) &&
+                   Write(fd, &header, sizeof(header), 0);
+
+    if(fd >= 0)
+        written &= close(fd) == 0;
+
+    return written;
+}
+
+bool DbIndex::Load(int db_fd)
+{
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        return false;
+
+    Header header{};
+    struct stat info;
+    auto valid = fstat(db_fd, &info) == 0 && Read(fd, &header, sizeof(header), 0) &&
+                 std::equal(magic.begin(), magic.end(), header.magic) &&
+                 header.db_size == static_cast<std::uint64_t>(info.st_size) &&
+                 header.db_mtime == ModificationTime(info) && header.sorted <= header.total;
+
+    if(valid)
+    {
+        added.resize(header.total - header.sorted);
+        valid = Read(fd,
+                     added.data(),
+                     added.size() * sizeof(Entry),
+                     sizeof(Header) + header.sorted * sizeof(Entry));
+    }
+
+    close(fd);
+
+    if(!valid)
+    {
+        added.clear();
+        return false;
+    }
+
+    mapped = std::make_unique<MappedFile>(path.string(), false);
+    if(mapped->View().size() < sizeof(Header) + header.total * sizeof(Entry))
+        return false;
+
+    // NOLINTNEXTLINE (cppcoreguidelines-pro-type-reinterpret-cast)
+    mapped_entries = reinterpret_cast<const Entry*>(mapped->View().data() + sizeof(Header));
+    sorted_count   = header.sorted;
+    loaded_added   = added.size();
+    lines          = static_cast<std::uint32_t>(header.lines);
+    return true;
+}
+
+void DbIndex::Build()
+{
+    const MappedFile file(db.string());
+    const auto data = file.View();
+
+    sorted.clear();
+    added.clear();
+    loaded_added = 0;
+    lines        = 0;
+
+    for(std::size_t start = 0; start < data.size();)
+    {
+        const auto line = SplitLine(data.substr(start));
+        ++lines;
+
+        if(line.equals != std::string_view::npos && line.equals != 0)
+            sorted.push_back({Hash(line.text.substr(0, line.equals)),
+                              start,
+                              static_cast<std::uint32_t>(line.text.size()),
+                              lines});
+
+        start += line.text.size() + 1;
+    }
+
+    std::sort(sorted.begin(), sorted.end(), [](const Entry& left, const Entry& right) {
+        return std::tie(left.hash, left.offset) < std::tie(right.hash, right.offset);
+    });
+
+    mapped_entries = nullptr;
+    sorted_count   = sorted.size();
+    rebuilt        = true;
+}
+
+MasterDb::MasterDb(const bpath& path_, bool write_behind)
+    : path(path_),
+      journal(path_.string() + ".journal"),
+      source(SourceFiles::AddFirst(path_)),
+      fd(Open(path_, journal)),
+      index(path_, fd),
+      appended(journal.string() + ".tmp", false, write_behind)
+{
+    struct stat info;
+    if(fd < 0 || fstat(fd, &info) != 0)
+    {
+        failed = true;
+        return;
+    }
+
+    size = base = static_cast<std::uint64_t>(info.st_size);
+    char last   = '\n';
+    if(size != 0 && pread(fd, &last, 1, static_cast<off_t>(size - 1)) != 1)
+        failed = true;
+    ends_with_newline = last == '\n';
+}
+
+bool MasterDb::Find(std::string_view key, std::vector<FileData>& records)
+{
+    found_key.assign(key.data(), key.size());
+    index.Find(DbIndex::Hash(key), candidates);
+    found.clear();
+    records.clear();
+
+    for(const auto& entry : candidates)
+    {
+        const auto line = ReadLine(entry);
+
+        if(line.size() > key.size() && line[key.size()] == '=' &&
+           line.compare(0, key.size(), key) == 0)
+            found.push_back(entry);
+    }
+
+    std::sort(found.begin(), found.end(), [](const auto& left, const auto& right) {
+        return left.offset < right.offset;
+    });
+
+    for(const auto& entry : found)
+    {
+        auto value = std::string_view{ReadLine(entry)}.substr(key.size() + 1);
+        if(!value.empty() && value.back() == '\r')
+            value.remove_suffix(1);
+        if(!value.empty())
+            records.push_back({{source, entry.line}, Arena::Local().Store(value)});
+    }
+
+    return !records.empty();
+}
+
+void MasterDb::Write(std::string_view key, std::string_view value)
+{
+    line.assign(key.data(), key.size()).append("=").append(value.data(), value.size());
+
+    if(key != found_key || found.empty())
+    {
+        Append(key);
+        return;
+    }
+
+    const auto& first = found.front();
+
+    if(ReadLine(first) != line)
+    {
+        if(line.size() <= first.length)
+        {
+            line.append(first.length - line.size(), '\n');
+            WriteAt(line, first.offset);
+        }
+        else
+        {
+            Blank(first);
+            Append(key);
+        }
+    }
+
+    for(auto i = 1u; i < found.size(); ++i)
+        Blank(found[i]);
+
+    found.clear();
+}
+
+void MasterDb::Drop(std::string_view key)
+{
+    if(key != found_key)
+        return;
+
+    for(const auto& entry : found)
+        Blank(entry);
+
+    found.clear();
+}
+
+bool MasterDb::Close()
+{
+    const auto temp = appended.Path();
+    failed |= !appended.Close();
+
+    if(fd < 0)
+    {
+        // Nothing was appended if the master could not be opened, or it was closed before.
+        boost::system::error_code error;
+        boost::filesystem::remove(temp, error);
+        return !failed;
+    }
+
+    if(!failed)
+        failed = !CommitJournal(temp) || !Replay(fd, journal);
+
+    // The journal is applied by the next run if it was committed, otherwise it is dropped.
+    boost::system::error_code error;
+    boost::filesystem::remove(temp, error);
+
+    if(!failed)
+    {
+        index.SetLines(lines_appended == 0 ? index.Lines() : last_line);
+        failed |= !index.Save(fd);
+    }
+
+    failed |= close(fd) != 0;
+    fd = -1;
+    return !failed;
+}
+
+int MasterDb::Open(const bpath& path, const bpath& journal)
+{
+    // NOLINTNEXTLINE (hicpp-signed-bitwise, hicpp-vararg)
+    const auto fd = open(path.c_str(), O_RDWR | O_CREAT, 0666);
+
+    if(fd >= 0 && !Replay(fd, journal))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+bool MasterDb::Replay(int fd, const bpath& journal)
+{
+    const auto journal_fd = open(journal.c_str(), O_RDONLY);
+    if(journal_fd < 0)
+        return errno == ENOENT;
+
+    struct stat info;
+    Trailer trailer{};
+    auto valid = fstat(journal_fd, &info) == 0 &&
+                 static_cast<std::uint64_t>(info.st_size) >= sizeof(Trailer);
+
+    const auto end = valid ? static_cast<std::uint64_t>(info.st_size) - sizeof(Trailer) : 0;
+    auto offset    = std::uint64_t{0};
+
+    valid = valid && DbIndex::Read(journal_fd, &trailer, sizeof(trailer), end) &&
+            std::equal(magic.begin(), magic.end(), trailer.magic);
+    std::vector<char> data(1 << 20);
+
+    // Appended lines first, they are the same on every replay, so the size is set with them.
+    while(valid && offset < trailer.appended)
+    {
+        const auto count = std::min<std::uint64_t>(data.size(), trailer.appended - offset);
+        valid            = offset + count <= end &&
+                DbIndex::Read(journal_fd, data.data(), count, offset) &&
+                DbIndex::Write(fd, data.data(), count, trailer.base + offset);
+        offset += count;
+    }
+
+    valid = valid && ftruncate(fd, static_cast<off_t>(trailer.base + trailer.appended)) == 0;
+
+    for(auto i = std::uint64_t{0}; valid && i < trailer.patches; ++i)
+    {
+        Patch patch{};
+        valid = offset + sizeof(Patch) <= end &&
+                DbIndex::Read(journal_fd, &patch, sizeof(patch), offset) &&
+                patch.length <= end - offset - sizeof(Patch) &&
+                patch.offset + patch.length <= trailer.base;
+        offset += sizeof(Patch);
+
+        if(valid)
+        {
+            data.resize(std::max<std::size_t>(data.size(), patch.length));
+            valid = DbIndex::Read(journal_fd, data.data(), patch.length, offset) &&
+                    DbIndex::Write(fd, data.data(), patch.length, patch.offset);
+            offset += patch.length;
+        }
+    }
+
+    close(journal_fd);
+
+    if(!valid || fsync(fd) != 0)
+        return false;
+
+    boost::system::error_code error;
+    boost::filesystem::remove(journal, error);
+    return !error;
+}
+
+bool MasterDb::CommitJournal(const bpath& temp)
+{
+    const auto journal_fd = open(temp.c_str(), O_WRONLY);
+    if(journal_fd < 0)
+        return false;
+
+    auto offset  = size - base;
+    auto written = true;
+
+    for(const auto& patch : patches)
+    {
+        const Patch header{patch.first, patch.second.size()};
+        written = written && DbIndex::Write(journal_fd, &header, sizeof(header), offset);
+        offset += sizeof(header);
+        written = written &&
+                  DbIndex::Write(journal_fd, patch.second.data(), header.length, offset);
+        offset += header.length;
+    }
+
+    Trailer trailer{};
+    std::copy(magic.begin(), magic.end(), trailer.magic);
+    trailer.base     = base;
+    trailer.appended = size - base;
+    trailer.patches  = patches.size();
+
+    written = written && DbIndex::Write(journal_fd, &trailer, sizeof(trailer), offset) &&
+              fsync(journal_fd) == 0;
+    written &= close(journal_fd) == 0;
+
+    if(!written || rename(temp.c_str(), journal.c_str()) != 0)
+        return false;
+
+    // The rename itself is only durable once the directory is synced.
+    auto directory = journal.parent_path();
+    if(directory.empty())
+        directory = ".";
+
+    const auto directory_fd = open(directory.c_str(), O_RDONLY);
+    if(directory_fd >= 0)
+    {
+        fsync(directory_fd);
+        close(directory_fd);
+    }
+
+    patches.clear();
+    return true;
+}
+
+const std::string& MasterDb::ReadLine(const DbIndex::Entry& entry)
+{
+    buffer.resize(entry.length);
+
+    if(entry.offset + entry.length > base ||
+       pread(fd, &buffer[0], entry.length, static_cast<off_t>(entry.offset)) !=
+           static_cast<ssize_t>(entry.length))
+        buffer.clear();
+
+    buffer.resize(std::min(buffer.find('\n'), buffer.size()));
+    return buffer;
+}
+
+void MasterDb::Append(std::string_view key)
+{
+    if(!ends_with_newline)
+    {
+        appended.Stream() << '\n';
+        ++size;
+        ends_with_newline = true;
+    }
+
+    if(lines_appended++ == 0)
+        last_line = index.Lines();
+
+    index.Add({DbIndex::Hash(key), size, static_cast<std::uint32_t>(line.size()), ++last_line});
+    appended.Stream() << line << '\n';
+    size += line.size() + 1;
+}
+
+void MasterDb::Blank(const DbIndex::Entry& entry)
+{
+    WriteAt(std::string(entry.length, '\n'), entry.offset);
+}
+
+void MasterDb::WriteAt(const std::string& data, std::uint64_t offset)
+{
+    patches.emplace_back(offset, data);
+}
@@ -0,0 +1,209 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_MASTER_H_
+#define GUARD_PDBMERGE_MASTER_H_
+
+#include "pdbmerge_io.h"
+#include "pdbmerge_records.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <sys/stat.h>
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Sidecar index of a text db, kept next to it as <db>.idx. Entries map the hash of a key to the
+/// line holding it. The sorted part of the file is binary searched in place, entries added since
+/// the index was built follow it unsorted and are read up front. The header remembers the size
+/// and modification time of the db, an index that does not match them is rebuilt.
+class DbIndex
+{
+    public:
+    struct Entry
+    {
+        std::uint64_t hash;
+        std::uint64_t offset;
+        /// Length of the line when the entry was made, lines rewritten in place can only shrink.
+        std::uint32_t length;
+        std::uint32_t line;
+    };
+
+    static std::uint64_t Hash(std::string_view key);
+
+    DbIndex(const bpath& db_, int db_fd);
+
+    /// Entries of the hash in no particular order, some of them can point to lines which no
+    /// longer hold a record.
+    void Find(std::uint64_t hash, std::vector<Entry>& found) const;
+
+    void Add(const Entry& entry) { added.push_back(entry); }
+
+    std::uint32_t Lines() const { return lines; }
+    void SetLines(std::uint32_t lines_) { lines = lines_; }
+
+    /// Nanoseconds since the epoch, which tell apart versions of a file written within a second.
+    static std::int64_t ModificationTime(const struct stat& info);
+
+    /// Reads or writes all of data at the offset of the file, also used for the master journal.
+    static bool Read(int fd, void* data, std::size_t size, std::size_t offset);
+
+    static bool Write(int fd, const void* data, std::size_t size, std::size_t offset);
+
+    /// Writes the entries added since loading. The whole index is written instead if it was
+    /// rebuilt, or rebuilt first if too many of its entries are unsorted.
+    bool Save(int db_fd);
+
+    private:
+    static constexpr std::array<char, 8> magic = {'P', 'D', 'B', 'I', 'D', 'X', '1', '\0'};
+    static constexpr std::size_t rebuild_slack = 4096;
+
+    struct Header
+    {
+        char magic[8]; // NOLINT (modernize-avoid-c-arrays)
+        std::uint64_t db_size;
+        std::int64_t db_mtime;
+        std::uint64_t sorted;
+        std::uint64_t total;
+        std::uint64_t lines;
+    };
+
+    bpath db;
+    bpath path;
+    std::unique_ptr<MappedFile> mapped;
+    const Entry* mapped_entries = nullptr;
+    std::size_t sorted_count    = 0;
+    /// Only filled when the index is rebuilt, otherwise the sorted entries are mapped.
+    std::vector<Entry> sorted;
+    std::vector<Entry> added;
+    std::size_t loaded_added = 0;
+    std::uint32_t lines      = 0;
+    bool rebuilt             = false;
+
+    bool Load(int db_fd);
+
+    /// Indexes every record of the db.
+    void Build();
+};
+
+/// A text db merged into in place. Lookups go through its DbIndex, so only the records of keys
+/// found in the sources are read. A record that changes is rewritten in place if it still fits
+/// and padded with empty lines, otherwise the old line is blanked and the record is appended,
+/// as are new keys. Empty lines are skipped by MIOpen and pdbmerge alike, but the master is no
+/// longer sorted.
+///
+/// The master itself is only written on Close(). Appended records and the patches go to the
+/// journal <db>.journal first, which is synced and then applied. A run that stops before the
+/// journal is complete leaves the master as it was, one that stops while applying it leaves the
+/// journal, and the next run opening the master applies it again.
+class MasterDb : public RecordWriter
+{
+    public:
+    MasterDb(const bpath& path_, bool write_behind);
+
+    ~MasterDb() override { Close(); }
+
+    bool IsOpen() const override { return fd >= 0 && !failed && appended.IsOpen(); }
+    const bpath& Path() const override { return path; }
+    const bpath& Journal() const { return journal; }
+
+    /// Reads the records of the key in line order, their values are stored in the Arena. Lines
+    /// of the key without contents are not records, but are replaced all the same.
+    bool Find(std::string_view key, std::vector<FileData>& records);
+
+    void Write(std::string_view key, std::string_view value) override;
+
+    /// Removes the records of the key found last.
+    void Drop(std::string_view key);
+
+    bool Close() override;
+
+    private:
+    static constexpr std::array<char, 8> magic = {'P', 'D', 'B', 'J', 'R', 'N', '1', '\0'};
+
+    /// Ends the journal, after the appended lines and the patches.
+    struct Trailer
+    {
+        char magic[8]; // NOLINT (modernize-avoid-c-arrays)
+        /// Size of the master before the appended lines.
+        std::uint64_t base;
+        std::uint64_t appended;
+        std::uint64_t patches;
+    };
+
+    struct Patch
+    {
+        std::uint64_t offset;
+        std::uint64_t length;
+    };
+
+    bpath path;
+    bpath journal;
+    unsigned int source;
+    int fd;
+    DbIndex index;
+    OutputFile appended;
+    std::uint64_t base         = 0;
+    std::uint64_t size         = 0;
+    bool ends_with_newline     = true;
+    bool failed                = false;
+    std::size_t lines_appended = 0;
+    std::uint32_t last_line    = 0;
+    std::string found_key;
+    std::vector<DbIndex::Entry> candidates;
+    std::vector<DbIndex::Entry> found;
+    std::string line;
+    std::string buffer;
+    /// Rewritten lines and their offsets in the master, written to it once the journal is synced.
+    std::vector<std::pair<std::uint64_t, std::string>> patches;
+
+    /// Opens the master, applying the journal left by a run that did not finish.
+    static int Open(const bpath& path, const bpath& journal);
+
+    /// Applies a complete journal to the master and removes it. A missing journal is fine, an
+    /// incomplete one is never renamed into place.
+    static bool Replay(int fd, const bpath& journal);
+
+    /// Adds the patches to the temporary journal holding the appended lines, syncs it and renames
+    /// it into place, which commits the changes.
+    bool CommitJournal(const bpath& temp);
+
+    /// The line at the entry, up to its end or to the padding after it. Lines appended by this
+    /// run are not in the master yet and read as empty, they hold keys already written.
+    const std::string& ReadLine(const DbIndex::Entry& entry);
+
+    void Append(std::string_view key);
+
+    void Blank(const DbIndex::Entry& entry);
+
+    void WriteAt(const std::string& data, std::uint64_t offset);
+};
+
+#endif // GUARD_PDBMERGE_MASTER_H_
@@ -0,0 +1,338 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_MERGER_H_
+#define GUARD_PDBMERGE_MERGER_H_
+
+#include "pdbmerge_context.h"
+#include "pdbmerge_internal.h"
+#include "pdbmerge_io.h"
+#include "pdbmerge_master.h"
+#include "pdbmerge_policies.h"
+#include "pdbmerge_records.h"
+#include "pdbmerge_sources.h"
+#include "pdbmerge_sqlite.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <sqlite3.h>
+
+#include <csignal>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class DbMerger
+{
+    public:
+    DbMerger()                           = default;
+    DbMerger(const DbMerger&)            = delete;
+    DbMerger& operator=(const DbMerger&) = delete;
+
+    ~DbMerger();
+
+    /// Runs the tool and exits with its exit code. Merged records are not destroyed on the way,
+    /// std::exit does not run destructors.
+    [[noreturn]] void Execute(int nargs, char** cargs);
+
+    /// Merges as the command line tells and returns the exit code: 0 on success, 1 if some
+    /// conflicts were not resolved. Throws MergeError on errors.
+    int Run(int nargs, char** cargs);
+
+    private:
+    friend class pdbmerge::Merger;
+
+    ResolveModes resolve_mode = ResolveModes::Off;
+    OutputFormats format      = OutputFormats::Auto;
+    bool use_mmap             = false;
+    bool write_behind         = false;
+    bool sorted_inputs        = false;
+    bool kernel_dbs           = false;
+    bool find_db              = false;
+    bool diff                 = false;
+    bool json_report          = false;
+    bool concat               = false;
+    unsigned int jobs         = 1;
+    unsigned int prefetch     = 4;
+    unsigned int checkpoint   = 60;
+    std::size_t max_memory    = 0;
+    bpath temp_dir;
+    bpath watch_dir;
+    std::vector<bpath> priority_paths;
+    bpath times_path;
+    KeyShard shard;
+    bpath shard_bounds_path;
+    RecordLimits limits;
+    /// Set for the modes resolving conflicts item by item.
+    std::unique_ptr<ResolvePolicy> policy;
+    std::unique_ptr<Prefetcher> prefetcher;
+    std::shared_mutex parsing;
+    std::vector<bpath> runs;
+    bpath destination_path;
+    bpath master_path;
+    bpath conflicts_path;
+    bpath conflict_commands_path;
+    RecordTable data;
+    bpath commands_path;
+
+    [[noreturn]] static void ExitWithError(const std::string& message, int exit_code = 1);
+
+    /// Default path of a side output next to the output, compressed the same way.
+    static bpath SidePath(const bpath& path, const char* suffix);
+
+    /// Parses a decimal number spanning all of text, false if there is none or it does not fit.
+    static bool ParseNumber(std::string_view text, std::size_t& number);
+
+    /// Value of an argument taking a number up to high, zero included.
+    static std::size_t NumberArgument(const std::string& arg,
+                                      std::string_view value,
+                                      std::size_t high = std::numeric_limits<std::size_t>::max());
+
+    /// Value of an argument taking a positive number up to high, which may not fit an int.
+    static std::size_t PositiveArgument(const std::string& arg,
+                                        std::string_view value,
+                                        std::size_t high = std::numeric_limits<std::size_t>::max());
+
+    [[noreturn]] static void ExitWithHelp();
+
+    void ParseArguments(int nargs, char** cargs);
+
+    void ReadShardBounds();
+
+    /// Parses sources into data on a pool of jobs threads.
+    void ParseFilesConcurrently();
+
+    /// Runs action for every source on a pool of jobs threads. Warnings are printed in source
+    /// order, as soon as each source is done. Once an action fails, the sources not started yet
+    /// are skipped and the error of the first failed source is rethrown.
+    void ForEachSourceConcurrently(const std::function<void(unsigned int, Diagnostics&)>& action);
+
+    void ParseFile(unsigned int source, Diagnostics& log);
+
+    /// Reads a whole SQLite perf db source. Every config becomes one record at the position
+    /// (source, config id), with the solvers of the config as its items.
+    void ParseSqlite(unsigned int source, Diagnostics& log);
+
+    /// Adds the records of a binary perf db at the positions (source, record number).
+    void ParseBinary(unsigned int source, Diagnostics& log);
+
+    static constexpr int spill_check_interval = 1024;
+    /// Keys emitted by a job at a time with --jobs.
+    static constexpr std::size_t emit_chunk_size = 4096;
+
+    std::size_t MemoryUsed() const;
+
+    void Spill();
+
+    /// Writes data sorted by key to a new run file and empties it.
+    void SpillRun();
+
+    void ParseLine(const FilePos& pos, const TextLine& line, Diagnostics& log);
+
+    void AddRecord(const FilePos& pos,
+                   std::string_view key,
+                   std::string_view value,
+                   Diagnostics& log);
+
+    std::unique_ptr<OutputFile> OpenOutput(const bpath& path, bool append) const;
+
+    static std::ostream* StreamOf(const std::unique_ptr<OutputFile>& file);
+
+    /// Without --format, merged records go to an SQLite perf db if the output path ends with .db
+    /// and to a binary perf db if it ends with .pdbx.
+    std::unique_ptr<RecordWriter> OpenRecords(const bpath& path) const;
+
+    struct Outputs
+    {
+        std::unique_ptr<RecordWriter> file;
+        /// Set with --master, file writes to it.
+        MasterDb* master = nullptr;
+        std::unique_ptr<OutputFile> commands;
+        std::unique_ptr<OutputFile> options;
+        std::unique_ptr<OutputFile> conflicts;
+    };
+
+    Outputs OpenOutputs() const;
+
+    /// Writes everything buffered, returns the exit code.
+    static int Finish(Outputs& outputs, int exit_code);
+
+    static void Close(Outputs& outputs);
+
+    static void WriteStats();
+
+    /// Where a merged record and everything about it goes.
+    struct Sinks
+    {
+        RecordWriter* file;
+        std::ostream* commands;
+        std::ostream* options;
+        std::ostream* conflicts;
+        Diagnostics& log;
+    };
+
+    static Sinks SinksOf(const Outputs& outputs, Diagnostics& log = Diagnostics::Main());
+
+    /// Writes a merged record and its driver command. Returns false on an unresolved conflict.
+    bool Emit(const Outputs& outputs,
+              std::string_view key,
+              const Record& record,
+              Diagnostics& log = Diagnostics::Main()) const;
+
+    /// Records of the master come before everything read from the sources, as if it was the
+    /// first one. Master records of a key without a merged record are removed.
+    bool EmitToMaster(const Outputs& outputs, std::string_view key, const Record& record) const;
+
+    bool EmitRecord(const Sinks& sinks, std::string_view key, const Record& record) const;
+
+    /// Every resolve mode merges the repeats of a value into its items sorted by id, the same as
+    /// a conflict of them would, unless an id is met twice in the value. Such values are merged
+    /// as a conflict.
+    bool EmitRepeated(const Sinks& sinks, std::string_view key, const UniqueValue& value) const;
+
+    int Process() const;
+
+    /// Writes the records merged so far to hidden files next to the outputs and renames them over
+    /// the outputs, so readers see either the previous checkpoint or the new one. Only the last
+    /// checkpoint reports the diagnostics of the merge, the earlier ones would repeat them.
+    int Checkpoint(bool last);
+
+    static inline volatile std::sig_atomic_t stop_requested = 0;
+
+    static void RequestStop(int /*signal*/) { stop_requested = 1; }
+
+    /// Merges the files landing in watch_dir as they come, see --watch. SIGINT and SIGTERM are
+    /// only delivered while waiting for files, so a file is either merged or not when they stop
+    /// the run.
+    int Watch();
+
+    /// Records of a range of keys emitted into memory, to be written out in key order.
+    struct EmittedChunk
+    {
+        BufferWriter* records = nullptr;
+        std::unique_ptr<RecordWriter> file;
+        std::ostringstream commands;
+        std::ostringstream options;
+        std::ostringstream conflicts;
+        Diagnostics log;
+        std::uint64_t keys             = 0;
+        std::uint64_t conflicting_keys = 0;
+        std::uint64_t identical_keys   = 0;
+        bool unresolved                = false;
+        std::exception_ptr error;
+    };
+
+    std::unique_ptr<EmittedChunk> EmitChunk(const Outputs& outputs,
+                                            const std::vector<const RecordTable::Entry*>& sorted,
+                                            std::size_t chunk) const;
+
+    static void Append(const std::unique_ptr<OutputFile>& file, const std::ostringstream& buffer);
+
+    /// Emits chunks of the sorted records on jobs threads and writes them out in key order, so
+    /// the outputs and messages are the same as when records are emitted one by one. Only a few
+    /// chunks per job wait to be written at a time.
+    int EmitConcurrently(const Outputs& outputs,
+                         const std::vector<const RecordTable::Entry*>& sorted) const;
+
+    /// K-way merge of sorted sources. Records of a key are combined in (source, line) order, the
+    /// same as ParseLine would, and written out before the next key is read.
+    int MergeSorted() const;
+
+    /// Walks the two sorted sources side by side and reports how the second one differs from
+    /// the first. Returns 0 if they are the same and 1 otherwise.
+    int Diff() const;
+
+    /// Joins the sorted outputs of shards into one sorted db, as streams. A key is found in one
+    /// shard at most, so records are copied as they are.
+    int Concat() const;
+
+    /// K-way merge of the spilled runs, they are removed once merged.
+    int MergeRuns() const;
+
+    struct KernelRow
+    {
+        /// Points into an Arena.
+        std::string_view name;
+        std::string_view args;
+        sqlite3_int64 row;
+    };
+
+    struct KernelId
+    {
+        std::string_view name;
+        std::string_view args;
+
+        bool operator==(const KernelId& other) const
+        {
+            return name == other.name && args == other.args;
+        }
+    };
+
+    struct KernelIdHash
+    {
+        std::size_t operator()(const KernelId& id) const
+        {
+            const auto name = std::hash<std::string_view>{}(id.name);
+            return name ^ (std::hash<std::string_view>{}(id.args) + 0x9e3779b9 + (name << 6) +
+                           (name >> 2));
+        }
+    };
+
+    struct KernelLocation
+    {
+        unsigned int source;
+        sqlite3_int64 row;
+    };
+
+    static SqliteDb OpenKernelDb(unsigned int source, const char* query, SqliteStatement& rows);
+
+    static void KernelDbError(unsigned int source, sqlite3* db);
+
+    /// Reads the kernel ids of a source, the blobs are not touched.
+    static std::vector<KernelRow> IndexKernelDb(unsigned int source);
+
+    /// Copies the given rows, sorted by rowid, of a source to the output. The blobs are bound
+    /// as they are read, without a copy of their own.
+    static void CopyKernels(unsigned int source,
+                            const std::vector<sqlite3_int64>& copied,
+                            SqliteOutput& output,
+                            sqlite3_stmt* insert);
+
+    /// Merges SQLite kernel dbs. Like merge_db.py, a kernel of a later source replaces the one
+    /// with the same (kernel_name, kernel_args) from earlier sources. Sources are indexed
+    /// concurrently, then the remaining rows are copied in source and row order.
+    void MergeKernelDbs();
+
+    bool ProcessConflict(const Sinks& sinks, std::string_view key, const Conflict& conflict) const;
+};
+
+#endif // GUARD_PDBMERGE_MERGER_H_
@@ -0,0 +1,704 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_merger.h"
+
+#include "pdbmerge_binary.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <charconv>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+bpath DbMerger::SidePath(const bpath& path, const char* suffix)
+{
+    if(CompressionOfName(path) == Compression::None)
+        return path.string() + suffix;
+
+    auto side = path;
+    side.replace_extension();
+    return side.string() + suffix + path.extension().string();
+}
+
+bool DbMerger::ParseNumber(std::string_view text, std::size_t& number)
+{
+    const auto end    = text.data() + text.size();
+    const auto result = std::from_chars(text.data(), end, number);
+    return result.ec == std::errc{} && result.ptr == end;
+}
+
+std::size_t DbMerger::NumberArgument(const std::string& arg,
+                                     std::string_view value,
+                                     std::size_t high)
+{
+    std::size_t count = 0;
+
+    if(!ParseNumber(value, count))
+        ExitWithError("F\tExpected a number after " + arg + " argument.", 2);
+    if(count > high)
+        ExitWithError("F\tExpected at most " + std::to_string(high) + " after " + arg +
+                          " argument.",
+                      2);
+    return count;
+}
+
+std::size_t DbMerger::PositiveArgument(const std::string& arg,
+                                       std::string_view value,
+                                       std::size_t high)
+{
+    std::size_t count = 0;
+
+    if(!ParseNumber(value, count) || count == 0)
+        ExitWithError("F\tExpected a positive number after " + arg + " argument.", 2);
+    return NumberArgument(arg, value, high);
+}
+
+void DbMerger::ExitWithHelp()
+{
+    std::cout << "Usage:" << std::endl;
+    std::cout << "pdbmerge [arguments] [--sources|-s] <paths to files to merge>" << std::endl;
+    std::cout << "\tProcess files. Text, binary and SQLite perf db sources are accepted. "
+                 "SQLite configs are keyed as in text dbs, so they merge with them. Text "
+                 "sources may be gzip or zstd compressed, they are decompressed while parsed."
+              << std::endl;
+    std::cout << "\tIf sources are SQLite kernel dbs (kdb), kernels are merged into --output "
+                 "instead, later sources replace kernels with the same name and arguments."
+              << std::endl;
+    std::cout << "\tA directory stands for the regular files in it sorted by name, except "
+                 "hidden ones. Paths with *, ? or [ are glob patterns. @<path> reads more of "
+                 "these from a list file, one per line, skipping empty lines and # comments."
+              << std::endl;
+    std::cout << "\t- stands for the standard input. It and named pipes are read once, front "
+                 "to back, as text dbs. They are compressed only if named so. Like any other "
+                 "source they are merged in the order given, whenever their contents arrive, "
+                 "and with --jobs they are read concurrently."
+              << std::endl;
+    std::cout << "pdbmerge --diff [arguments] <before> <after>" << std::endl;
+    std::cout << "\tCompare two text dbs sorted by key as streams and report the keys added, "
+                 "removed and changed in <after>, with the solvers added, removed and changed "
+                 "in each changed key. Items are matched by solver id, so their order does not "
+                 "matter. The report is written to --output, or printed if no file provided. "
+                 "Exit code is 0 if the dbs are the same and 1 otherwise."
+              << std::endl;
+    std::cout << "pdbmerge --concat [arguments] <paths to shards>" << std::endl;
+    std::cout << "\tJoin the text outputs of --shard runs, sorted by key, into --output as "
+                 "streams. Records are copied as they are, a key found in more than one shard "
+                 "is an error. Side outputs of shards can be joined by concatenating them."
+              << std::endl;
+    std::cout << "pdbmerge --help|-h" << std::endl;
+    std::cout << "\tPrint this help message." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Arguments:" << std::endl;
+    std::cout << "--output|-o <path>" << std::endl;
+    std::cout << "\tPath to output file. Output will not be saved if no file provided. Paths "
+                 "ending with .db are written as SQLite perf db, which needs conv keys with "
+                 "one layout. Text outputs ending with .gz or .zst are compressed, as are the "
+                 "other outputs named after them and any output path given with these "
+                 "extensions. - writes text to the standard output, other outputs are only "
+                 "saved then if their paths are given, - included."
+              << std::endl;
+    std::cout << "--format|-f <text|bin|sqlite>" << std::endl;
+    std::cout << "\tFormat of the output. Default: bin for paths ending with .pdbx, sqlite for "
+                 ".db, text otherwise. Binary perf dbs keep records sorted by key with their "
+                 "values in place and are read back as sources without parsing."
+              << std::endl;
+    std::cout << "--conflicts|-p <path>" << std::endl;
+    std::cout << "\tPath to conflicts file. Conflicts will not be saved if no file provided."
+              << std::endl;
+    std::cout << "--conflict_commands|-x <path>" << std::endl;
+    std::cout << "\tPath to conflict commands file. Conflict commands will not be saved if no "
+                 "file provided."
+              << std::endl;
+    std::cout << "--commands|-c <path>" << std::endl;
+    std::cout
+        << "\tPath to file to dump all driver commands. Commands will not be dumped if no "
+           "file provided. Automatically sets conflicts and conflict_commands if they are not "
+           "set"
+        << std::endl;
+    std::cout << "--resolve|-r <0|1|auto|off|last|replace|majority|priority|time>" << std::endl;
+    std::cout << "\tMerge conflict resolve mode. Default: off." << std::endl;
+    std::cout << "\t\tAuto/1: Values with more commas is used. If equal amount of commas "
+                 "value met later is used."
+              << std::endl;
+    std::cout << "\t\tLast: Value met last is used, item by item." << std::endl;
+    std::cout << "\t\tReplace: Record met last replaces the earlier records of the key."
+              << std::endl;
+    std::cout << "\t\tMajority: Value met in most sources is used, item by item. If equal "
+                 "amount of sources value met earlier is used."
+              << std::endl;
+    std::cout << "\t\tPriority: Value of the first source in --priority is used, item by "
+                 "item. Sources not listed come after the listed ones, earlier first."
+              << std::endl;
+    std::cout << "\t\tTime: Value with the lowest time in --times is used, item by item. If "
+                 "no value has a time, the value is chosen as by auto."
+              << std::endl;
+    std::cout << "\t\tOff/0: Values with any conflicts are ignored." << std::endl;
+    std::cout << "--priority <path>" << std::endl;
+    std::cout << "\tSource preferred by --resolve priority. Every one given comes after the "
+                 "ones before it."
+              << std::endl;
+    std::cout << "--times <path>" << std::endl;
+    std::cout << "\tMeasured times for --resolve time, a text file with lines of "
+                 "<key>\\t<solver>\\t<parameters>\\t<time>, such as benchmark results "
+                 "exported from Tuna. Empty lines and lines starting with # are skipped. It "
+                 "may be compressed the same as the sources."
+              << std::endl;
+    std::cout << "--master <path>" << std::endl;
+    std::cout << "\tText db to merge the sources into in place, instead of --output. Merged "
+                 "records are the same as if the master was the first source, but only records "
+                 "with keys from the sources are read and written. They are rewritten in place "
+                 "or appended, so the master is no longer sorted. An index of the master is "
+                 "kept in <path>.idx and rebuilt when the master was changed by anything else. "
+                 "Changes are synced to <path>.journal before the master is written, a "
+                 "journal left by an interrupted run is applied by the next one."
+              << std::endl;
+    std::cout << "--fdb" << std::endl;
+    std::cout << "\tSources are find dbs (.fdb.txt). Items of merged records are ordered by "
+                 "kernel time and with --resolve auto the fastest of conflicting items is used."
+              << std::endl;
+    std::cout << "--json" << std::endl;
+    std::cout << "\tWrite the --diff report as JSON." << std::endl;
+    std::cout << "--verbosity <0-3>" << std::endl;
+    std::cout << "\tWarnings and errors about records printed. 0: none, 1: only a summary of "
+                 "their counts by category at the end, 2: the first --max_messages of every "
+                 "category and the summary, 3: all of them and the summary. Default: 2."
+              << std::endl;
+    std::cout << "--max_messages <count>" << std::endl;
+    std::cout << "\tMessages printed per category with --verbosity 2. Default: 10."
+              << std::endl;
+    std::cout << "--stats <path>" << std::endl;
+    std::cout << "\tWrite statistics of the run as JSON: wall and CPU time of every phase and "
+                 "of parsing every source, bytes and records read per source, time spent "
+                 "writing and size of every output, counts of keys, conflicts and "
+                 "diagnostics, peak RSS and throughput."
+              << std::endl;
+    std::cout << "--jobs|-j <count>" << std::endl;
+    std::cout << "\tNumber of source files parsed concurrently. Results are the same as with "
+                 "a single job, warnings are grouped by source file. Default: 1."
+              << std::endl;
+    std::cout << "--prefetch <count>" << std::endl;
+    std::cout << "\tNumber of sources read ahead in the background while the ones before them "
+                 "are parsed, 0 disables it. Default: 4."
+              << std::endl;
+    std::cout << "--async_write|-a" << std::endl;
+    std::cout << "\tWrite output files from background threads while records are processed."
+              << std::endl;
+    std::cout << "--sorted_inputs|--sorted-inputs" << std::endl;
+    std::cout << "\tSources are sorted by key. They are merged as streams and every record is "
+                 "written as soon as all of its sources are read, so memory use does not grow "
+                 "with the input size. --jobs is ignored. The outputs can not be sources, "
+                 "as with --diff and --concat."
+              << std::endl;
+    std::cout << "--max_memory <MiB>" << std::endl;
+    std::cout << "\tApproximate limit for the memory used by parsed records. When it is "
+                 "reached, records are spilled to sorted temporary files which are merged at "
+                 "the end. Default: unlimited."
+              << std::endl;
+    std::cout << "--temp_dir <path>" << std::endl;
+    std::cout << "\tDirectory for the files spilled by --max_memory. Default: system temporary "
+                 "directory."
+              << std::endl;
+    std::cout << "--max_key_length <bytes>" << std::endl;
+    std::cout << "--max_value_length <bytes>" << std::endl;
+    std::cout << "--max_ids <count>" << std::endl;
+    std::cout << "\tRecords with a longer key, longer contents or more ids are dropped with a "
+                 "warning before they are stored. With both lengths, longer lines of text "
+                 "sources are not read whole. Default: unlimited."
+              << std::endl;
+    std::cout << "--max_errors <count>" << std::endl;
+    std::cout << "\tEnd the run with code 2 once more than <count> records and items were "
+                 "dropped as ill-formed, empty or over the limits. Default: unlimited."
+              << std::endl;
+    std::cout << "--watch <path>" << std::endl;
+    std::cout << "\tKeep running after the sources are parsed and merge every file that lands "
+                 "in the directory, the ones already in it first. Files are parsed once they "
+                 "are closed after writing or moved in, hidden ones are skipped, so fragments "
+                 "should be written under a hidden name and renamed. A file landing under a "
+                 "name already merged is merged again unless it is the same unchanged file. "
+                 "The outputs are written "
+                 "every --checkpoint seconds if anything was merged, to hidden files next to "
+                 "them which are renamed over them. SIGINT or SIGTERM writes the last "
+                 "checkpoint, with the diagnostics of the merge, and ends the run."
+              << std::endl;
+    std::cout << "--checkpoint <seconds>" << std::endl;
+    std::cout << "\tInterval between the checkpoints of --watch. Default: 60." << std::endl;
+    std::cout << "--shard <index>/<count>" << std::endl;
+    std::cout << "\tMerge only the keys of shard <index>, counted from 0, of <count>. Every "
+                 "source is read, records of other keys are skipped before they are stored. "
+                 "Keys are split by their FNV-1a hash, the same on every node, or by "
+                 "--shard_bounds. Outputs of all shards are joined with --concat."
+              << std::endl;
+    std::cout << "--shard_bounds <path>" << std::endl;
+    std::cout << "\tText file of <count> - 1 sorted keys, one per line, splitting keys into "
+                 "ranges for --shard instead of hashes. Shard <index> holds the keys from "
+                 "line <index> up to line <index> + 1, that key excluded, so the outputs of "
+                 "the shards in order are also sorted together."
+              << std::endl;
+    std::cout << "--mmap|-m" << std::endl;
+    std::cout << "\tMap source files into memory and parse them in place instead of reading "
+                 "them line by line."
+              << std::endl;
+    std::cout << std::endl << "Environment:" << std::endl;
+    std::cout << "PDBMERGE_SCANNER=<bytes|swar|sse2|avx2>" << std::endl;
+    std::cout << "\tDelimiter scanner of the text parsers, for testing them against each "
+                 "other. bytes looks at one byte at a time, swar at 8 in a 64 bit word. One "
+                 "the CPU does not run is ignored. Default: the fastest one."
+              << std::endl;
+    throw MergeError("", 0);
+}
+
+void DbMerger::ParseArguments(int nargs, char** cargs)
+{
+    auto sources = false;
+    std::vector<std::string> source_args;
+
+    for(auto i = 1; i < nargs; i++)
+    {
+        const auto arg = std::string{cargs[i]};
+
+        if(sources)
+        {
+            source_args.push_back(arg);
+            continue;
+        }
+
+        if(arg == "-r" || arg == "--resolve")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            const auto value = boost::algorithm::to_lower_copy(std::string{cargs[i]});
+
+            if(value == "0" || value == "off")
+                resolve_mode = ResolveModes::Off;
+            else if(value == "1" || value == "auto")
+                resolve_mode = ResolveModes::Auto;
+            else if(value == "last")
+                resolve_mode = ResolveModes::Last;
+            else if(value == "replace")
+                resolve_mode = ResolveModes::Replace;
+            else if(value == "majority")
+                resolve_mode = ResolveModes::Majority;
+            else if(value == "priority")
+                resolve_mode = ResolveModes::Priority;
+            else if(value == "time")
+                resolve_mode = ResolveModes::Time;
+            else
+                ExitWithError("F\tExpected 0, 1, off, auto, last, replace, majority, "
+                              "priority or time value after " +
+                                  arg + " argument.",
+                              2);
+        }
+        else if(arg == "--priority")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            priority_paths.emplace_back(cargs[i]);
+        }
+        else if(arg == "--times")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            times_path = cargs[i];
+        }
+        else if(arg == "-f" || arg == "--format")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            const auto value = boost::algorithm::to_lower_copy(std::string{cargs[i]});
+
+            if(value == "text")
+                format = OutputFormats::Text;
+            else if(value == "bin")
+                format = OutputFormats::Binary;
+            else if(value == "sqlite")
+                format = OutputFormats::Sqlite;
+            else
+                ExitWithError(
+                    "F\tExpected text, bin or sqlite value after " + arg + " argument.", 2);
+        }
+        else if(arg == "-c" || arg == "--commands")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            commands_path = cargs[i];
+        }
+        else if(arg == "-p" || arg == "--conflicts")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            conflicts_path = cargs[i];
+        }
+        else if(arg == "-x" || arg == "--conflict_commands")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            conflict_commands_path = cargs[i];
+        }
+        else if(arg == "-o" || arg == "--output")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            destination_path = cargs[i];
+
+            if(conflicts_path.empty() && destination_path != "-")
+                conflicts_path = SidePath(destination_path, ".conflicts");
+            if(conflict_commands_path.empty() && destination_path != "-")
+                conflict_commands_path = SidePath(destination_path, ".options");
+        }
+        else if(arg == "-j" || arg == "--jobs")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            jobs = PositiveArgument(arg, cargs[i], std::numeric_limits<unsigned int>::max());
+        }
+        else if(arg == "--prefetch")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            prefetch = NumberArgument(arg, cargs[i], std::numeric_limits<unsigned int>::max());
+        }
+        else if(arg == "-a" || arg == "--async_write")
+        {
+            write_behind = true;
+        }
+        else if(arg == "--max_memory")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            // MiB, bounded so the value in bytes does not overflow.
+            max_memory =
+                PositiveArgument(arg, cargs[i], std::numeric_limits<std::size_t>::max() >> 20)
+                << 20;
+        }
+        else if(arg == "--temp_dir")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            temp_dir = cargs[i];
+        }
+        else if(arg == "--max_key_length")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            limits.key_length = PositiveArgument(arg, cargs[i]);
+        }
+        else if(arg == "--max_value_length")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            limits.value_length = PositiveArgument(arg, cargs[i]);
+        }
+        else if(arg == "--max_ids")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            limits.ids = PositiveArgument(arg, cargs[i]);
+        }
+        else if(arg == "--max_errors")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            Diagnostics::MaxErrors() = PositiveArgument(arg, cargs[i]);
+        }
+        else if(arg == "--watch")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            watch_dir = cargs[i];
+        }
+        else if(arg == "--checkpoint")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            checkpoint =
+                PositiveArgument(arg, cargs[i], std::numeric_limits<unsigned int>::max());
+        }
+        else if(arg == "--sorted_inputs" || arg == "--sorted-inputs")
+        {
+            sorted_inputs = true;
+        }
+        else if(arg == "--master")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            master_path = cargs[i];
+
+            if(conflicts_path.empty())
+                conflicts_path = master_path.string() + ".conflicts";
+            if(conflict_commands_path.empty())
+                conflict_commands_path = master_path.string() + ".options";
+        }
+        else if(arg == "--verbosity")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            const auto value = std::string{cargs[i]};
+
+            if(value.size() != 1 || value[0] < '0' || value[0] > '3')
+                ExitWithError("F\tExpected 0, 1, 2 or 3 after " + arg + " argument.", 2);
+            Diagnostics::Verbosity() = value[0] - '0';
+        }
+        else if(arg == "--max_messages")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            Diagnostics::Limit() = NumberArgument(arg, cargs[i]);
+        }
+        else if(arg == "--stats")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            RunStats::Get().Enable(cargs[i]);
+        }
+        else if(arg == "--fdb")
+        {
+            find_db = true;
+        }
+        else if(arg == "--diff")
+        {
+            diff = true;
+        }
+        else if(arg == "--json")
+        {
+            json_report = true;
+        }
+        else if(arg == "--concat")
+        {
+            concat = true;
+        }
+        else if(arg == "--shard")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a value after " + arg + " argument.", 2);
+            const auto value  = std::string_view{cargs[i]};
+            const auto slash  = value.find('/');
+            std::size_t index = 0;
+            std::size_t count = 0;
+
+            if(slash == std::string_view::npos || !ParseNumber(value.substr(0, slash), index) ||
+               !ParseNumber(value.substr(slash + 1), count) || index >= count ||
+               count > std::numeric_limits<unsigned int>::max())
+                ExitWithError("F\tExpected <index>/<count> with an index below the count "
+                              "after " +
+                                  arg + " argument.",
+                              2);
+            shard.index = index;
+            shard.count = count;
+        }
+        else if(arg == "--shard_bounds")
+        {
+            if(++i >= nargs)
+                ExitWithError("F\tExpected a path after " + arg + " argument.", 2);
+            shard_bounds_path = cargs[i];
+        }
+        else if(arg == "-m" || arg == "--mmap")
+        {
+            use_mmap = true;
+        }
+        else if(arg == "-s" || arg == "--sources")
+        {
+            if(i >= nargs - 1)
+                ExitWithError("F\tExpected at least one path after " + arg + " argument.", 2);
+            sources = true;
+        }
+        else if(arg == "-h" || arg == "--help")
+        {
+            ExitWithHelp();
+        }
+        else if(arg == "-" || (!arg.empty() && arg[0] != '-'))
+        {
+            sources = true;
+            --i;
+        }
+        else
+        {
+            ExitWithError("F\tUnknown argument:" + arg, 2);
+        }
+    }
+
+    for(const auto& path : SourceDiscovery::Discover(source_args))
+        SourceFiles::Add(path);
+
+    if(SourceFiles::Count() == 0 && watch_dir.empty())
+        ExitWithError("F\tExpected at least one input file.", 2);
+
+    for(auto id = 0u; id < SourceFiles::Count(); ++id)
+        for(auto other = 0u; other < id; ++other)
+            if(SourceFiles::Get(other) == SourceFiles::Get(id) &&
+               IsStream(SourceFiles::Get(id)))
+                ExitWithError("F\tStreams can only be read once: " +
+                                  SourceFiles::Get(id).string(),
+                              2);
+
+    if(!watch_dir.empty())
+    {
+        if(destination_path.empty() || destination_path == "-" || IsStream(destination_path))
+            ExitWithError("F\t--watch needs an --output file.", 2);
+        if(!master_path.empty() || sorted_inputs || diff || max_memory != 0)
+            ExitWithError("F\t--watch can not be used with --master, --sorted-inputs, "
+                          "--diff or --max_memory.",
+                          2);
+        if(!boost::filesystem::is_directory(watch_dir))
+            ExitWithError("F\tExpected a directory to watch: " + watch_dir.string(), 2);
+    }
+
+    if(diff && SourceFiles::Count() != 2)
+        ExitWithError("F\tExpected two files to compare with --diff.", 2);
+    if(diff && !master_path.empty())
+        ExitWithError("F\t--master can not be used with --diff.", 2);
+
+    kernel_dbs = SourceFiles::Count() != 0 && SqliteKernelDb::IsKernelDb(SourceFiles::Get(0));
+
+    if(kernel_dbs && !watch_dir.empty())
+        ExitWithError("F\tKernel dbs can not be merged with --watch.", 2);
+    if(shard.count > 1 && (kernel_dbs || !master_path.empty() || concat))
+        ExitWithError("F\t--shard can not be used with kernel dbs, --master or --concat.", 2);
+    if(!shard_bounds_path.empty())
+        ReadShardBounds();
+    if(concat && (destination_path.empty() || diff || !master_path.empty()))
+        ExitWithError("F\t--concat needs an --output and can not be used with --diff or "
+                      "--master.",
+                      2);
+
+    for(auto id = 1u; id < SourceFiles::Count(); ++id)
+        if(SqliteKernelDb::IsKernelDb(SourceFiles::Get(id)) != kernel_dbs)
+            ExitWithError("F\tKernel dbs can not be merged with perf dbs: " +
+                              SourceFiles::Get(id).string(),
+                          2);
+
+    for(auto id = 0u; id < SourceFiles::Count(); ++id)
+        if(!PDBMERGE_ZSTD && CompressionOfContents(SourceFiles::Get(id)) == Compression::Zstd)
+            ExitWithError("F\tpdbmerge is built without zstd support: " +
+                              SourceFiles::Get(id).string(),
+                          2);
+
+    for(const auto& path : {destination_path, conflicts_path, conflict_commands_path, commands_path})
+        if(!PDBMERGE_ZSTD && CompressionOfName(path) == Compression::Zstd)
+            ExitWithError("F\tpdbmerge is built without zstd support: " + path.string(), 2);
+
+    if(!master_path.empty())
+    {
+        if(!destination_path.empty())
+            ExitWithError("F\t--output can not be used with --master.", 2);
+        if(kernel_dbs || format != OutputFormats::Auto || master_path == "-" ||
+           IsStream(master_path) || SqlitePerfDb::IsDatabase(master_path) ||
+           BinaryPerfDb::IsDatabase(master_path) ||
+           CompressionOfName(master_path) != Compression::None ||
+           CompressionOfContents(master_path) != Compression::None)
+            ExitWithError("F\tMaster has to be an uncompressed text db: " +
+                              master_path.string(),
+                          2);
+
+        for(auto id = 0u; id < SourceFiles::Count(); ++id)
+        {
+            boost::system::error_code error;
+            if(boost::filesystem::equivalent(SourceFiles::Get(id), master_path, error))
+                ExitWithError("F\tMaster can not be one of the sources: " +
+                                  master_path.string(),
+                              2);
+        }
+    }
+
+    if(sorted_inputs || diff || concat)
+        for(auto id = 0u; id < SourceFiles::Count(); ++id)
+            if(kernel_dbs || SqlitePerfDb::IsDatabase(SourceFiles::Get(id)) ||
+               BinaryPerfDb::IsDatabase(SourceFiles::Get(id)))
+                ExitWithError(std::string{"F\tOnly text sources can be "} +
+                                  (diff     ? "compared with --diff: "
+                                   : concat ? "joined with --concat: "
+                                            : "merged with --sorted-inputs: ") +
+                                  SourceFiles::Get(id).string(),
+                              2);
+
+    // Streamed sources are still read while the outputs are written, unlike parsed ones.
+    if(sorted_inputs || diff || concat)
+        for(const auto* output :
+            {&destination_path, &conflicts_path, &conflict_commands_path, &commands_path})
+            for(auto id = 0u; id < SourceFiles::Count() && !output->empty(); ++id)
+            {
+                boost::system::error_code error;
+                if(boost::filesystem::equivalent(SourceFiles::Get(id), *output, error))
+                    ExitWithError("F\tOutput can not be one of the streamed sources: " +
+                                      output->string(),
+                                  2);
+            }
+
+    if(resolve_mode == ResolveModes::Priority && priority_paths.empty())
+        ExitWithError("F\tExpected at least one --priority with --resolve priority.", 2);
+    if(resolve_mode == ResolveModes::Time && times_path.empty())
+        ExitWithError("F\tExpected --times with --resolve time.", 2);
+
+    if(resolve_mode == ResolveModes::Auto)
+        policy = std::make_unique<AutoPolicy>(find_db);
+    else if(resolve_mode == ResolveModes::Last)
+        policy = std::make_unique<LatestPolicy>();
+    else if(resolve_mode == ResolveModes::Majority)
+        policy = std::make_unique<MajorityPolicy>();
+    else if(resolve_mode == ResolveModes::Priority)
+        policy = std::make_unique<PriorityPolicy>(priority_paths);
+    else if(resolve_mode == ResolveModes::Time)
+        policy = std::make_unique<TimePolicy>(times_path, find_db, use_mmap);
+
+    if(policy)
+        policy->SourcesAdded();
+}
+
+void DbMerger::ReadShardBounds()
+{
+    if(shard.count == 1)
+        ExitWithError("F\t--shard_bounds needs a --shard.", 2);
+    if(!boost::filesystem::is_regular_file(shard_bounds_path))
+        ExitWithError("F\tCan not open file " + shard_bounds_path.string(), 2);
+
+    LineReader reader(shard_bounds_path, false);
+    TextLine line;
+
+    while(reader.Next(line))
+    {
+        auto bound = line.text;
+        if(!bound.empty() && bound.back() == '\r')
+            bound.remove_suffix(1);
+        if(bound.empty())
+            continue;
+
+        if(!shard.bounds.empty() && bound <= shard.bounds.back())
+            ExitWithError("F\tShard bounds are not sorted: " + std::string{bound}, 2);
+        shard.bounds.emplace_back(bound);
+    }
+
+    if(reader.Failed())
+        ExitWithError("F\tCan not decompress " + shard_bounds_path.string(), 2);
+    if(shard.bounds.size() != shard.count - 1)
+        ExitWithError("F\tExpected " + std::to_string(shard.count - 1) + " keys in " +
+                          shard_bounds_path.string(),
+                      2);
+}
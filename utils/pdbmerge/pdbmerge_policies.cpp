@@ -0,0 +1,381 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_policies.h"
+
+#include "pdbmerge_key.h"
+#include "pdbmerge_scanner.h"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <string_view>
+
+void ReplaceResolve::Process(RecordWriter* output, std::string_view key, const Conflict& conflict)
+{
+    if(output == nullptr)
+        return;
+
+    auto latest = conflict.items.empty() ? FilePos{0, 0}
+                                         : conflict.items.front().sources.back().source;
+    for(const auto& id : conflict.items)
+        if(latest.MergedBefore(id.sources.back().source))
+            latest = id.sources.back().source;
+
+    std::string value;
+    for(const auto& id : conflict.items)
+    {
+        const auto& item = id.sources.back();
+
+        if(item.source.MergedBefore(latest))
+            continue;
+
+        if(!value.empty())
+            value += ';';
+
+        value.append(id.name).append(":").append(item.value);
+    }
+
+    output->Write(key, value);
+}
+
+std::string_view AutoPolicy::Resolve(std::string_view /*key*/,
+                                     std::string_view /*id*/,
+                                     const Conflict::Sources& items) const
+{
+    return find_db ? ResolveByTime(items) : ResolveByCommas(items);
+}
+
+std::string_view AutoPolicy::ResolveByCommas(const Conflict::Sources& items)
+{
+    auto best_metric = -1;
+    auto best        = std::string_view{};
+
+    for(const auto& item : items)
+    {
+        const auto metric =
+            static_cast<int>(DelimiterScanner::Get().Commas(item.value));
+
+        if(metric >= best_metric)
+        {
+            best_metric = metric;
+            best        = item.value;
+        }
+    }
+
+    return best;
+}
+
+std::string_view AutoPolicy::ResolveByTime(const Conflict::Sources& items)
+{
+    auto best_time = std::numeric_limits<double>::infinity();
+    auto best      = items.front().value;
+
+    for(const auto& item : items)
+    {
+        auto time = 0.0;
+
+        if(FindDb::Time(item.value, time) && time < best_time)
+        {
+            best_time = time;
+            best      = item.value;
+        }
+    }
+
+    return best;
+}
+
+std::string_view LatestPolicy::Resolve(std::string_view /*key*/,
+                                       std::string_view /*id*/,
+                                       const Conflict::Sources& items) const
+{
+    return items.back().value;
+}
+
+std::string_view MajorityPolicy::Resolve(std::string_view /*key*/,
+                                         std::string_view /*id*/,
+                                         const Conflict::Sources& items) const
+{
+    auto best       = items.front().value;
+    auto best_count = std::size_t{0};
+
+    for(std::size_t i = 0; i < items.size(); ++i)
+    {
+        const auto value = items[i].value;
+        auto count       = std::size_t{0};
+        auto counted     = false;
+
+        for(std::size_t j = 0; j < items.size() && !counted; ++j)
+        {
+            if(items[j].value != value)
+                continue;
+            counted = j < i;
+            ++count;
+        }
+
+        if(!counted && count > best_count)
+        {
+            best       = value;
+            best_count = count;
+        }
+    }
+
+    return best;
+}
+
+std::string_view PriorityPolicy::Resolve(std::string_view /*key*/,
+                                         std::string_view /*id*/,
+                                         const Conflict::Sources& items) const
+{
+    const auto* best = &items.front();
+
+    for(const auto& item : items)
+        if(ranks[item.source.source] < ranks[best->source.source])
+            best = &item;
+
+    return best->value;
+}
+
+void PriorityPolicy::SourcesAdded()
+{
+    for(auto id = static_cast<unsigned int>(ranks.size()); id < SourceFiles::Count(); ++id)
+    {
+        auto rank = paths.size() + SourceFiles::Rank(id);
+
+        for(std::size_t i = 0; i < paths.size() && rank > i; ++i)
+        {
+            boost::system::error_code error;
+            if(boost::filesystem::equivalent(SourceFiles::Get(id), paths[i], error))
+                rank = i;
+        }
+
+        ranks.push_back(rank);
+    }
+}
+
+TimePolicy::TimePolicy(const bpath& path, bool find_db, bool use_mmap) : fallback(find_db)
+{
+    if(!boost::filesystem::is_regular_file(path))
+        Diagnostics::Fatal("F\tCan not open file ", path.c_str());
+
+    LineReader reader(path, use_mmap);
+    TextLine line;
+    unsigned int line_number = 0;
+
+    while(reader.Next(line))
+    {
+        ++line_number;
+
+        if(line.text.empty() || line.text[0] == '#')
+            continue;
+
+        std::array<std::string_view, 4> fields;
+        auto rest = line.text;
+        auto ok   = true;
+
+        if(rest.back() == '\r')
+            rest.remove_suffix(1);
+
+        for(std::size_t i = 0; i < fields.size() - 1 && ok; ++i)
+            ok = SplitString(rest, fields[i], rest, '\t');
+        fields.back() = rest;
+
+        const std::string time{fields.back()};
+        char* end = nullptr;
+        const auto measured = ok ? std::strtod(time.c_str(), &end) : 0.0;
+
+        if(!ok || time.empty() || end != time.c_str() + time.size() ||
+           !std::isfinite(measured))
+            Diagnostics::Fatal(
+                "F\tIll-formed time at ", path.c_str(), ":", line_number, ": ", line.text);
+
+        auto& best = times.emplace(Name(fields[0], fields[1], fields[2]), measured)
+                         .first->second;
+        best = std::min(best, measured);
+    }
+
+    if(reader.Failed())
+        Diagnostics::Fatal("F\tCan not decompress ", path.c_str());
+}
+
+std::string_view TimePolicy::Resolve(std::string_view key,
+                                     std::string_view id,
+                                     const Conflict::Sources& items) const
+{
+    auto best_time = std::numeric_limits<double>::infinity();
+    auto best      = std::string_view{};
+    std::string name;
+
+    for(const auto& item : items)
+    {
+        name.clear();
+        name.append(key).append(1, '\t').append(id).append(1, '\t').append(item.value);
+        const auto time = times.find(name);
+
+        if(time != times.end() && time->second < best_time)
+        {
+            best_time = time->second;
+            best      = item.value;
+        }
+    }
+
+    return best.data() != nullptr ? best : fallback.Resolve(key, id, items);
+}
+
+std::string TimePolicy::Name(std::string_view key, std::string_view id, std::string_view value)
+{
+    std::string name;
+    name.reserve(key.size() + id.size() + value.size() + 2);
+    return name.append(key).append(1, '\t').append(id).append(1, '\t').append(value);
+}
+
+void PolicyResolve::Process(RecordWriter* output,
+                            std::string_view key,
+                            const Conflict& conflict,
+                            const ResolvePolicy& policy)
+{
+    if(output == nullptr)
+        return;
+
+    std::string value;
+    for(const auto& id : conflict.items)
+    {
+        if(!value.empty())
+            value += ';';
+
+        value.append(id.name)
+            .append(":")
+            .append(id.all_equal ? id.sources.front().value
+                                 : policy.Resolve(key, id.name, id.sources));
+    }
+
+    output->Write(key, value);
+}
+
+NoResolve::NoResolve(std::ostream* options_,
+                     std::ostream* conflicts_,
+                     RecordWriter* output_,
+                     std::string_view key_,
+                     const Conflict& conflict_,
+                     Diagnostics& log_)
+    : options(options_),
+      conflicts(conflicts_),
+      output(output_),
+      key(key_),
+      conflict(conflict_),
+      log(log_)
+{
+}
+
+bool NoResolve::Process() const
+{
+    if(conflict.AllEqual())
+    {
+        TrivialMerge();
+        return true;
+    }
+
+    NoResolveMerge();
+    return false;
+}
+
+void NoResolve::TrivialMerge() const
+{
+    log.Report(Diagnostics::TrivialMerge, "W\tMerged without conflicts: ", key);
+
+    if(output == nullptr)
+        return;
+
+    std::string value;
+    for(const auto& id : conflict.items)
+    {
+        if(!value.empty())
+            value += ';';
+
+        value.append(id.name).append(":").append(id.sources[0].value);
+    }
+
+    output->Write(key, value);
+}
+
+void NoResolve::NoResolveMerge() const
+{
+    log.Report(Diagnostics::MergeConflict, "E\tMerge conflict: ", key);
+
+    if(options == nullptr && conflicts == nullptr)
+        return;
+
+    const auto driver_options = OptionsFromKey(key, log);
+    WriteOptions(driver_options);
+    WriteConflict(driver_options);
+}
+
+void NoResolve::WriteOptions(const std::string& driver_options) const
+{
+    if(options == nullptr || driver_options.empty())
+        return;
+
+    *options << driver_options << '\n';
+}
+
+void NoResolve::WriteConflict(const std::string& driver_options) const
+{
+    if(conflicts == nullptr)
+        return;
+
+    auto& out = *conflicts;
+
+    out << "Merge conflict at key " << key << '\n';
+    out << "Driver options to reproduce: " << driver_options << '\n';
+    out << "Merged record: " << key << "=";
+
+    auto first = true;
+    for(const auto& id : conflict.items)
+        if(id.all_equal)
+        {
+            if(!first)
+                out << ';';
+
+            first = false;
+            out << id.name << ':' << id.sources[0].value;
+        }
+
+    out << '\n';
+    out << "Conflicting items:" << '\n';
+
+    for(const auto& id : conflict.items)
+        if(!id.all_equal)
+            for(const auto& source : id.sources)
+                out << '\t' << id.name << ':' << source.value << " from " << source.source
+                    << '\n';
+
+    out << '\n';
+}
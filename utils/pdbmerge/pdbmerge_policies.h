@@ -0,0 +1,177 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_POLICIES_H_
+#define GUARD_PDBMERGE_POLICIES_H_
+
+#include "pdbmerge_io.h"
+#include "pdbmerge_records.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/// The latest record of the key replaces the earlier ones, the same as merging into a dict
+/// record by record.
+struct ReplaceResolve
+{
+    static void Process(RecordWriter* output, std::string_view key, const Conflict& conflict);
+};
+
+/// Picks the value written for an item of a conflict among the values met in its sources,
+/// which are in source order. Policies are shared by the jobs emitting records, so Resolve
+/// keeps no state.
+class ResolvePolicy
+{
+    public:
+    ResolvePolicy()                                = default;
+    ResolvePolicy(const ResolvePolicy&)            = delete;
+    ResolvePolicy& operator=(const ResolvePolicy&) = delete;
+    virtual ~ResolvePolicy()                       = default;
+
+    virtual std::string_view Resolve(std::string_view key,
+                                     std::string_view id,
+                                     const Conflict::Sources& items) const = 0;
+
+    /// Called when sources are added to SourceFiles, before records of them are resolved.
+    virtual void SourcesAdded() {}
+};
+
+/// Values with more commas win, the latest on ties. With find_db the lowest kernel time wins
+/// instead, the earliest on ties.
+class AutoPolicy : public ResolvePolicy
+{
+    public:
+    explicit AutoPolicy(bool find_db_) : find_db(find_db_) {}
+
+    std::string_view Resolve(std::string_view /*key*/,
+                             std::string_view /*id*/,
+                             const Conflict::Sources& items) const override;
+
+    static std::string_view ResolveByCommas(const Conflict::Sources& items);
+
+    /// The lowest kernel time wins, the earliest source on ties. Items without a time are
+    /// only used if no other item has one.
+    static std::string_view ResolveByTime(const Conflict::Sources& items);
+
+    private:
+    bool find_db;
+};
+
+/// The value met latest wins, the same as merging into a dict item by item.
+class LatestPolicy : public ResolvePolicy
+{
+    public:
+    std::string_view Resolve(std::string_view /*key*/,
+                             std::string_view /*id*/,
+                             const Conflict::Sources& items) const override;
+};
+
+/// The value met in most sources wins, the earliest on ties.
+class MajorityPolicy : public ResolvePolicy
+{
+    public:
+    std::string_view Resolve(std::string_view /*key*/,
+                             std::string_view /*id*/,
+                             const Conflict::Sources& items) const override;
+};
+
+/// The value of the source listed first wins. Sources not listed come after the listed ones,
+/// earlier first.
+class PriorityPolicy : public ResolvePolicy
+{
+    public:
+    explicit PriorityPolicy(std::vector<bpath> paths_) : paths(std::move(paths_)) {}
+
+    std::string_view Resolve(std::string_view /*key*/,
+                             std::string_view /*id*/,
+                             const Conflict::Sources& items) const override;
+
+    void SourcesAdded() override;
+
+    private:
+    std::vector<bpath> paths;
+    /// By source, lower ranks win.
+    std::vector<std::size_t> ranks;
+};
+
+/// The value with the lowest measured time wins, the earliest on ties. If no value has a
+/// time, the value is chosen by AutoPolicy.
+class TimePolicy : public ResolvePolicy
+{
+    public:
+    TimePolicy(const bpath& path, bool find_db, bool use_mmap);
+
+    std::string_view Resolve(std::string_view key,
+                             std::string_view id,
+                             const Conflict::Sources& items) const override;
+
+    private:
+    std::unordered_map<std::string, double> times;
+    AutoPolicy fallback;
+
+    static std::string Name(std::string_view key, std::string_view id, std::string_view value);
+};
+
+/// Writes every item of a conflict with the value picked by a policy.
+struct PolicyResolve
+{
+    static void Process(RecordWriter* output,
+                        std::string_view key,
+                        const Conflict& conflict,
+                        const ResolvePolicy& policy);
+};
+
+struct NoResolve
+{
+    std::ostream* options;
+    std::ostream* conflicts;
+    RecordWriter* output;
+    const std::string_view key;
+    const Conflict& conflict;
+    Diagnostics& log;
+
+    NoResolve(std::ostream* options_,
+              std::ostream* conflicts_,
+              RecordWriter* output_,
+              std::string_view key_,
+              const Conflict& conflict_,
+              Diagnostics& log_);
+
+    bool Process() const;
+
+    void TrivialMerge() const;
+
+    void NoResolveMerge() const;
+
+    void WriteOptions(const std::string& driver_options) const;
+
+    void WriteConflict(const std::string& driver_options) const;
+};
+
+#endif // GUARD_PDBMERGE_POLICIES_H_
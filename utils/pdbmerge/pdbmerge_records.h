@@ -0,0 +1,798 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_RECORDS_H_
+#define GUARD_PDBMERGE_RECORDS_H_
+
+#include "pdbmerge_context.h"
+#include "pdbmerge_io.h"
+#include "pdbmerge_scanner.h"
+
+#include <boost/filesystem/path.hpp>
+#include <boost/variant.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <vector>
+
+struct FileData
+{
+    FilePos source;
+    /// Points into an Arena.
+    std::string_view value;
+};
+
+struct Conflict
+{
+    /// Most ids are met in two or three sources, those stay in place.
+    using Sources = SmallVector<FileData, 2>;
+
+    struct Id
+    {
+        std::string_view name;
+        Sources sources;
+        /// All the sources hold the same value, kept up to date as sources are added.
+        bool all_equal;
+    };
+
+    /// Sorted by name. Conflicts rarely hold more than a few ids, a flat array beats a tree.
+    std::vector<Id, ArenaAllocator<Id>> items;
+
+    /// Data has to outlive the conflict, usually by being stored in an Arena. Items refer to it.
+    void Add(std::string_view data, const FilePos& pos, Diagnostics& log = Diagnostics::Main())
+    {
+        DelimiterScanner::Get().ForEachItem(data, [&](std::string_view item, std::size_t colon) {
+            AddItem(item, colon, pos, log);
+        });
+    }
+
+    /// Restores the order in which the items were met, records of different sources may be
+    /// added in any order when sources are parsed concurrently.
+    void SortItems()
+    {
+        for(auto& id : items)
+            std::stable_sort(id.sources.begin(),
+                             id.sources.end(),
+                             [](const FileData& left, const FileData& right) {
+                                 return left.source < right.source;
+                             });
+    }
+
+    bool AllEqual() const
+    {
+        return std::all_of(items.begin(), items.end(), [](const Id& id) { return id.all_equal; });
+    }
+
+    /// Adds an already validated item. Id and value have to outlive the conflict.
+    void Insert(std::string_view id, const FileData& item)
+    {
+        const auto found = std::lower_bound(
+            items.begin(), items.end(), id, [](const Id& left, std::string_view right) {
+                return left.name < right;
+            });
+
+        if(found != items.end() && found->name == id)
+        {
+            found->all_equal = found->all_equal && found->sources.front().value == item.value;
+            found->sources.push_back(item);
+        }
+        else
+            items.insert(found, Id{id, Sources{item}, true});
+    }
+
+    private:
+    void AddItem(std::string_view item, std::size_t colon, const FilePos& pos, Diagnostics& log)
+    {
+        if(colon == std::string_view::npos || colon == 0)
+        {
+            log.Report(Diagnostics::IllFormedItem, "W\tIll-formed record: id not found at ", pos);
+            return;
+        }
+
+        const auto id    = item.substr(0, colon);
+        const auto value = item.substr(colon + 1);
+
+        if(value.empty())
+        {
+            log.Report(Diagnostics::EmptyItem, "W\tNone contents under the id: ", id, " at ", pos);
+            return;
+        }
+
+        Insert(id, {pos, value});
+    }
+};
+
+/// Source of a record holding the same value as the one met first for its key.
+struct Repeat
+{
+    FilePos source;
+    const Repeat* next;
+};
+
+/// The only value met for a key so far. Records repeating it byte for byte, as several machines
+/// tuning the same configs produce, only add their sources instead of making a conflict.
+struct UniqueValue : FileData
+{
+    UniqueValue() = default;
+    UniqueValue(const FileData& data, std::uint64_t hash_) : FileData(data), hash(hash_) {}
+    explicit UniqueValue(const FileData& data) : UniqueValue(data, Hash(data.value)) {}
+
+    /// Tells differing values apart without comparing them.
+    std::uint64_t hash = 0;
+    /// Latest first, in an Arena.
+    const Repeat* repeats = nullptr;
+
+    static std::uint64_t Hash(std::string_view value)
+    {
+        return std::hash<std::string_view>{}(value);
+    }
+
+    /// Sources of the value and its repeats in (source, line) order, records of different sources
+    /// may be met in any order when sources are parsed concurrently.
+    std::vector<FilePos> Sources() const
+    {
+        std::vector<FilePos> sources{source};
+        for(auto repeat = repeats; repeat != nullptr; repeat = repeat->next)
+            sources.push_back(repeat->source);
+
+        std::sort(sources.begin(), sources.end());
+        return sources;
+    }
+};
+
+using Record = boost::variant<UniqueValue, Conflict>;
+
+inline Conflict& MakeConflict(Record& record, Diagnostics& log)
+{
+    if(const auto previous = boost::get<UniqueValue>(&record))
+    {
+        Conflict conflict;
+
+        if(previous->repeats == nullptr)
+            conflict.Add(previous->value, previous->source, log);
+        else
+            for(const auto& source : previous->Sources())
+                conflict.Add(previous->value, source, log);
+
+        record = std::move(conflict);
+    }
+
+    return boost::get<Conflict>(record);
+}
+
+/// Tells if the value adds to a conflict without warnings, Conflict::Add splits it the same way.
+inline bool IsWellFormed(std::string_view value)
+{
+    auto well_formed = true;
+
+    DelimiterScanner::Get().ForEachItem(value, [&](std::string_view item, std::size_t colon) {
+        well_formed = well_formed && colon != std::string_view::npos && colon != 0 &&
+                      colon + 1 < item.size();
+    });
+
+    return well_formed;
+}
+
+/// Notes a record met again with the value the record of its key holds. Returns false if the
+/// value differs or the record is a conflict already, the caller has to add it to a conflict.
+inline bool AddRepeat(Record& record, std::string_view value, std::uint64_t hash, FilePos source)
+{
+    const auto unique = boost::get<UniqueValue>(&record);
+
+    // Ill-formed items are reported for every record, as they are added to a conflict.
+    if(unique == nullptr || unique->hash != hash || unique->value != value ||
+       (unique->repeats == nullptr && !IsWellFormed(value)))
+        return false;
+
+    const auto memory = Arena::Local().Allocate(sizeof(Repeat), alignof(Repeat));
+    unique->repeats   = new(memory) Repeat{source, unique->repeats};
+    return true;
+}
+
+/// Tells if records of the key were met more than once.
+inline bool IsMerged(const Record& record)
+{
+    const auto unique = boost::get<UniqueValue>(&record);
+    return unique == nullptr || unique->repeats != nullptr;
+}
+
+inline bool IsRepeated(const Record& record)
+{
+    const auto unique = boost::get<UniqueValue>(&record);
+    return unique != nullptr && unique->repeats != nullptr;
+}
+
+/// Keys merged by one of the runs a merge is spread over, see --shard. Keys are assigned by
+/// their FNV-1a hash, which is the same whatever pdbmerge is built with, or by the sorted keys
+/// bounding the shards.
+struct KeyShard
+{
+    unsigned int index = 0;
+    unsigned int count = 1;
+    /// Empty for hash sharding, otherwise count - 1 sorted keys. Shard i holds the keys from
+    /// bound i - 1 up to bound i, the bound itself excluded.
+    std::vector<std::string> bounds;
+
+    bool Owns(std::string_view key) const
+    {
+        if(count == 1)
+            return true;
+
+        if(bounds.empty())
+            return Hash(key) % count == index;
+
+        const auto shard = std::upper_bound(bounds.begin(), bounds.end(), key) - bounds.begin();
+        return static_cast<unsigned int>(shard) == index;
+    }
+
+    static std::uint64_t Hash(std::string_view key)
+    {
+        auto hash = std::uint64_t{0xcbf29ce484222325};
+
+        for(const auto ch : key)
+            hash = (hash ^ static_cast<unsigned char>(ch)) * 0x100000001b3;
+
+        return hash;
+    }
+};
+
+/// Bounds on the records accepted, see --max_key_length, --max_value_length and --max_ids. 0 is
+/// no bound. Records are checked as views into the line read, before anything is stored.
+struct RecordLimits
+{
+    std::size_t key_length   = 0;
+    std::size_t value_length = 0;
+    std::size_t ids          = 0;
+
+    /// Longest line worth reading whole, with the '=' and a '\r'. 0 if any line may be a record.
+    std::size_t LineLength() const
+    {
+        return key_length == 0 || value_length == 0 ? 0 : key_length + value_length + 2;
+    }
+
+    /// Lines longer than LineLength() may be cut by the reader, the '=' of such a line may be
+    /// gone, but its key or contents are too long either way.
+    bool IsCut(std::string_view line) const
+    {
+        return LineLength() != 0 && line.size() > LineLength();
+    }
+
+    /// Warns about a record above the limits. Messages only tell the limit, as the whole record
+    /// may not have been read, and do not print oversized keys.
+    bool Admit(const FilePos& pos,
+               std::string_view key,
+               std::string_view value,
+               Diagnostics& log) const
+    {
+        if(key_length != 0 && key.size() > key_length)
+        {
+            ReportKey(pos, log);
+            return false;
+        }
+
+        if(value_length != 0 && value.size() > value_length)
+        {
+            log.Report(Diagnostics::OversizedRecord,
+                       "W\tRecord over the limits: contents longer than ",
+                       value_length,
+                       " bytes under the key: ",
+                       key,
+                       " at ",
+                       pos);
+            return false;
+        }
+
+        if(ids != 0 && value.size() > ids)
+        {
+            const auto count = DelimiterScanner::Get().Semicolons(value) + (value.back() != ';');
+
+            if(count > ids)
+            {
+                log.Report(Diagnostics::OversizedRecord,
+                           "W\tRecord over the limits: more than ",
+                           ids,
+                           " ids under the key: ",
+                           key,
+                           " at ",
+                           pos);
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void ReportKey(const FilePos& pos, Diagnostics& log) const
+    {
+        log.Report(Diagnostics::OversizedRecord,
+                   "W\tRecord over the limits: key longer than ",
+                   key_length,
+                   " bytes at ",
+                   pos);
+    }
+};
+
+/// Splits a text record, records of keys in other shards are skipped before anything is checked.
+/// Records without a key are only reported by the first shard.
+inline bool ParseRecord(const FilePos& pos,
+                        const TextLine& line,
+                        const KeyShard& shard,
+                        const RecordLimits& limits,
+                        std::string_view& key,
+                        std::string_view& value,
+                        Diagnostics& log)
+{
+    if(line.text.empty())
+        return false;
+
+    if(line.equals == std::string_view::npos || line.equals == 0)
+    {
+        if(shard.index != 0)
+            return false;
+
+        if(line.equals == std::string_view::npos && limits.IsCut(line.text))
+            limits.ReportKey(pos, log);
+        else
+            log.Report(
+                Diagnostics::IllFormedRecord, "W\tIll-formed record: key not found at ", pos);
+        return false;
+    }
+
+    key = line.text.substr(0, line.equals);
+
+    if(!shard.Owns(key))
+        return false;
+
+    value = line.text.substr(line.equals + 1);
+
+    if(value.empty())
+    {
+        log.Report(Diagnostics::EmptyRecord, "W\tNone contents under the key: ", key, " at ", pos);
+        return false;
+    }
+
+    if(value.back() == '\r')
+        value.remove_suffix(1);
+
+    return limits.Admit(pos, key, value, log);
+}
+
+/// Walks the records of a source sorted by key. Key and value stay valid until Next() is called.
+class SortedSource
+{
+    public:
+    SortedSource(unsigned int source_,
+                 bool use_mmap,
+                 const KeyShard& shard_,
+                 const RecordLimits& limits_)
+        : source(source_),
+          reader(SourceFiles::Get(source_), use_mmap, limits_.LineLength()),
+          shard(shard_),
+          limits(limits_)
+    {
+    }
+
+    /// Advances to the next record, returns false at the end of the source.
+    bool Next(Diagnostics& log)
+    {
+        TextLine line;
+
+        while(reader.Next(line))
+        {
+            pos = {source, ++line_number};
+
+            if(!ParseRecord(pos, line, shard, limits, key, value, log))
+                continue;
+
+            if(key < last_key)
+                Diagnostics::Fatal(
+                    "F\tSource is not sorted: ", key, " after ", last_key, " at ", pos);
+
+            RunStats::Get().GetSource(source).records++;
+
+            last_key.assign(key.data(), key.size());
+            return true;
+        }
+
+        if(reader.Failed())
+            Diagnostics::Fatal("F\tCan not decompress ", SourceFiles::Get(source).c_str());
+
+        return false;
+    }
+
+    std::string_view Key() const { return key; }
+    std::string_view Value() const { return value; }
+    const FilePos& Pos() const { return pos; }
+
+    /// Orders sources by the current key and then by the source index.
+    static bool Later(const SortedSource* left, const SortedSource* right)
+    {
+        return std::tie(left->key, left->source) > std::tie(right->key, right->source);
+    }
+
+    private:
+    unsigned int source;
+    LineReader reader;
+    const KeyShard& shard;
+    const RecordLimits& limits;
+    unsigned int line_number = 0;
+    FilePos pos{};
+    std::string_view key;
+    std::string_view value;
+    std::string last_key;
+};
+
+/// Sorted run of records spilled to a temporary file to bound memory use. Records are stored
+/// as built by the parser, conflicts included, so merging runs gives the same records as parsing
+/// everything into memory. Keys and values read back are views into a mapping of the file.
+class SpilledRun
+{
+    public:
+    explicit SpilledRun(const bpath& path) : file(path.string()), rest(file.View()) {}
+
+    static void Write(std::ostream& out, std::string_view key, const Record& record)
+    {
+        std::string body;
+
+        if(const auto value = boost::get<UniqueValue>(&record))
+        {
+            body.push_back(file_data);
+            Put(body, *value);
+            Put(body, value->hash);
+
+            auto count = std::uint32_t{0};
+            for(auto repeat = value->repeats; repeat != nullptr; repeat = repeat->next)
+                ++count;
+
+            Put(body, count);
+            for(auto repeat = value->repeats; repeat != nullptr; repeat = repeat->next)
+                Put(body, repeat->source);
+        }
+        else
+        {
+            const auto& conflict = boost::get<Conflict>(record);
+            body.push_back(conflict_data);
+            Put(body, static_cast<std::uint32_t>(conflict.items.size()));
+
+            for(const auto& id : conflict.items)
+            {
+                Put(body, id.name);
+                Put(body, static_cast<std::uint32_t>(id.sources.size()));
+
+                for(const auto& item : id.sources)
+                    Put(body, item);
+            }
+        }
+
+        std::string header;
+        Put(header, key);
+        Put(header, static_cast<std::uint32_t>(body.size()));
+        out << header << body;
+    }
+
+    bool Next(Diagnostics& /*log*/)
+    {
+        if(rest.empty())
+            return false;
+
+        key  = GetString(rest);
+        body = rest.substr(0, Get32(rest));
+        rest.remove_prefix(body.size());
+        return true;
+    }
+
+    std::string_view Key() const { return key; }
+
+    /// Adds the current record to the ones met earlier in other runs.
+    void Take(Record& record, bool first, Diagnostics& log) const
+    {
+        auto in         = body;
+        const auto kind = in.front();
+        in.remove_prefix(1);
+
+        if(kind == file_data)
+        {
+            const auto value = GetFileData(in);
+            const auto hash  = Get64(in);
+            auto count       = Get32(in);
+
+            if(first)
+                record = UniqueValue(value, hash);
+            else if(!AddRepeat(record, value.value, hash, value.source))
+                MakeConflict(record, log).Add(value.value, value.source, log);
+
+            for(; count > 0; --count)
+            {
+                const auto source = GetFilePos(in);
+                if(!AddRepeat(record, value.value, hash, source))
+                    MakeConflict(record, log).Add(value.value, source, log);
+            }
+            return;
+        }
+
+        if(first)
+            record = Conflict{};
+
+        auto& conflict = MakeConflict(record, log);
+
+        for(auto ids = Get32(in); ids > 0; --ids)
+        {
+            const auto id = GetString(in);
+
+            for(auto count = Get32(in); count > 0; --count)
+                conflict.Insert(id, GetFileData(in));
+        }
+    }
+
+    static bool Later(const SpilledRun* left, const SpilledRun* right)
+    {
+        return left->key > right->key;
+    }
+
+    private:
+    static constexpr char file_data     = 'D';
+    static constexpr char conflict_data = 'C';
+
+    MappedFile file;
+    std::string_view rest;
+    std::string_view key;
+    std::string_view body;
+
+    static void Put(std::string& out, std::uint32_t value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value)); // NOLINT
+    }
+
+    static void Put(std::string& out, std::string_view value)
+    {
+        Put(out, static_cast<std::uint32_t>(value.size()));
+        out.append(value.data(), value.size());
+    }
+
+    static void Put(std::string& out, std::uint64_t value)
+    {
+        out.append(reinterpret_cast<const char*>(&value), sizeof(value)); // NOLINT
+    }
+
+    static void Put(std::string& out, const FilePos& pos)
+    {
+        Put(out, static_cast<std::uint32_t>(pos.source));
+        Put(out, static_cast<std::uint32_t>(pos.line));
+    }
+
+    static void Put(std::string& out, const FileData& value)
+    {
+        Put(out, value.source);
+        Put(out, value.value);
+    }
+
+    static std::uint32_t Get32(std::string_view& in)
+    {
+        std::uint32_t value;
+        std::memcpy(&value, in.data(), sizeof(value));
+        in.remove_prefix(sizeof(value));
+        return value;
+    }
+
+    static std::uint64_t Get64(std::string_view& in)
+    {
+        std::uint64_t value;
+        std::memcpy(&value, in.data(), sizeof(value));
+        in.remove_prefix(sizeof(value));
+        return value;
+    }
+
+    static std::string_view GetString(std::string_view& in)
+    {
+        const auto size  = Get32(in);
+        const auto value = in.substr(0, size);
+        in.remove_prefix(size);
+        return value;
+    }
+
+    static FilePos GetFilePos(std::string_view& in)
+    {
+        FilePos pos;
+        pos.source = Get32(in);
+        pos.line   = Get32(in);
+        return pos;
+    }
+
+    static FileData GetFileData(std::string_view& in)
+    {
+        FileData value;
+        value.source = GetFilePos(in);
+        value.value  = GetString(in);
+        return value;
+    }
+};
+
+/// Pops cursors off a heap in groups sharing the smallest key. take(cursor, first) is called for
+/// every member of a group, in the order given by Cursor::Later, then flush(key) for the group.
+template <class Cursor, class Take, class Flush>
+inline void MergeCursors(std::vector<Cursor*> heap, Take take, Flush flush)
+{
+    std::make_heap(heap.begin(), heap.end(), Cursor::Later);
+    std::string key;
+
+    while(!heap.empty())
+    {
+        key.assign(heap.front()->Key().data(), heap.front()->Key().size());
+        auto first = true;
+
+        while(!heap.empty() && heap.front()->Key() == key)
+        {
+            std::pop_heap(heap.begin(), heap.end(), Cursor::Later);
+            auto* const cursor = heap.back();
+
+            take(*cursor, first);
+            first = false;
+
+            if(cursor->Next(Diagnostics::Main()))
+                std::push_heap(heap.begin(), heap.end(), Cursor::Later);
+            else
+                heap.pop_back();
+        }
+
+        flush(key);
+    }
+}
+
+/// Open-addressing hash table of records split into shards with a lock each, so concurrent
+/// parsers only wait for each other when they hit the same shard. Records are stored in
+/// insertion order, Sorted() gives them ordered by key.
+class RecordTable
+{
+    public:
+    using Entry = std::pair<std::string_view, Record>;
+
+    /// Passes the record of the key to on_found if there is one, otherwise inserts make().
+    template <class Make, class OnFound>
+    void Upsert(std::string_view key, Make make, OnFound on_found)
+    {
+        const auto hash = std::hash<std::string_view>{}(key);
+        auto& shard     = shards[hash % shard_count];
+        const std::lock_guard<std::mutex> lock(shard.mutex);
+
+        auto slot = shard.Find(key, hash);
+
+        if(shard.slots[slot] != 0)
+        {
+            on_found(shard.entries[shard.slots[slot] - 1].second);
+            return;
+        }
+
+        if((shard.entries.size() + 1) * 2 > shard.slots.size())
+        {
+            shard.Grow();
+            slot = shard.Find(key, hash);
+        }
+
+        shard.entries.emplace_back(Arena::Local().Store(key), make());
+        shard.hashes.push_back(hash);
+        shard.slots[slot] = static_cast<std::uint32_t>(shard.entries.size());
+        ++size;
+    }
+
+    std::size_t Size() const { return size; }
+
+    /// Approximate memory held by the table itself for every record, keys and values excluded.
+    static constexpr std::size_t entry_overhead =
+        sizeof(Entry) + sizeof(std::size_t) + 2 * sizeof(std::uint32_t);
+
+    /// Drops all records, the memory of the table is kept for reuse.
+    void Clear()
+    {
+        for(auto& shard : shards)
+        {
+            shard.entries.clear();
+            shard.hashes.clear();
+            std::fill(shard.slots.begin(), shard.slots.end(), 0);
+        }
+
+        size = 0;
+    }
+
+    template <class Action>
+    void ForEach(Action action)
+    {
+        for(auto& shard : shards)
+            for(auto& entry : shard.entries)
+                action(entry);
+    }
+
+    std::vector<const Entry*> Sorted() const
+    {
+        std::vector<const Entry*> sorted;
+        auto total = std::size_t{0};
+
+        for(const auto& shard : shards)
+            total += shard.entries.size();
+
+        sorted.reserve(total);
+
+        for(const auto& shard : shards)
+            for(const auto& entry : shard.entries)
+                sorted.push_back(&entry);
+
+        std::sort(sorted.begin(), sorted.end(), [](const Entry* left, const Entry* right) {
+            return left->first < right->first;
+        });
+
+        return sorted;
+    }
+
+    private:
+    static constexpr std::size_t shard_count = 64;
+
+    struct Shard
+    {
+        std::mutex mutex;
+        std::vector<Entry> entries;
+        std::vector<std::size_t> hashes;
+        /// Index of the entry plus one, zero marks an empty slot. Size is a power of two.
+        std::vector<std::uint32_t> slots = std::vector<std::uint32_t>(16, 0);
+
+        /// Returns the slot holding the key or the empty slot where it should be inserted.
+        std::size_t Find(std::string_view key, std::size_t hash) const
+        {
+            const auto mask = slots.size() - 1;
+
+            for(auto slot = (hash / shard_count) & mask;; slot = (slot + 1) & mask)
+            {
+                const auto index = slots[slot];
+                if(index == 0 || (hashes[index - 1] == hash && entries[index - 1].first == key))
+                    return slot;
+            }
+        }
+
+        void Grow()
+        {
+            slots.assign(slots.size() * 2, 0);
+            const auto mask = slots.size() - 1;
+
+            for(auto i = 0u; i < entries.size(); ++i)
+            {
+                auto slot = (hashes[i] / shard_count) & mask;
+                while(slots[slot] != 0)
+                    slot = (slot + 1) & mask;
+                slots[slot] = i + 1;
+            }
+        }
+    };
+
+    std::array<Shard, shard_count> shards;
+    std::atomic<std::size_t> size{0};
+};
+
+#endif // GUARD_PDBMERGE_RECORDS_H_
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_internal.h"
+#include "pdbmerge_scanner.h"
+
+#include <string_view>
+
+namespace pdbmerge {
+
+bool IsSupported(Scanner scanner)
+{
+#if PDBMERGE_SIMD
+    if(scanner == Scanner::Avx2)
+        return __builtin_cpu_supports("avx2");
+    if(scanner == Scanner::Sse2)
+        return __builtin_cpu_supports("sse2");
+#endif
+    return scanner == Scanner::Scalar;
+}
+
+std::size_t ScanItems(Scanner scanner, std::string_view text)
+{
+    DelimiterScanner::Classify classify = DelimiterScanner::ClassifyScalar;
+#if PDBMERGE_SIMD
+    if(scanner == Scanner::Avx2)
+        classify = DelimiterScanner::ClassifyAvx2;
+    else if(scanner == Scanner::Sse2)
+        classify = DelimiterScanner::ClassifySse2;
+#endif
+
+    if(!IsSupported(scanner))
+        return 0;
+
+    const DelimiterScanner scanning(classify);
+    auto items = std::size_t{0};
+
+    for(std::size_t start = 0; start < text.size();)
+    {
+        const auto line = SplitLine(text.substr(start));
+        start += line.text.size() + 1;
+
+        if(line.equals != std::string_view::npos)
+            scanning.ForEachItem(line.text.substr(line.equals + 1),
+                                 [&](std::string_view, std::size_t) { ++items; });
+    }
+
+    return items;
+}
+
+} // namespace pdbmerge
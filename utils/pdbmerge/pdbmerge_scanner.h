@@ -0,0 +1,337 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_SCANNER_H_
+#define GUARD_PDBMERGE_SCANNER_H_
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+
+#ifndef PDBMERGE_SIMD
+#if defined(__x86_64__) || defined(__i386__)
+#define PDBMERGE_SIMD 1
+#else
+#define PDBMERGE_SIMD 0
+#endif
+#endif
+#if PDBMERGE_SIMD
+#include <immintrin.h>
+#endif
+
+/// A line of a text db and the offset of its first '=', npos if there is none.
+struct TextLine
+{
+    std::string_view text;
+    std::size_t equals = std::string_view::npos;
+};
+
+/// Finds the end of the line text starts with and the first '=' in it. Both are single bytes,
+/// which the vectorized memchr of libc finds faster than the masks of the DelimiterScanner.
+inline TextLine SplitLine(std::string_view text)
+{
+    if(text.empty())
+        return {text};
+
+    const auto* newline = static_cast<const char*>(std::memchr(text.data(), '\n', text.size()));
+    if(newline != nullptr)
+        text = text.substr(0, newline - text.data());
+
+    const auto* equals = static_cast<const char*>(std::memchr(text.data(), '=', text.size()));
+    return {text, equals == nullptr ? std::string_view::npos
+                                    : static_cast<std::size_t>(equals - text.data())};
+}
+
+/// Bits of the delimiters of the text formats in a block of bytes, bit i stands for byte i.
+struct DelimiterMasks
+{
+    /// Delimiters to look for, the masks of the others are left empty.
+    enum Delimiters : unsigned
+    {
+        Newline   = 1U << 0U,
+        Equals    = 1U << 1U,
+        Semicolon = 1U << 2U,
+        Colon     = 1U << 3U,
+        Comma     = 1U << 4U,
+    };
+
+    std::uint64_t newline   = 0;
+    std::uint64_t equals    = 0;
+    std::uint64_t semicolon = 0;
+    std::uint64_t colon     = 0;
+    std::uint64_t comma     = 0;
+};
+
+/// Finds newlines, '=', ';', ':' and ',' in one pass over blocks of 64 bytes, with AVX2 or SSE2
+/// when the CPU has them and 8 bytes at a time otherwise. The text parsers split records into
+/// items and count delimiters at the positions found instead of searching them for each
+/// delimiter in turn. Lines are split with SplitLine instead, memchr is faster for one byte.
+class DelimiterScanner
+{
+    public:
+    static constexpr std::size_t block_size = 64;
+    using Classify = void (*)(const char* block, unsigned delimiters, DelimiterMasks& masks);
+
+    explicit DelimiterScanner(Classify classify_) : classify(classify_) {}
+
+    /// The fastest one the CPU runs.
+    static const DelimiterScanner& Get()
+    {
+        static const DelimiterScanner scanner(Best());
+        return scanner;
+    }
+
+    /// Splits a value into items the same way as std::getline(..., ';'): a trailing empty item
+    /// is not reported. Calls on_item(item, colon) with the offset of the first ':' in the item,
+    /// npos if there is none.
+    template <class OnItem>
+    void ForEachItem(std::string_view value, OnItem on_item) const
+    {
+        std::size_t start = 0;
+        auto colon        = std::string_view::npos;
+
+        for(std::size_t offset = 0; offset < value.size(); offset += block_size)
+        {
+            DelimiterMasks masks;
+            Scan(value, offset, DelimiterMasks::Semicolon | DelimiterMasks::Colon, masks);
+
+            for(auto bits = masks.semicolon | masks.colon; bits != 0; bits &= bits - 1)
+            {
+                const auto bit = Lowest(bits);
+                const auto at  = offset + bit;
+
+                if((masks.semicolon >> bit & 1) != 0)
+                {
+                    on_item(value.substr(start, at - start), colon);
+                    start = at + 1;
+                    colon = std::string_view::npos;
+                }
+                else if(colon == std::string_view::npos)
+                {
+                    colon = at - start;
+                }
+            }
+        }
+
+        if(start < value.size())
+            on_item(value.substr(start), colon);
+    }
+
+    std::size_t Commas(std::string_view text) const { return Count(text, DelimiterMasks::Comma); }
+
+    std::size_t Semicolons(std::string_view text) const
+    {
+        return Count(text, DelimiterMasks::Semicolon);
+    }
+
+    /// Compares one byte at a time, the reference the others are tested against.
+    static void ClassifyBytes(const char* block, unsigned delimiters, DelimiterMasks& masks)
+    {
+        masks = {};
+
+        for(std::size_t i = 0; i < block_size; ++i)
+        {
+            const auto bit  = std::uint64_t{1} << i;
+            const auto byte = block[i];
+
+            if((delimiters & DelimiterMasks::Newline) != 0 && byte == '\n')
+                masks.newline |= bit;
+            else if((delimiters & DelimiterMasks::Equals) != 0 && byte == '=')
+                masks.equals |= bit;
+            else if((delimiters & DelimiterMasks::Semicolon) != 0 && byte == ';')
+                masks.semicolon |= bit;
+            else if((delimiters & DelimiterMasks::Colon) != 0 && byte == ':')
+                masks.colon |= bit;
+            else if((delimiters & DelimiterMasks::Comma) != 0 && byte == ',')
+                masks.comma |= bit;
+        }
+    }
+
+    /// Compares 8 bytes at a time in 64 bit words.
+    static void ClassifyScalar(const char* block, unsigned delimiters, DelimiterMasks& masks)
+    {
+        masks = {};
+
+        for(std::size_t word = 0; word < block_size / 8; ++word)
+        {
+            std::uint64_t bytes;
+            std::memcpy(&bytes, block + 8 * word, sizeof(bytes));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            bytes = __builtin_bswap64(bytes);
+#endif
+            const auto shift = 8 * word;
+            const auto bits  = [&](unsigned delimiter, char byte) {
+                return (delimiters & delimiter) != 0 ? WordBits(bytes, byte) << shift : 0;
+            };
+
+            masks.newline |= bits(DelimiterMasks::Newline, '\n');
+            masks.equals |= bits(DelimiterMasks::Equals, '=');
+            masks.semicolon |= bits(DelimiterMasks::Semicolon, ';');
+            masks.colon |= bits(DelimiterMasks::Colon, ':');
+            masks.comma |= bits(DelimiterMasks::Comma, ',');
+        }
+    }
+
+#if PDBMERGE_SIMD
+    __attribute__((target("avx2"))) static void
+    ClassifyAvx2(const char* block, unsigned delimiters, DelimiterMasks& masks)
+    {
+        const auto vectors = reinterpret_cast<const __m256i*>(block); // NOLINT
+        const auto low     = _mm256_loadu_si256(vectors);
+        const auto high    = _mm256_loadu_si256(vectors + 1);
+
+        masks.newline   = Avx2Bits(low, high, delimiters, DelimiterMasks::Newline, '\n');
+        masks.equals    = Avx2Bits(low, high, delimiters, DelimiterMasks::Equals, '=');
+        masks.semicolon = Avx2Bits(low, high, delimiters, DelimiterMasks::Semicolon, ';');
+        masks.colon     = Avx2Bits(low, high, delimiters, DelimiterMasks::Colon, ':');
+        masks.comma     = Avx2Bits(low, high, delimiters, DelimiterMasks::Comma, ',');
+    }
+
+    __attribute__((target("sse2"))) static void
+    ClassifySse2(const char* block, unsigned delimiters, DelimiterMasks& masks)
+    {
+        const auto vectors = reinterpret_cast<const __m128i*>(block); // NOLINT
+        masks              = {};
+
+        for(auto part = 0u; part < block_size / 16; ++part)
+        {
+            const auto bytes = _mm_loadu_si128(vectors + part);
+            const auto shift = 16 * part;
+
+            masks.newline |= Sse2Bits(bytes, delimiters, DelimiterMasks::Newline, '\n') << shift;
+            masks.equals |= Sse2Bits(bytes, delimiters, DelimiterMasks::Equals, '=') << shift;
+            masks.semicolon |= Sse2Bits(bytes, delimiters, DelimiterMasks::Semicolon, ';') << shift;
+            masks.colon |= Sse2Bits(bytes, delimiters, DelimiterMasks::Colon, ':') << shift;
+            masks.comma |= Sse2Bits(bytes, delimiters, DelimiterMasks::Comma, ',') << shift;
+        }
+    }
+#endif
+
+    private:
+    Classify classify;
+
+    /// PDBMERGE_SCANNER picks another one, to test them against each other.
+    static Classify Best()
+    {
+        const auto* env   = std::getenv("PDBMERGE_SCANNER"); // NOLINT (concurrency-mt-unsafe)
+        const auto chosen = std::string_view{env == nullptr ? "" : env};
+
+        if(chosen == "bytes")
+            return ClassifyBytes;
+        if(chosen == "swar")
+            return ClassifyScalar;
+#if PDBMERGE_SIMD
+        const auto avx2 = __builtin_cpu_supports("avx2") != 0;
+        const auto sse2 = __builtin_cpu_supports("sse2") != 0;
+
+        if(chosen == "sse2" && sse2)
+            return ClassifySse2;
+        if(avx2)
+            return ClassifyAvx2;
+        if(sse2)
+            return ClassifySse2;
+#endif
+        return ClassifyScalar;
+    }
+
+    static std::size_t Lowest(std::uint64_t bits) { return __builtin_ctzll(bits); }
+
+    /// Bit i is set if byte i of the word is the delimiter.
+    static std::uint64_t WordBits(std::uint64_t bytes, char delimiter)
+    {
+        constexpr std::uint64_t ones = 0x0101010101010101;
+        constexpr std::uint64_t low  = 0x7f7f7f7f7f7f7f7f;
+
+        // The top bit of every byte is set if the byte differs from the delimiter, with no carries
+        // between bytes. The multiplication gathers the top bits of the matching bytes.
+        const auto differs = bytes ^ (ones * static_cast<unsigned char>(delimiter));
+        const auto matches = ~(((differs & low) + low) | differs) & ~low;
+        return (matches >> 7) * 0x0102040810204080 >> 56;
+    }
+
+    /// Occurrences of one delimiter, the masks of the others stay empty.
+    std::size_t Count(std::string_view text, unsigned delimiter) const
+    {
+        std::size_t count = 0;
+
+        for(std::size_t offset = 0; offset < text.size(); offset += block_size)
+        {
+            DelimiterMasks masks;
+            Scan(text, offset, delimiter, masks);
+            count += __builtin_popcountll(masks.newline | masks.equals | masks.semicolon |
+                                          masks.colon | masks.comma);
+        }
+
+        return count;
+    }
+
+    /// The last block of text is copied padded with zeros, nothing past its end is read.
+    void Scan(std::string_view text,
+              std::size_t offset,
+              unsigned delimiters,
+              DelimiterMasks& masks) const
+    {
+        if(text.size() - offset >= block_size)
+        {
+            classify(text.data() + offset, delimiters, masks);
+            return;
+        }
+
+        std::array<char, block_size> tail{};
+        std::copy(text.begin() + offset, text.end(), tail.begin());
+        classify(tail.data(), delimiters, masks);
+    }
+
+#if PDBMERGE_SIMD
+    __attribute__((target("avx2"))) static std::uint64_t
+    Avx2Bits(__m256i low, __m256i high, unsigned delimiters, unsigned delimiter, char byte)
+    {
+        if((delimiters & delimiter) == 0)
+            return 0;
+
+        const auto pattern = _mm256_set1_epi8(byte);
+        const auto bits    = [](int mask) { return static_cast<std::uint64_t>(
+                                                static_cast<std::uint32_t>(mask)); };
+
+        return bits(_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, pattern))) |
+               bits(_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, pattern))) << 32;
+    }
+
+    __attribute__((target("sse2"))) static std::uint64_t
+    Sse2Bits(__m128i bytes, unsigned delimiters, unsigned delimiter, char byte)
+    {
+        if((delimiters & delimiter) == 0)
+            return 0;
+
+        const auto pattern = _mm_set1_epi8(byte);
+        return static_cast<std::uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, pattern)));
+    }
+#endif
+};
+
+#endif // GUARD_PDBMERGE_SCANNER_H_
@@ -0,0 +1,228 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_sources.h"
+
+#include "pdbmerge_compression.h"
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+std::vector<bpath> SourceDiscovery::Discover(const std::vector<std::string>& args)
+{
+    std::vector<std::string> expanded;
+
+    for(const auto& arg : args)
+    {
+        if(arg.size() > 1 && arg[0] == '@')
+            ReadList(arg.substr(1), expanded);
+        else
+            expanded.push_back(arg);
+    }
+
+    std::vector<std::vector<bpath>> found(expanded.size());
+    ParallelFor(expanded.size(), threads, [&](std::size_t i) {
+        found[i] = Expand(expanded[i]);
+    });
+
+    std::vector<bpath> paths;
+    for(auto& part : found)
+        paths.insert(paths.end(),
+                     std::make_move_iterator(part.begin()),
+                     std::make_move_iterator(part.end()));
+
+    ParallelFor(paths.size(), threads, [&](std::size_t i) { Check(paths[i]); });
+    return paths;
+}
+
+void SourceDiscovery::ReadList(const std::string& path, std::vector<std::string>& args)
+{
+    std::ifstream list(path);
+    if(!list)
+        Diagnostics::Fatal("F\tCan not open file ", path);
+
+    std::string line;
+    while(std::getline(list, line))
+    {
+        boost::algorithm::trim(line);
+        if(!line.empty() && line[0] != '#')
+            args.push_back(line);
+    }
+
+    if(list.bad())
+        Diagnostics::Fatal("F\tCan not read file ", path);
+}
+
+std::vector<bpath> SourceDiscovery::Expand(const std::string& arg)
+{
+    if(arg == "-")
+        return {standard_input};
+    if(arg.find_first_of("*?[") != std::string::npos)
+        return Glob(arg);
+
+    boost::system::error_code error;
+    if(!boost::filesystem::is_directory(arg, error))
+        return {arg};
+
+    std::vector<bpath> paths;
+    for(boost::filesystem::directory_iterator it(arg, error), end; !error && it != end;
+        it.increment(error))
+    {
+        const auto name = it->path().filename().string();
+        if(!name.empty() && name[0] != '.' &&
+           boost::filesystem::is_regular_file(it->status()))
+            paths.push_back(it->path());
+    }
+
+    if(error)
+        Diagnostics::Fatal("F\tCan not list directory ", arg);
+    if(paths.empty())
+        Diagnostics::Fatal("F\tNo sources found in ", arg);
+
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+std::vector<bpath> SourceDiscovery::Glob(const std::string& pattern)
+{
+    glob_t matches = {};
+    std::vector<bpath> paths;
+
+    if(glob(pattern.c_str(), GLOB_NOCHECK, nullptr, &matches) == 0)
+    {
+        for(std::size_t i = 0; i < matches.gl_pathc; ++i)
+        {
+            // NOLINTNEXTLINE (cppcoreguidelines-pro-bounds-pointer-arithmetic)
+            const bpath path = matches.gl_pathv[i];
+            boost::system::error_code error;
+            if(!boost::filesystem::is_directory(path, error))
+                paths.push_back(path);
+        }
+    }
+
+    globfree(&matches);
+
+    if(paths.empty())
+        Diagnostics::Fatal("F\tNo sources match ", pattern);
+
+    return paths;
+}
+
+void SourceDiscovery::Check(const bpath& path)
+{
+    // Opening a pipe waits for its writer, it is opened only once it is parsed.
+    if(IsStream(path))
+        return;
+
+    // NOLINTNEXTLINE (hicpp-signed-bitwise, hicpp-vararg)
+    const auto fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat info;
+    auto readable = fd >= 0 && fstat(fd, &info) == 0 && S_ISREG(info.st_mode);
+
+    if(readable)
+    {
+        std::array<char, checked_size> start;
+        readable = pread(fd, start.data(), start.size(), 0) >= 0;
+    }
+
+    if(fd >= 0)
+        close(fd);
+
+    if(!readable)
+        Diagnostics::Fatal("F\tCan not open file ", path.c_str());
+}
+
+Prefetcher::Prefetcher(std::vector<bpath> paths_, unsigned int depth_)
+    : paths(std::move(paths_)), depth(depth_)
+{
+    if(depth > 0 && paths.size() > 1)
+        thread = std::thread([this]() { Run(); });
+}
+
+Prefetcher::~Prefetcher()
+{
+    if(!thread.joinable())
+        return;
+
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        stopped = true;
+    }
+    ready.notify_all();
+    thread.join();
+}
+
+void Prefetcher::Started(unsigned int source)
+{
+    if(!thread.joinable())
+        return;
+
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        next  = std::max<std::size_t>(next, source + 1);
+        limit = std::min(paths.size(), std::max<std::size_t>(limit, source + 1 + depth));
+    }
+    ready.notify_all();
+}
+
+void Prefetcher::Run()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while(true)
+    {
+        ready.wait(lock, [&]() { return stopped || next < limit; });
+        if(stopped)
+            return;
+
+        const auto& path = paths[next++];
+        lock.unlock();
+
+        // Opening a pipe could be taken by its writer for the parser opening it.
+        // NOLINTNEXTLINE (hicpp-signed-bitwise, hicpp-vararg)
+        const auto fd = IsStream(path) ? -1 : open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd >= 0)
+        {
+            posix_fadvise(fd, 0, hinted_size, POSIX_FADV_WILLNEED);
+            close(fd);
+        }
+
+        lock.lock();
+    }
+}
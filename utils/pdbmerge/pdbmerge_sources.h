@@ -0,0 +1,131 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_SOURCES_H_
+#define GUARD_PDBMERGE_SOURCES_H_
+
+#include "pdbmerge_context.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Runs action(i) for every i below count on up to threads threads. If actions fail, the error
+/// of the smallest i is rethrown once all threads are done.
+template <class Action>
+inline void ParallelFor(std::size_t count, unsigned int threads, Action action)
+{
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<std::size_t> next{0};
+    std::vector<std::thread> workers;
+
+    const auto work = [&]() {
+        for(auto i = next++; i < count; i = next++)
+        {
+            try
+            {
+                action(i);
+            }
+            catch(...)
+            {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    for(auto i = 1u; i < std::min<std::size_t>(threads, count); ++i)
+        workers.push_back(MergeContext::Thread(work));
+    work();
+
+    for(auto& worker : workers)
+        worker.join();
+
+    for(const auto& error : errors)
+        if(error != nullptr)
+            std::rethrow_exception(error);
+}
+
+/// Turns source arguments into source files. An argument is a file, a directory standing for
+/// the regular files in it sorted by name, hidden ones excepted, a glob pattern, or @<path> of
+/// a list file with one such argument per line. Directories are listed and sources checked on
+/// a pool of threads, as on network file systems most of the time goes to waiting for metadata.
+/// Checking a source reads its first bytes, so probing it later does not wait either.
+class SourceDiscovery
+{
+    public:
+    static std::vector<bpath> Discover(const std::vector<std::string>& args);
+
+    private:
+    static constexpr unsigned int threads     = 16;
+    static constexpr std::size_t checked_size = 4096;
+
+    static void ReadList(const std::string& path, std::vector<std::string>& args);
+
+    static std::vector<bpath> Expand(const std::string& arg);
+
+    /// Patterns without a match are taken as paths, so they fail the check as missing files.
+    static std::vector<bpath> Glob(const std::string& pattern);
+
+    static void Check(const bpath& path);
+};
+
+/// Hints the kernel to read ahead the sources about to be parsed, from a thread of its own so
+/// that opening them does not stall parsing either. Started(source) moves the window of hinted
+/// sources to the ones following it. Nothing is read here, pages are only brought into the cache.
+class Prefetcher
+{
+    public:
+    Prefetcher(std::vector<bpath> paths_, unsigned int depth_);
+
+    Prefetcher(const Prefetcher&)            = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+    ~Prefetcher();
+
+    void Started(unsigned int source);
+
+    private:
+    static constexpr off_t hinted_size = 8 << 20;
+
+    std::vector<bpath> paths;
+    unsigned int depth;
+    std::size_t next  = 0;
+    std::size_t limit = 0;
+    bool stopped      = false;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::thread thread;
+
+    void Run();
+};
+
+#endif // GUARD_PDBMERGE_SOURCES_H_
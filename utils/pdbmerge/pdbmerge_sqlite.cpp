@@ -0,0 +1,573 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_sqlite.h"
+
+#include "pdbmerge_merger.h"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <sqlite3.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+bool SqlitePerfDb::IsDatabase(const bpath& path)
+{
+    static constexpr char magic[] = "SQLite format 3"; // NOLINT (modernize-avoid-c-arrays)
+    char header[sizeof(magic)]    = {};                // NOLINT (modernize-avoid-c-arrays)
+
+    if(IsStream(path))
+        return false;
+
+    std::ifstream file(path.string(), std::ios::binary);
+    return file.read(header, sizeof(header)) &&
+           std::equal(header, header + sizeof(header), magic);
+}
+
+bool SqlitePerfDb::Config(const std::array<std::string_view, text_columns>& texts,
+                          const Numbers& numbers,
+                          ConvKey& config)
+{
+    config           = {};
+    config.layouts   = {texts[0], texts[0], texts[0]};
+    config.direction = texts[1];
+    config.data_type = texts[2];
+
+    // Every column fits an int, so that computing the out sizes can not overflow.
+    if(std::any_of(numbers.begin(), numbers.end(), [](sqlite3_int64 number) {
+           return number != static_cast<int>(number);
+       }))
+        return false;
+
+    const auto number = [&](std::size_t column) { return static_cast<int>(numbers[column]); };
+    config.spatial_dims = number(0);
+    config.in_channels  = number(1);
+    config.in           = {number(4), number(2), number(3)};
+    config.filter       = {number(7), number(5), number(6)};
+    config.out_channels = number(8);
+    config.batch_size   = number(9);
+    config.pad          = {number(12), number(10), number(11)};
+    config.stride       = {number(15), number(13), number(14)};
+    config.dilation     = {number(18), number(16), number(17)};
+    config.bias         = number(19);
+    config.group_count  = number(20);
+
+    if(config.spatial_dims != 2 && config.spatial_dims != 3)
+        return false;
+
+    const auto backward = config.direction == "B" || config.direction == "W";
+
+    // Depth columns of 2D configs are left out of the key.
+    for(auto i = static_cast<std::size_t>(3 - config.spatial_dims); i < config.out.size(); ++i)
+    {
+        const auto in     = std::int64_t{config.in[i]};
+        const auto stride = std::int64_t{config.stride[i]};
+        const auto extent = std::int64_t{config.dilation[i]} * (config.filter[i] - 1) + 1;
+        const auto padded = 2 * std::int64_t{config.pad[i]};
+        const auto out    = backward     ? (in - 1) * stride - padded + extent
+                            : stride > 0 ? (in + padded - extent) / stride + 1
+                                         : 0;
+        config.out[i]     = static_cast<int>(out);
+
+        if(out < 0 || out != config.out[i])
+            return false;
+    }
+
+    return true;
+}
+
+SqlitePerfDb::Numbers SqlitePerfDb::Columns(const ConvKey& config)
+{
+    const auto flat = config.spatial_dims == 2;
+
+    return {config.spatial_dims,
+            config.in_channels,
+            config.in[1],
+            config.in[2],
+            config.in[0],
+            config.filter[1],
+            config.filter[2],
+            config.filter[0],
+            config.out_channels,
+            config.batch_size,
+            config.pad[1],
+            config.pad[2],
+            config.pad[0],
+            config.stride[1],
+            config.stride[2],
+            flat ? 0 : config.stride[0],
+            config.dilation[1],
+            config.dilation[2],
+            flat ? 0 : config.dilation[0],
+            config.bias,
+            config.group_count};
+}
+
+bool SqlitePerfDb::Config(std::string_view key, ConvKey& config)
+{
+    ConvKey stored;
+
+    return ConvKey::Parse(key, config) && config.kind == ConvKey::Kinds::Conv &&
+           config.layouts[1] == config.layouts[0] && config.layouts[2] == config.layouts[0] &&
+           Config({config.layouts[0], config.direction, config.data_type},
+                  Columns(config),
+                  stored) &&
+           stored.Format() == key;
+}
+
+std::string SqlitePerfDb::Query()
+{
+    std::string query = "SELECT p.config";
+
+    for(const auto* column : config_columns)
+        query.append(", c.").append(column);
+
+    return query + ", p.solver, p.params FROM perf_db AS p INNER JOIN config AS c ON c.id = "
+                   "p.config ORDER BY p.config, p.id;";
+}
+
+std::string SqlitePerfDb::InsertConfig()
+{
+    std::string names, values;
+
+    for(const auto* column : config_columns)
+    {
+        names.append(names.empty() ? "" : ", ").append(column);
+        values.append(values.empty() ? "?" : ", ?");
+    }
+
+    return "INSERT INTO config(" + names + ") VALUES(" + values + ");";
+}
+
+SqliteOutput::SqliteOutput(const bpath& path_, const char* schema)
+    : path(path_), temp(path_.string() + ".tmp")
+{
+    boost::system::error_code error;
+    boost::filesystem::remove(temp, error);
+
+    // NOLINTNEXTLINE (hicpp-signed-bitwise)
+    const auto flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE;
+
+    if(sqlite3_open_v2(temp.c_str(), &db, flags, nullptr) != SQLITE_OK || !Exec(schema) ||
+       !Exec("PRAGMA journal_mode = OFF; PRAGMA synchronous = OFF; BEGIN;"))
+        failed = true;
+}
+
+SqliteOutput::~SqliteOutput()
+{
+    if(db == nullptr)
+        return;
+
+    failed = true;
+    Close();
+}
+
+sqlite3_stmt* SqliteOutput::Prepare(const std::string& sql)
+{
+    sqlite3_stmt* statement = nullptr;
+
+    if(db == nullptr ||
+       sqlite3_prepare_v2(db, sql.c_str(), -1, &statement, nullptr) != SQLITE_OK)
+        failed = true;
+    else
+        statements.push_back(statement);
+
+    return statement;
+}
+
+void SqliteOutput::Bind(sqlite3_stmt* statement, int index, std::string_view text)
+{
+    sqlite3_bind_text(
+        statement, index, text.data(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+}
+
+void SqliteOutput::Step(sqlite3_stmt* statement)
+{
+    if(statement == nullptr)
+        return;
+
+    failed |= sqlite3_step(statement) != SQLITE_DONE;
+    sqlite3_reset(statement);
+}
+
+void SqliteOutput::RecordDone()
+{
+    if(++pending >= transaction_size)
+    {
+        failed |= !Exec("COMMIT; BEGIN;");
+        pending = 0;
+    }
+}
+
+bool SqliteOutput::Close()
+{
+    if(db == nullptr)
+        return !failed;
+
+    for(auto* statement : statements)
+        sqlite3_finalize(statement);
+    statements.clear();
+
+    if(!failed)
+        failed = !Exec("COMMIT;");
+
+    sqlite3_close(db);
+    db = nullptr;
+
+    boost::system::error_code error;
+    if(!failed)
+    {
+        boost::filesystem::rename(temp, path, error);
+        failed = static_cast<bool>(error);
+    }
+    if(failed)
+        boost::filesystem::remove(temp, error);
+
+    return !failed;
+}
+
+bool SqliteOutput::Exec(const char* sql) const
+{
+    return sqlite3_exec(db, sql, nullptr, nullptr, nullptr) == SQLITE_OK;
+}
+
+SqliteWriter::SqliteWriter(const bpath& path)
+    : db(path, SqlitePerfDb::schema),
+      insert_config(db.Prepare(SqlitePerfDb::InsertConfig())),
+      insert_perf(db.Prepare("INSERT INTO perf_db(solver, config, params) VALUES(?, ?, ?);"))
+{
+}
+
+void SqliteWriter::Write(std::string_view key, std::string_view value)
+{
+    ConvKey problem;
+
+    if(!SqlitePerfDb::Config(key, problem))
+        Diagnostics::Fatal("F\tNot a key of an SQLite perf db config: ", key);
+
+    SqliteOutput::Bind(insert_config, 1, problem.layouts[0]);
+    SqliteOutput::Bind(insert_config, 2, problem.direction);
+    SqliteOutput::Bind(insert_config, 3, problem.data_type);
+
+    const auto numbers = SqlitePerfDb::Columns(problem);
+    for(auto i = 0u; i < numbers.size(); ++i)
+        sqlite3_bind_int64(insert_config, SqlitePerfDb::text_columns + i + 1, numbers[i]);
+
+    db.Step(insert_config);
+    const auto config = db.LastRow();
+
+    for(std::size_t start = 0; start < value.size();)
+    {
+        auto end = value.find(';', start);
+        if(end == std::string_view::npos)
+            end = value.size();
+
+        std::string_view solver, params;
+
+        if(SplitString(value.substr(start, end - start), solver, params, ':'))
+        {
+            SqliteOutput::Bind(insert_perf, 1, solver);
+            sqlite3_bind_int64(insert_perf, 2, config);
+            SqliteOutput::Bind(insert_perf, 3, params);
+            db.Step(insert_perf);
+        }
+
+        start = end + 1;
+    }
+
+    db.RecordDone();
+}
+
+void DbMerger::ParseSqlite(unsigned int source, Diagnostics& log)
+{
+    const auto& path       = SourceFiles::Get(source);
+    sqlite3* opened        = nullptr;
+    sqlite3_stmt* prepared = nullptr;
+
+    // A connection is returned even if opening failed and has to be closed as well.
+    const auto open = sqlite3_open_v2(path.c_str(), &opened, SQLITE_OPEN_READONLY, nullptr);
+    const SqliteDb db(opened);
+
+    if(open != SQLITE_OK ||
+       sqlite3_prepare_v2(db.get(), SqlitePerfDb::Query().c_str(), -1, &prepared, nullptr) !=
+           SQLITE_OK)
+        Diagnostics::Fatal(
+            "F\tCan not read SQLite perf db ", path.c_str(), ": ", sqlite3_errmsg(db.get()));
+
+    const SqliteStatement statement(prepared);
+    auto* rows = statement.get();
+
+    const auto text = [&](int column) {
+        const auto* data = reinterpret_cast<const char*>(sqlite3_column_text(rows, column));
+        const auto size  = static_cast<std::size_t>(sqlite3_column_bytes(rows, column));
+        return std::string_view{data, size};
+    };
+
+    std::string key, value;
+    auto config = sqlite3_int64{-1};
+    auto status = sqlite3_step(rows);
+
+    const auto add_config = [&]() {
+        const FilePos pos{source, static_cast<unsigned int>(config)};
+
+        if(!shard.Owns(key))
+            return;
+
+        if(value.empty())
+            log.Report(
+                Diagnostics::EmptyRecord, "W\tNone contents under the key: ", key, " at ", pos);
+        else if(limits.Admit(pos, key, value, log))
+            AddRecord(pos, key, value, log);
+    };
+
+    while(status == SQLITE_ROW)
+    {
+        {
+            // Spilling waits until no thread is in the middle of a batch.
+            const std::shared_lock<std::shared_mutex> lock(parsing);
+
+            for(auto i = 0; i < spill_check_interval && status == SQLITE_ROW; ++i)
+            {
+                const auto solver_config = sqlite3_column_int64(rows, 0);
+                const auto solver        = text(SqlitePerfDb::config_columns.size() + 1);
+                const auto params        = text(SqlitePerfDb::config_columns.size() + 2);
+
+                if(solver_config != config)
+                {
+                    if(!key.empty())
+                        add_config();
+
+                    config = solver_config;
+                    key.clear();
+                    value.clear();
+
+                    SqlitePerfDb::Numbers numbers;
+                    for(auto i = 0u; i < numbers.size(); ++i)
+                        numbers[i] =
+                            sqlite3_column_int64(rows, SqlitePerfDb::text_columns + i + 1);
+
+                    ConvKey problem;
+                    if(SqlitePerfDb::Config({text(1), text(2), text(3)}, numbers, problem))
+                        key = problem.Format();
+                    else
+                        log.Report(Diagnostics::IllFormedRecord,
+                                   "W\tIll-formed record: not a conv config at ",
+                                   FilePos{source, static_cast<unsigned int>(config)});
+                }
+
+                if(solver.empty() || solver.find_first_of(":;") != std::string_view::npos ||
+                   params.find(';') != std::string_view::npos)
+                    log.Report(Diagnostics::IllFormedRecord,
+                               "W\tIll-formed record: unexpected solver or params at ",
+                               FilePos{source, static_cast<unsigned int>(config)});
+                else
+                    value.append(value.empty() ? "" : ";")
+                        .append(solver)
+                        .append(":")
+                        .append(params);
+
+                status = sqlite3_step(rows);
+            }
+
+            if(status != SQLITE_ROW && !key.empty())
+                add_config();
+        }
+
+        if(max_memory != 0 && MemoryUsed() > max_memory)
+            Spill();
+    }
+
+    if(status != SQLITE_DONE)
+        Diagnostics::Fatal(
+            "F\tCan not read SQLite perf db ", path.c_str(), ": ", sqlite3_errmsg(db.get()));
+}
+
+SqliteDb DbMerger::OpenKernelDb(unsigned int source, const char* query, SqliteStatement& rows)
+{
+    const auto& path       = SourceFiles::Get(source);
+    sqlite3* opened        = nullptr;
+    sqlite3_stmt* prepared = nullptr;
+
+    const auto open = sqlite3_open_v2(path.c_str(), &opened, SQLITE_OPEN_READONLY, nullptr);
+    SqliteDb db(opened);
+
+    if(open != SQLITE_OK ||
+       sqlite3_prepare_v2(db.get(), query, -1, &prepared, nullptr) != SQLITE_OK)
+        KernelDbError(source, db.get());
+
+    rows.reset(prepared);
+    return db;
+}
+
+void DbMerger::KernelDbError(unsigned int source, sqlite3* db)
+{
+    ExitWithError("F\tCan not read SQLite kernel db " + SourceFiles::Get(source).string() +
+                      ": " + sqlite3_errmsg(db),
+                  2);
+}
+
+std::vector<DbMerger::KernelRow> DbMerger::IndexKernelDb(unsigned int source)
+{
+    SqliteStatement statement;
+    const auto db = OpenKernelDb(source, SqliteKernelDb::index_query, statement);
+    auto* rows    = statement.get();
+    auto& arena   = Arena::Local();
+    std::vector<KernelRow> kernels;
+    auto status = SQLITE_ROW;
+
+    const auto text = [&](int column) {
+        return arena.Store(
+            {reinterpret_cast<const char*>(sqlite3_column_text(rows, column)),
+             static_cast<std::size_t>(sqlite3_column_bytes(rows, column))});
+    };
+
+    while((status = sqlite3_step(rows)) == SQLITE_ROW)
+        kernels.push_back({text(1), text(2), sqlite3_column_int64(rows, 0)});
+
+    if(status != SQLITE_DONE)
+        KernelDbError(source, db.get());
+
+    return kernels;
+}
+
+void DbMerger::CopyKernels(unsigned int source,
+                           const std::vector<sqlite3_int64>& copied,
+                           SqliteOutput& output,
+                           sqlite3_stmt* insert)
+{
+    SqliteStatement statement;
+    const auto db = OpenKernelDb(source, SqliteKernelDb::copy_query, statement);
+    auto* rows    = statement.get();
+    auto next     = copied.begin();
+    auto status   = SQLITE_ROW;
+
+    while(next != copied.end() && (status = sqlite3_step(rows)) == SQLITE_ROW)
+    {
+        if(sqlite3_column_int64(rows, 0) != *next)
+            continue;
+
+        ++next;
+
+        for(auto column = 1; column <= 5; ++column)
+        {
+            const auto bytes = sqlite3_column_bytes(rows, column);
+
+            // Empty blobs come back as null pointers and have to stay blobs.
+            if(sqlite3_column_type(rows, column) == SQLITE_BLOB && bytes > 0)
+                sqlite3_bind_blob(
+                    insert, column, sqlite3_column_blob(rows, column), bytes, SQLITE_STATIC);
+            else
+                sqlite3_bind_value(insert, column, sqlite3_column_value(rows, column));
+        }
+
+        output.Step(insert);
+        output.RecordDone();
+    }
+
+    if(status != SQLITE_ROW && status != SQLITE_DONE)
+        KernelDbError(source, db.get());
+}
+
+void DbMerger::MergeKernelDbs()
+{
+    const auto count = SourceFiles::Count();
+
+    if(destination_path.empty())
+        ExitWithError("F\tExpected an output path to merge kernel dbs.", 2);
+
+    for(auto source = 0u; source < count; ++source)
+    {
+        boost::system::error_code error;
+        if(boost::filesystem::equivalent(SourceFiles::Get(source), destination_path, error))
+            ExitWithError("F\tOutput can not be one of the kernel db sources: " +
+                              destination_path.string(),
+                          2);
+    }
+
+    std::vector<std::vector<KernelRow>> kernels(count);
+
+    if(jobs > 1 && count > 1)
+        ForEachSourceConcurrently([&](unsigned int source, Diagnostics& /*log*/) {
+            kernels[source] = IndexKernelDb(source);
+        });
+    else
+        for(auto source = 0u; source < count; ++source)
+            kernels[source] = IndexKernelDb(source);
+
+    for(auto source = 0u; source < count; ++source)
+        RunStats::Get().GetSource(source).records = kernels[source].size();
+
+    std::unordered_map<KernelId, KernelLocation, KernelIdHash> index;
+    std::size_t duplicates = 0;
+
+    for(auto source = 0u; source < count; ++source)
+    {
+        for(const auto& kernel : kernels[source])
+        {
+            const KernelLocation location{source, kernel.row};
+
+            if(!index.insert_or_assign({kernel.name, kernel.args}, location).second)
+                duplicates++;
+        }
+
+        kernels[source] = {};
+    }
+
+    std::vector<std::vector<sqlite3_int64>> copied(count);
+
+    for(const auto& kernel : index)
+        copied[kernel.second.source].push_back(kernel.second.row);
+
+    index = {};
+    Arena::ResetAll();
+
+    SqliteOutput output(destination_path, SqliteKernelDb::schema);
+    auto* insert = output.Prepare(SqliteKernelDb::insert);
+
+    if(!output.IsOpen())
+        ExitWithError("F\tCan not open file " + destination_path.string(), 2);
+
+    for(auto source = 0u; source < count; ++source)
+    {
+        std::sort(copied[source].begin(), copied[source].end());
+        CopyKernels(source, copied[source], output, insert);
+    }
+
+    if(!output.Close())
+        ExitWithError("F\tCan not write file " + destination_path.string(), 2);
+
+    if(duplicates != 0 && Diagnostics::Verbosity() >= 1)
+        std::cerr << "W\tDuplicate kernels replaced: " << duplicates << std::endl;
+}
@@ -0,0 +1,211 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#ifndef GUARD_PDBMERGE_SQLITE_H_
+#define GUARD_PDBMERGE_SQLITE_H_
+
+#include "pdbmerge_io.h"
+#include "pdbmerge_key.h"
+
+#include <boost/filesystem/path.hpp>
+
+#include <sqlite3.h>
+
+#include <array>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Finalizes statements and closes connections of SQLite dbs read, also when a read throws.
+struct SqliteCloser
+{
+    void operator()(sqlite3* db) const { sqlite3_close(db); }
+    void operator()(sqlite3_stmt* statement) const { sqlite3_finalize(statement); }
+};
+
+using SqliteDb        = std::unique_ptr<sqlite3, SqliteCloser>;
+using SqliteStatement = std::unique_ptr<sqlite3_stmt, SqliteCloser>;
+
+/// Layout of the SQLite perf db written by Tuna's export_db.py and read by MIOpen. A config row
+/// is keyed by the MIOpen text key of its problem, so that it merges with the same config of text
+/// sources, the perf_db rows of the config become the "solver:params" items of the record.
+struct SqlitePerfDb
+{
+    static constexpr std::size_t text_columns = 3;
+    static constexpr std::array<const char*, 24> config_columns = {
+        "layout",        "direction",     "data_type",     "spatial_dim", "in_channels",
+        "in_h",          "in_w",          "in_d",          "fil_h",       "fil_w",
+        "fil_d",         "out_channels",  "batchsize",     "pad_h",       "pad_w",
+        "pad_d",         "conv_stride_h", "conv_stride_w", "conv_stride_d", "dilation_h",
+        "dilation_w",    "dilation_d",    "bias",          "group_count"};
+
+    /// Values of the columns after the text ones.
+    using Numbers = std::array<sqlite3_int64, config_columns.size() - text_columns>;
+
+    static constexpr const char* schema =
+        "CREATE TABLE IF NOT EXISTS `config` (`id` INTEGER PRIMARY KEY ASC,`layout` TEXT NOT NULL,"
+        "`data_type` TEXT NOT NULL,`direction` TEXT NOT NULL,`spatial_dim` INT NOT NULL,"
+        "`in_channels` INT NOT NULL,`in_h` INT NOT NULL,`in_w` INT NOT NULL,`in_d` INT NOT NULL,"
+        "`fil_h` INT NOT NULL,`fil_w` INT NOT NULL,`fil_d` INT NOT NULL,"
+        "`out_channels` INT NOT NULL, `batchsize` INT NOT NULL,"
+        "`pad_h` INT NOT NULL,`pad_w` INT NOT NULL,`pad_d` INT NOT NULL,"
+        "`conv_stride_h` INT NOT NULL,`conv_stride_w` INT NOT NULL,`conv_stride_d` INT NOT NULL,"
+        "`dilation_h` INT NOT NULL,`dilation_w` INT NOT NULL,`dilation_d` INT NOT NULL,"
+        "`bias` INT NOT NULL,`group_count` INT NOT NULL);"
+        "CREATE TABLE IF NOT EXISTS `perf_db` (`id` INTEGER PRIMARY KEY ASC,`solver` TEXT NOT NULL,"
+        "`config` INTEGER NOT NULL, `params` TEXT NOT NULL);"
+        "CREATE UNIQUE INDEX IF NOT EXISTS `idx_config` ON config( layout,data_type,direction,"
+        "spatial_dim,in_channels,in_h,in_w,in_d,fil_h,fil_w,fil_d,out_channels,"
+        "batchsize,pad_h,pad_w,pad_d,conv_stride_h,conv_stride_w,conv_stride_d,"
+        "dilation_h,dilation_w,dilation_d,bias,group_count );"
+        "CREATE UNIQUE INDEX IF NOT EXISTS `idx_perf_db` ON perf_db(solver, config);";
+
+    static bool IsDatabase(const bpath& path);
+
+    /// Problem of a config row from its layout, direction and data type and the other columns.
+    /// Out sizes are not stored and follow from the others, in and out being swapped for backward
+    /// directions as in text keys. False if the columns do not make a 2D or 3D conv.
+    static bool Config(const std::array<std::string_view, text_columns>& texts,
+                       const Numbers& numbers,
+                       ConvKey& config);
+
+    /// Inverse of Config, the columns after the text ones of a problem. 2D configs have a depth
+    /// stride and dilation of 0, as MIOpen stores them.
+    static Numbers Columns(const ConvKey& config);
+
+    /// Problem of a text key to store as a config row. False if the key is not a conv key with
+    /// one layout, or not the key the row would be read back as.
+    static bool Config(std::string_view key, ConvKey& config);
+
+    static std::string Query();
+
+    static std::string InsertConfig();
+};
+
+/// Layout of the SQLite binary kernel cache (kdb) written by Tuna's export_db.py. Kernels are
+/// identified by (kernel_name, kernel_args), the blob itself is copied as is.
+struct SqliteKernelDb
+{
+    static constexpr const char* schema =
+        "CREATE TABLE `kern_db` (`id` INTEGER PRIMARY KEY ASC,`kernel_name` TEXT NOT NULL,"
+        "`kernel_args` TEXT NOT NULL,`kernel_blob` BLOB NOT NULL,`kernel_hash` TEXT NOT NULL,"
+        "`uncompressed_size` INT NOT NULL);"
+        "CREATE UNIQUE INDEX `idx_kern_db` ON kern_db(kernel_name, kernel_args);";
+
+    static constexpr const char* index_query =
+        "SELECT rowid, kernel_name, kernel_args FROM kern_db ORDER BY rowid;";
+    static constexpr const char* copy_query =
+        "SELECT rowid, kernel_name, kernel_args, kernel_blob, kernel_hash, uncompressed_size FROM "
+        "kern_db ORDER BY rowid;";
+    static constexpr const char* insert =
+        "INSERT INTO kern_db(kernel_name, kernel_args, kernel_blob, kernel_hash, "
+        "uncompressed_size) VALUES(?, ?, ?, ?, ?);";
+
+    static constexpr const char* table_query =
+        "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'kern_db';";
+
+    static bool IsKernelDb(const bpath& path)
+    {
+        if(!SqlitePerfDb::IsDatabase(path))
+            return false;
+
+        sqlite3* db             = nullptr;
+        sqlite3_stmt* statement = nullptr;
+        auto found              = false;
+
+        if(sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) == SQLITE_OK &&
+           sqlite3_prepare_v2(db, table_query, -1, &statement, nullptr) == SQLITE_OK)
+            found = sqlite3_step(statement) == SQLITE_ROW;
+
+        sqlite3_finalize(statement);
+        sqlite3_close(db);
+        return found;
+    }
+};
+
+/// A new SQLite database filled through prepared statements, journaling is off and rows are
+/// committed in large transactions. The database is built in a temporary file next to the path
+/// and only replaces an existing file once closed without errors. An output that failed or is
+/// destroyed without being closed, as when a record is refused, leaves the path as it was.
+class SqliteOutput
+{
+    public:
+    SqliteOutput(const bpath& path_, const char* schema);
+
+    SqliteOutput(const SqliteOutput&)            = delete;
+    SqliteOutput& operator=(const SqliteOutput&) = delete;
+
+    ~SqliteOutput();
+
+    bool IsOpen() const { return db != nullptr && !failed; }
+    const bpath& Path() const { return path; }
+    sqlite3_int64 LastRow() const { return sqlite3_last_insert_rowid(db); }
+
+    /// The statement is finalized by Close.
+    sqlite3_stmt* Prepare(const std::string& sql);
+
+    static void Bind(sqlite3_stmt* statement, int index, std::string_view text);
+
+    void Step(sqlite3_stmt* statement);
+
+    /// Called after every record, starts a new transaction once enough have been written.
+    void RecordDone();
+
+    bool Close();
+
+    private:
+    static constexpr std::size_t transaction_size = 100000;
+
+    bpath path;
+    bpath temp;
+    sqlite3* db = nullptr;
+    std::vector<sqlite3_stmt*> statements;
+    std::size_t pending = 0;
+    bool failed         = false;
+
+    bool Exec(const char* sql) const;
+};
+
+/// Writes merged records to an SQLite perf db, all keys have to be conv keys a config row holds.
+class SqliteWriter : public RecordWriter
+{
+    public:
+    explicit SqliteWriter(const bpath& path);
+
+    bool IsOpen() const override { return db.IsOpen(); }
+    const bpath& Path() const override { return db.Path(); }
+
+    void Write(std::string_view key, std::string_view value) override;
+
+    bool Close() override { return db.Close(); }
+
+    private:
+    SqliteOutput db;
+    sqlite3_stmt* insert_config;
+    sqlite3_stmt* insert_perf;
+};
+
+#endif // GUARD_PDBMERGE_SQLITE_H_
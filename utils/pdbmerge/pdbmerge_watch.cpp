@@ -0,0 +1,245 @@
+/*******************************************************************************
+ *
+ * MIT License
+ *
+ * Copyright (c) 2022 Advanced Micro Devices, Inc.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *******************************************************************************/
+#include "pdbmerge_merger.h"
+
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+int DbMerger::Checkpoint(bool last)
+{
+    std::vector<std::pair<bpath*, bpath>> renames;
+
+    for(auto* path :
+        {&destination_path, &commands_path, &conflicts_path, &conflict_commands_path})
+    {
+        if(path->empty())
+            continue;
+
+        renames.emplace_back(path, *path);
+        *path = path->parent_path() / ("." + path->filename().string());
+
+        boost::system::error_code error;
+        boost::filesystem::remove(*path, error);
+    }
+
+    auto exit_code = 0;
+
+    if(last)
+    {
+        exit_code = Process();
+    }
+    else
+    {
+        const RunStats::Phase phase("process");
+        auto& stats        = RunStats::Get();
+        const auto counted =
+            std::make_tuple(stats.keys, stats.conflicting_keys, stats.identical_keys);
+        auto outputs       = OpenOutputs();
+        Diagnostics discarded;
+
+        for(const auto* entry : data.Sorted())
+            if(!Emit(outputs, entry->first, entry->second, discarded))
+                exit_code = 1;
+
+        Close(outputs);
+        std::tie(stats.keys, stats.conflicting_keys, stats.identical_keys) = counted;
+    }
+
+    for(const auto& rename : renames)
+    {
+        // Side outputs are not written by every resolve mode.
+        boost::system::error_code error;
+        const auto written = boost::filesystem::exists(*rename.first, error);
+
+        if(written)
+            boost::filesystem::rename(*rename.first, rename.second, error);
+        if(written && error)
+            ExitWithError("F\tCan not rename file " + rename.first->string(), 2);
+
+        *rename.first = rename.second;
+    }
+
+    return exit_code;
+}
+
+int DbMerger::Watch()
+{
+    struct Inbox
+    {
+        // NOLINTNEXTLINE (hicpp-signed-bitwise)
+        int fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        sigset_t stops{};
+        sigset_t unblocked{};
+        struct sigaction interrupt{};
+        struct sigaction terminate{};
+
+        Inbox()
+        {
+            struct sigaction stop{};
+            stop.sa_handler = &RequestStop;
+            sigemptyset(&stop.sa_mask);
+            sigaction(SIGINT, &stop, &interrupt);
+            sigaction(SIGTERM, &stop, &terminate);
+
+            sigemptyset(&stops);
+            sigaddset(&stops, SIGINT);
+            sigaddset(&stops, SIGTERM);
+            pthread_sigmask(SIG_BLOCK, &stops, &unblocked);
+        }
+
+        Inbox(const Inbox&)            = delete;
+        Inbox& operator=(const Inbox&) = delete;
+
+        ~Inbox()
+        {
+            if(fd >= 0)
+                close(fd);
+            pthread_sigmask(SIG_SETMASK, &unblocked, nullptr);
+            sigaction(SIGINT, &interrupt, nullptr);
+            sigaction(SIGTERM, &terminate, nullptr);
+        }
+    };
+
+    const Inbox inbox;
+    stop_requested = 0;
+
+    // NOLINTNEXTLINE (hicpp-signed-bitwise)
+    const auto events = IN_CLOSE_WRITE | IN_MOVED_TO;
+
+    if(inbox.fd < 0 || inotify_add_watch(inbox.fd, watch_dir.c_str(), events) < 0)
+        ExitWithError("F\tCan not watch directory " + watch_dir.string(), 2);
+
+    // A name is merged again when it names another file or the file changed, rescans and
+    // repeated events of a file already merged are skipped.
+    using Fragment = std::tuple<dev_t, ino_t, off_t, std::int64_t>;
+    std::unordered_map<std::string, Fragment> seen;
+    auto merged = SourceFiles::Count() != 0;
+
+    const auto take = [&](const bpath& path) {
+        struct stat info;
+        if(stat(path.c_str(), &info) != 0)
+            return;
+
+        const auto fragment = Fragment{
+            info.st_dev, info.st_ino, info.st_size, DbIndex::ModificationTime(info)};
+        const auto known = seen.find(path.filename().string());
+
+        if(known != seen.end() && known->second == fragment)
+        {
+            if(Diagnostics::Verbosity() >= 3)
+                std::cerr << "W\tFile already merged, skipped: " << path.string() << std::endl;
+            return;
+        }
+
+        if(known != seen.end() && Diagnostics::Verbosity() >= 1)
+            std::cerr << "W\tFile replaced since it was merged, merged again: " << path.string()
+                      << std::endl;
+        seen[path.filename().string()] = fragment;
+
+        const auto id = SourceFiles::Add(path);
+        RunStats::Get().AddSources();
+        if(policy)
+            policy->SourcesAdded();
+
+        const RunStats::Phase phase("parse");
+        ParseFile(id, Diagnostics::Main());
+        merged = true;
+    };
+
+    // Files landing from now on are seen by inotify, the ones already there are listed.
+    auto rescan = true;
+    auto next   = std::chrono::steady_clock::now() + std::chrono::seconds(checkpoint);
+
+    while(stop_requested == 0)
+    {
+        if(rescan)
+        {
+            for(const auto& path : SourceDiscovery::Discover({watch_dir.string()}))
+                take(path);
+            rescan = false;
+        }
+
+        const auto now = std::chrono::steady_clock::now();
+
+        if(now >= next)
+        {
+            if(merged)
+                Checkpoint(false);
+            merged = false;
+            next   = now + std::chrono::seconds(checkpoint);
+            continue;
+        }
+
+        const auto left = std::chrono::duration_cast<std::chrono::nanoseconds>(next - now);
+        timespec timeout{};
+        timeout.tv_sec  = left.count() / 1000000000;
+        timeout.tv_nsec = left.count() % 1000000000;
+
+        pollfd ready{inbox.fd, POLLIN, 0};
+        if(ppoll(&ready, 1, &timeout, &inbox.unblocked) <= 0)
+            continue;
+
+        alignas(inotify_event) std::array<char, 4096> buffer;
+        std::vector<std::string> landed;
+
+        for(auto got = read(inbox.fd, buffer.data(), buffer.size()); got > 0;
+            got      = read(inbox.fd, buffer.data(), buffer.size()))
+        {
+            for(ssize_t offset = 0; offset < got;)
+            {
+                const auto* event =
+                    reinterpret_cast<const inotify_event*>(buffer.data() + offset); // NOLINT
+                offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+
+                if((event->mask & IN_Q_OVERFLOW) != 0) // NOLINT (hicpp-signed-bitwise)
+                    rescan = true;
+                else if(event->len > 0 && event->name[0] != '.' &&
+                        (event->mask & IN_ISDIR) == 0) // NOLINT (hicpp-signed-bitwise)
+                    landed.emplace_back(event->name);
+            }
+        }
+
+        for(const auto& name : landed)
+            take(watch_dir / name);
+    }
+
+    return Checkpoint(true);
+}